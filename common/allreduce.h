@@ -0,0 +1,232 @@
+/*
+ * allreduce.h
+ * Bandwidth-optimal allreduce algorithms built on point-to-point messages.
+ *
+ *   ar_ring(buf, count, type, op, comm)          reduce-scatter + allgather
+ *                                                around the ring
+ *   ar_rabenseifner(buf, count, type, op, comm)  recursive halving
+ *                                                reduce-scatter + recursive
+ *                                                doubling allgather
+ *   ar_auto(buf, count, type, op, comm)          pick by message size
+ *
+ * All work in place on buf (count elements of a predefined or contiguous
+ * type) and assume a commutative op; the reduction itself is
+ * MPI_Reduce_local, so any such type/op pair works. They return MPI_SUCCESS
+ * or the first MPI error.
+ *
+ * Cost for n bytes on P ranks (alpha = latency, beta = time per byte):
+ *   ring           2 (P-1) alpha + 2 (P-1)/P n beta
+ *   Rabenseifner   2 log2 P alpha + 2 (P-1)/P n beta   (+2 steps if P is
+ *                  not a power of two: the extra ranks fold into partners)
+ * Both move the minimum 2 (P-1)/P n bytes per rank, against n log2 P for
+ * the recursive doubling a library typically uses for short messages.
+ *
+ * Large exchanges are cut into AR_SEG_BYTES segments: two segments are
+ * received ahead while the previous one is reduced, so the reduction
+ * overlaps the transfer instead of following it.
+ *
+ * ar_auto uses MPI_Allreduce below AR_SMALL_BYTES, Rabenseifner up to
+ * AR_LARGE_BYTES and the ring above. The defaults come from
+ * mpi/bench/allreduce.c on our machine, which prints the crossovers it
+ * measures; override them with -DAR_SMALL_BYTES=... -DAR_LARGE_BYTES=...
+ */
+#ifndef ALLREDUCE_H
+#define ALLREDUCE_H
+
+#include <mpi.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef AR_SEG_BYTES
+#define AR_SEG_BYTES (64 * 1024)
+#endif
+#ifndef AR_SMALL_BYTES
+#define AR_SMALL_BYTES (8 * 1024)
+#endif
+#ifndef AR_LARGE_BYTES
+#define AR_LARGE_BYTES (2 * 1024 * 1024)
+#endif
+#define AR_TAG 7301
+
+/* Block b of count elements split in P parts (first count % P get one more) */
+static inline void ar_block(int count, int P, int b, int *start, int *n) {
+    int base = count / P, rem = count % P;
+    *start = b * base + (b < rem ? b : rem);
+    *n = base + (b < rem ? 1 : 0);
+}
+
+/*
+ * Send scount elements at sbuf to dst, receive rcount elements from src and
+ * reduce them into rbuf. Messages are cut into seg-element segments; both
+ * sides cut the same way, so segments match in order. tmp holds 2 seg.
+ */
+static inline int ar_xchg_reduce(const char *sbuf, int scount, int dst, char *rbuf, int rcount, int src,
+                                 char *tmp, int seg, MPI_Datatype type, MPI_Aint ext, MPI_Op op, MPI_Comm comm) {
+    int err;
+    if (scount <= seg && rcount <= seg) {
+        err = MPI_Sendrecv(sbuf, scount, type, dst, AR_TAG, tmp, rcount, type, src, AR_TAG,
+                           comm, MPI_STATUS_IGNORE);
+        if (err == MPI_SUCCESS && rcount > 0) err = MPI_Reduce_local(tmp, rbuf, rcount, type, op);
+        return err;
+    }
+    int ns = (scount + seg - 1) / seg, nr = (rcount + seg - 1) / seg;
+    MPI_Request *sreq = malloc((ns ? ns : 1) * sizeof(MPI_Request)), rreq[2];
+    for (int k = 0; k < 2 && k < nr; k++) {
+        int n = rcount - k * seg < seg ? rcount - k * seg : seg;
+        MPI_Irecv(tmp + k * seg * ext, n, type, src, AR_TAG, comm, &rreq[k]);
+    }
+    for (int k = 0; k < ns; k++) {
+        int n = scount - k * seg < seg ? scount - k * seg : seg;
+        MPI_Isend(sbuf + (size_t) k * seg * ext, n, type, dst, AR_TAG, comm, &sreq[k]);
+    }
+    err = MPI_SUCCESS;
+    for (int k = 0; k < nr; k++) {
+        int n = rcount - k * seg < seg ? rcount - k * seg : seg;
+        char *t = tmp + (k & 1) * seg * ext;
+        MPI_Wait(&rreq[k & 1], MPI_STATUS_IGNORE);
+        if (err == MPI_SUCCESS) err = MPI_Reduce_local(t, rbuf + (size_t) k * seg * ext, n, type, op);
+        if (k + 2 < nr) {
+            int m = rcount - (k + 2) * seg < seg ? rcount - (k + 2) * seg : seg;
+            MPI_Irecv(t, m, type, src, AR_TAG, comm, &rreq[k & 1]);
+        }
+    }
+    int werr = MPI_Waitall(ns, sreq, MPI_STATUSES_IGNORE);
+    free(sreq);
+    return err != MPI_SUCCESS ? err : werr;
+}
+
+static inline int ar_seg_count(MPI_Aint ext) {
+    int seg = (int) (AR_SEG_BYTES / (ext > 0 ? ext : 1));
+    return seg > 0 ? seg : 1;
+}
+
+/*
+ * Ring: P - 1 steps of reduce-scatter (at step s rank r sends block r - s to
+ * its right neighbour and reduces block r - s - 1 from its left), after
+ * which rank r owns the full sum of block r + 1; then P - 1 steps of
+ * allgather pass the finished blocks around.
+ */
+static inline int ar_ring(void *buf, int count, MPI_Datatype type, MPI_Op op, MPI_Comm comm) {
+    int rank, P, err = MPI_SUCCESS;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &P);
+    if (P == 1 || count == 0) return MPI_SUCCESS;
+    MPI_Aint lb, ext;
+    MPI_Type_get_extent(type, &lb, &ext);
+    char *b = (char *) buf;
+    int right = (rank + 1) % P, left = (rank - 1 + P) % P;
+
+    int seg = ar_seg_count(ext), maxblk = (count + P - 1) / P;
+    if (seg > maxblk) seg = maxblk;
+    char *tmp = malloc((size_t) 2 * seg * ext);
+    if (!tmp) return MPI_ERR_NO_MEM;
+
+    for (int s = 0; s < P - 1 && err == MPI_SUCCESS; s++) {
+        int sb = (rank - s + P) % P, rb = (rank - s - 1 + P) % P, s0, sn, r0, rn;
+        ar_block(count, P, sb, &s0, &sn);
+        ar_block(count, P, rb, &r0, &rn);
+        err = ar_xchg_reduce(b + s0 * ext, sn, right, b + r0 * ext, rn, left, tmp, seg, type, ext, op, comm);
+    }
+    for (int s = 0; s < P - 1 && err == MPI_SUCCESS; s++) {
+        int sb = (rank + 1 - s + P) % P, rb = (rank - s + P) % P, s0, sn, r0, rn;
+        ar_block(count, P, sb, &s0, &sn);
+        ar_block(count, P, rb, &r0, &rn);
+        err = MPI_Sendrecv(b + s0 * ext, sn, type, right, AR_TAG, b + r0 * ext, rn, type, left, AR_TAG,
+                           comm, MPI_STATUS_IGNORE);
+    }
+    free(tmp);
+    return err;
+}
+
+/*
+ * Rabenseifner. With p2 the largest power of two <= P and rem = P - p2,
+ * ranks below 2 rem first fold pairwise (the even one sends everything to
+ * the odd one and sits out), leaving p2 active ranks. Recursive halving:
+ * at distance p2/2, p2/4, .., 1 partners split their current range, each
+ * keeps one half and reduces the partner's copy of it into its own. Each
+ * rank then owns 1/p2 of the sum, and recursive doubling retraces the
+ * splits to gather the rest. Finally the odd ranks send the result back.
+ */
+static inline int ar_rabenseifner(void *buf, int count, MPI_Datatype type, MPI_Op op, MPI_Comm comm) {
+    int rank, P, err = MPI_SUCCESS;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &P);
+    if (P == 1 || count == 0) return MPI_SUCCESS;
+    MPI_Aint lb, ext;
+    MPI_Type_get_extent(type, &lb, &ext);
+    char *b = (char *) buf;
+
+    int p2 = 1;
+    while (p2 * 2 <= P) p2 *= 2;
+    int rem = P - p2;
+    int seg = ar_seg_count(ext), half = (count + 1) / 2;
+    if (seg > half) seg = half;
+    char *tmp = malloc((size_t) 2 * seg * ext);
+    if (!tmp) return MPI_ERR_NO_MEM;
+
+    int nr;     /* rank among the p2 active ranks, -1 if folded away */
+    if (rank < 2 * rem) {
+        if (rank % 2 == 0) {
+            err = ar_xchg_reduce(b, count, rank + 1, NULL, 0, MPI_PROC_NULL, tmp, seg, type, ext, op, comm);
+            nr = -1;
+        } else {
+            err = ar_xchg_reduce(b, 0, MPI_PROC_NULL, b, count, rank - 1, tmp, seg, type, ext, op, comm);
+            nr = rank / 2;
+        }
+    } else {
+        nr = rank - rem;
+    }
+
+    if (nr >= 0) {
+        int lo = 0, hi = count, steps = 0, lo_s[32], hi_s[32], low_s[32];
+        for (int mask = p2 / 2; mask > 0 && err == MPI_SUCCESS; mask /= 2, steps++) {
+            int pn = nr ^ mask, peer = pn < rem ? 2 * pn + 1 : pn + rem;
+            int mid = lo + (hi - lo) / 2;
+            lo_s[steps] = lo;
+            hi_s[steps] = hi;
+            low_s[steps] = nr < pn;
+            if (nr < pn) {      /* keep [lo, mid), send [mid, hi) */
+                err = ar_xchg_reduce(b + mid * ext, hi - mid, peer, b + lo * ext, mid - lo, peer,
+                                     tmp, seg, type, ext, op, comm);
+                hi = mid;
+            } else {            /* keep [mid, hi), send [lo, mid) */
+                err = ar_xchg_reduce(b + lo * ext, mid - lo, peer, b + mid * ext, hi - mid, peer,
+                                     tmp, seg, type, ext, op, comm);
+                lo = mid;
+            }
+        }
+        for (int mask = 1; mask < p2 && err == MPI_SUCCESS; mask *= 2) {
+            int pn = nr ^ mask, peer = pn < rem ? 2 * pn + 1 : pn + rem;
+            int L = lo_s[--steps], H = hi_s[steps];
+            int olo = low_s[steps] ? hi : L, ohi = low_s[steps] ? H : lo;   /* the partner's half */
+            err = MPI_Sendrecv(b + lo * ext, hi - lo, type, peer, AR_TAG, b + olo * ext, ohi - olo, type,
+                               peer, AR_TAG, comm, MPI_STATUS_IGNORE);
+            lo = L;
+            hi = H;
+        }
+    }
+
+    if (rank < 2 * rem && err == MPI_SUCCESS) {
+        if (rank % 2 == 0) err = MPI_Recv(b, count, type, rank + 1, AR_TAG, comm, MPI_STATUS_IGNORE);
+        else err = MPI_Send(b, count, type, rank - 1, AR_TAG, comm);
+    }
+    free(tmp);
+    return err;
+}
+
+/*
+ * Size-based choice; see AR_SMALL_BYTES / AR_LARGE_BYTES. On our machine
+ * (Open MPI 4.1, shared memory, 4 ranks) the library wins up to a few KB,
+ * Rabenseifner in the middle, and the ring from 2 MB, where it runs 1.5x
+ * faster than MPI_Allreduce at 32-64 MB.
+ */
+static inline int ar_auto(void *buf, int count, MPI_Datatype type, MPI_Op op, MPI_Comm comm) {
+    int tsize;
+    MPI_Type_size(type, &tsize);
+    size_t bytes = (size_t) count * tsize;
+    if (bytes < AR_SMALL_BYTES) return MPI_Allreduce(MPI_IN_PLACE, buf, count, type, op, comm);
+    if (bytes < AR_LARGE_BYTES) return ar_rabenseifner(buf, count, type, op, comm);
+    return ar_ring(buf, count, type, op, comm);
+}
+
+#endif /* ALLREDUCE_H */
@@ -0,0 +1,494 @@
+/*
+ * compress.h
+ * Compressed transport for large arrays of doubles: in-tree float codecs
+ * and chunked send / recv / bcast that overlap coding with the transfer.
+ *
+ *   cz_parse(&cfg, "none" | "lossless" | "lossy=1e-6")
+ *   cz_send(x, n, dest, tag, comm, &cfg, &st)   \  same cfg on both sides;
+ *   cz_recv(x, n, src, tag, comm, &cfg, &st)    /  mode none = plain MPI
+ *   cz_bcast(x, n, root, comm, &cfg, &st)
+ *   cz_report(&st, seconds, raw_seconds, label, comm)   ratio, bandwidth, cost
+ *
+ * Codec, per chunk of cfg.chunk doubles (a self-describing CZ_HDR header
+ * plus body):
+ *   lossless  up to two candidates, the smaller is kept:
+ *             - LZ on the raw bytes: quantized data (few distinct values)
+ *               repeats whole 8-byte values, which shuffling would break up
+ *             - if that did not halve the chunk: XOR with the previous
+ *               value's bits, byte-shuffle (all first bytes, then all
+ *               second bytes, ...), LZ: smooth data leaves long zero runs
+ *               in the high planes
+ *   lossy     q = round(x / (2 eb)) (|error| <= eb), zigzag deltas of q,
+ *             byte-shuffle, LZ; a chunk where any value fails the bound
+ *             once rebuilt as q * 2 eb (|q| near 2^52 and up, where the
+ *             division and product round) falls back to lossless
+ *   and a chunk that does not shrink is stored as is.
+ * LZ is an LZ4-style byte coder (4-byte hash, 64 KB window, token with
+ * literal / match length nibbles), written here so there is no dependency.
+ *
+ * Transfers go chunk by chunk with two buffers on each side: the sender
+ * codes chunk k + 1 while chunk k is on the wire, the receiver decodes
+ * chunk k while k + 1 arrives. Broadcast chunks carry their length in a
+ * small Ibcast ahead of the data. In lossy mode the bcast root replaces
+ * its own copy by the decoded values, so all ranks hold the same data.
+ *
+ * Worth it only when the wire is slower than the coder, about 120-250 MB/s
+ * per core here on typical float data and ~1 GB/s on repetitive matrices:
+ * over a network (1-10 Gb/s), not through shared memory on one node, where
+ * the plain transfer is ~10x faster. mpi/bench/compress.c measures ratio,
+ * coding throughput and the break-even link bandwidth per kind of data.
+ */
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include <mpi.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef CZ_CHUNK
+#define CZ_CHUNK 32768          /* doubles per chunk (256 KB) */
+#endif
+#define CZ_HASH_BITS 12
+#define CZ_MIN_MATCH 4
+#define CZ_WINDOW 65535
+
+enum { CZ_NONE, CZ_LOSSLESS, CZ_LOSSY };
+
+/* chunk methods (header field) */
+#define CZ_M_STORED 0u
+#define CZ_M_LZ 1u              /* body is LZ coded */
+#define CZ_M_XOR 2u             /* XOR with the previous value */
+#define CZ_M_SHUF 4u            /* byte-shuffled */
+#define CZ_M_QUANT 8u           /* quantized integers, zigzag deltas */
+
+typedef struct {
+    int mode;
+    double eb;                  /* lossy: absolute error bound */
+    size_t chunk;               /* doubles per chunk */
+} cz_cfg_t;
+
+typedef struct {
+    double raw, wire;           /* bytes before and after coding */
+    double t_code, t_decode;    /* seconds spent compressing / decompressing */
+} cz_stats_t;
+
+typedef struct {
+    uint32_t raw, body, method, pad;
+    double step;                /* quantization step, CZ_M_QUANT only */
+} cz_hdr_t;
+
+#define CZ_HDR sizeof(cz_hdr_t)
+#define CZ_BOUND(raw_bytes) (CZ_HDR + (raw_bytes))
+
+/* 0 on success */
+static inline int cz_parse(cz_cfg_t *cfg, const char *s) {
+    cfg->mode = CZ_NONE;
+    cfg->chunk = CZ_CHUNK;
+    cfg->eb = 0.0;
+    if (!s || strcmp(s, "none") == 0) return 0;
+    if (strcmp(s, "lossless") == 0) cfg->mode = CZ_LOSSLESS;
+    else if (strncmp(s, "lossy=", 6) == 0 && (cfg->eb = atof(s + 6)) > 0.0) cfg->mode = CZ_LOSSY;
+    else return -1;
+    return 0;
+}
+
+static inline const char *cz_name(const cz_cfg_t *cfg) {
+    return cfg->mode == CZ_LOSSLESS ? "lossless" : cfg->mode == CZ_LOSSY ? "lossy" : "none";
+}
+
+/* ---- LZ ---- */
+
+static inline uint32_t cz_read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+/* Length extension: 255, 255, .., rest */
+static inline int cz_put_len(uint8_t *out, size_t *op, size_t cap, size_t len) {
+    for (; len >= 255; len -= 255) {
+        if (*op >= cap) return -1;
+        out[(*op)++] = 255;
+    }
+    if (*op >= cap) return -1;
+    out[(*op)++] = (uint8_t) len;
+    return 0;
+}
+
+static inline int cz_put_seq(uint8_t *out, size_t *op, size_t cap, const uint8_t *lit, size_t nlit,
+                             size_t off, size_t mlen) {
+    size_t m = mlen ? mlen - CZ_MIN_MATCH : 0;
+    if (*op >= cap) return -1;
+    out[(*op)++] = (uint8_t) ((nlit < 15 ? nlit : 15) << 4 | (m < 15 ? m : 15));
+    if (nlit >= 15 && cz_put_len(out, op, cap, nlit - 15) != 0) return -1;
+    if (*op + nlit > cap) return -1;
+    memcpy(out + *op, lit, nlit);
+    *op += nlit;
+    if (!mlen) return 0;
+    if (*op + 2 > cap) return -1;
+    out[(*op)++] = (uint8_t) off;
+    out[(*op)++] = (uint8_t) (off >> 8);
+    if (m >= 15 && cz_put_len(out, op, cap, m - 15) != 0) return -1;
+    return 0;
+}
+
+/* Length of the common prefix of a and b, at most max */
+static inline size_t cz_match_len(const uint8_t *a, const uint8_t *b, size_t max) {
+    size_t len = 0;
+    while (len + 8 <= max) {
+        uint64_t x, y;
+        memcpy(&x, a + len, 8);
+        memcpy(&y, b + len, 8);
+        if (x != y) return len + (size_t) (__builtin_ctzll(x ^ y) >> 3);     /* little endian */
+        len += 8;
+    }
+    while (len < max && a[len] == b[len]) len++;
+    return len;
+}
+
+/*
+ * Compress n bytes into at most cap bytes; returns the size, 0 if it does
+ * not fit. As in LZ4 the search step grows with the misses since the last
+ * match, so incompressible stretches are skipped quickly.
+ */
+static inline size_t cz_lz_encode(const uint8_t *in, size_t n, uint8_t *out, size_t cap) {
+    uint32_t ht[1 << CZ_HASH_BITS];
+    memset(ht, 0, sizeof ht);
+    size_t ip = 0, anchor = 0, op = 0, misses = 0;
+    while (ip + CZ_MIN_MATCH <= n) {
+        uint32_t seq = cz_read32(in + ip), h = (seq * 2654435761u) >> (32 - CZ_HASH_BITS);
+        size_t ref = ht[h];
+        ht[h] = (uint32_t) ip + 1;
+        if (ref && ip - (ref - 1) <= CZ_WINDOW && cz_read32(in + ref - 1) == seq) {
+            ref--;
+            size_t len = CZ_MIN_MATCH + cz_match_len(in + ref + CZ_MIN_MATCH, in + ip + CZ_MIN_MATCH,
+                                                     n - ip - CZ_MIN_MATCH);
+            if (cz_put_seq(out, &op, cap, in + anchor, ip - anchor, ip - ref, len) != 0) return 0;
+            ip += len;
+            anchor = ip;
+            misses = 0;
+        } else {
+            ip += 1 + (misses++ >> 5);
+        }
+    }
+    if (cz_put_seq(out, &op, cap, in + anchor, n - anchor, 0, 0) != 0) return 0;
+    return op;
+}
+
+/* Decode exactly n bytes; 0 on success, -1 on corrupt input */
+static inline int cz_lz_decode(const uint8_t *in, size_t len, uint8_t *out, size_t n) {
+    size_t ip = 0, op = 0;
+    while (ip < len) {
+        unsigned tok = in[ip++];
+        size_t nlit = tok >> 4, m = tok & 15;
+        if (nlit == 15)
+            for (unsigned b = 255; b == 255 && ip < len;) nlit += (b = in[ip++]);
+        if (nlit > len - ip || nlit > n - op) return -1;
+        memcpy(out + op, in + ip, nlit);
+        ip += nlit;
+        op += nlit;
+        if (ip == len) break;               /* last sequence: literals only */
+        if (len - ip < 2) return -1;
+        size_t off = in[ip] | (size_t) in[ip + 1] << 8;
+        ip += 2;
+        if (m == 15)
+            for (unsigned b = 255; b == 255 && ip < len;) m += (b = in[ip++]);
+        m += CZ_MIN_MATCH;
+        if (off == 0 || off > op || m > n - op) return -1;
+        if (off >= m) memcpy(out + op, out + op - off, m);
+        else
+            for (size_t i = 0; i < m; i++) out[op + i] = out[op + i - off];    /* overlapping run */
+        op += m;
+    }
+    return op == n ? 0 : -1;
+}
+
+/* ---- filters ---- */
+
+/* Plane by plane: one sequential stream per byte position */
+static inline void cz_shuffle(const uint8_t *in, size_t n, uint8_t *out) {
+    for (int b = 0; b < 8; b++) {
+        const uint8_t *p = in + b;
+        uint8_t *o = out + b * n;
+        for (size_t i = 0; i < n; i++) o[i] = p[i * 8];
+    }
+}
+
+static inline void cz_unshuffle(const uint8_t *in, size_t n, uint8_t *out) {
+    for (int b = 0; b < 8; b++) {
+        const uint8_t *p = in + b * n;
+        uint8_t *o = out + b;
+        for (size_t i = 0; i < n; i++) o[i * 8] = p[i];
+    }
+}
+
+/*
+ * Code n doubles into out (room for CZ_BOUND(8 n)); work holds 16 n bytes.
+ * Returns the chunk size in bytes.
+ */
+static inline size_t cz_encode(const cz_cfg_t *cfg, const double *x, size_t n, uint8_t *out, uint8_t *work) {
+    cz_hdr_t h = { (uint32_t) (8 * n), (uint32_t) (8 * n), CZ_M_STORED, 0, 0.0 };
+    uint8_t *body = out + CZ_HDR, *filt = work, *shuf = work + 8 * n;
+    uint64_t *u = (uint64_t *) filt;
+    size_t raw = 8 * n, best = raw, sz;
+    int quant = cfg->mode == CZ_LOSSY;
+
+    if (quant) {
+        double step = 2.0 * cfg->eb;
+        int64_t prev = 0;
+        for (size_t i = 0; i < n && quant; i++) {
+            double q = x[i] / step;
+            if (!(fabs(q) < 0x1p52)) {      /* also catches NaN / inf */
+                quant = 0;
+                break;
+            }
+            int64_t v = (int64_t) (q < 0 ? q - 0.5 : q + 0.5), d = (int64_t) ((uint64_t) v - (uint64_t) prev);
+            /* x / step and v * step round: check what the decoder will rebuild
+               (volatile keeps the product rounded, as the decoder stores it,
+               instead of fused into an FMA with the subtraction) */
+            volatile double r = (double) v * step;
+            if (!(fabs(x[i] - r) <= cfg->eb)) {
+                quant = 0;
+                break;
+            }
+            u[i] = ((uint64_t) d << 1) ^ (uint64_t) (d >> 63);
+            prev = v;
+        }
+        if (quant) {
+            h.step = step;
+            cz_shuffle(filt, n, shuf);
+            sz = cz_lz_encode(shuf, raw, body, raw - 1);
+            if (sz) {
+                best = sz;
+                h.method = CZ_M_QUANT | CZ_M_SHUF | CZ_M_LZ;
+            } else {                        /* incompressible: keep the shuffled q */
+                memcpy(body, shuf, raw);
+                h.method = CZ_M_QUANT | CZ_M_SHUF;
+            }
+        }
+    }
+    if (!quant) {
+        /* LZ on the raw bytes first; when it does not halve the chunk,
+           also try XOR + shuffle + LZ and keep the smaller */
+        sz = cz_lz_encode((const uint8_t *) x, raw, body, raw - 1);
+        if (sz) {
+            best = sz;
+            h.method = CZ_M_LZ;
+        }
+        if (best > raw / 2) {
+            uint64_t prev = 0;
+            for (size_t i = 0; i < n; i++) {
+                uint64_t v;
+                memcpy(&v, &x[i], 8);
+                u[i] = v ^ prev;
+                prev = v;
+            }
+            cz_shuffle(filt, n, shuf);
+            sz = cz_lz_encode(shuf, raw, filt, best - 1);
+            if (sz) {
+                memcpy(body, filt, sz);
+                best = sz;
+                h.method = CZ_M_XOR | CZ_M_SHUF | CZ_M_LZ;
+            }
+        }
+        if (h.method == CZ_M_STORED) memcpy(body, x, raw);
+    }
+    h.body = (uint32_t) best;
+    memcpy(out, &h, CZ_HDR);
+    return CZ_HDR + best;
+}
+
+/* Decode a chunk of n doubles; work holds 16 n bytes. 0 on success. */
+static inline int cz_decode(const uint8_t *in, size_t len, double *x, size_t n, uint8_t *work) {
+    cz_hdr_t h;
+    if (len < CZ_HDR) return -1;
+    memcpy(&h, in, CZ_HDR);
+    if (h.raw != 8 * n || h.body != len - CZ_HDR) return -1;
+    const uint8_t *body = in + CZ_HDR;
+    uint8_t *a = work, *b = work + 8 * n;
+    size_t raw = 8 * n;
+
+    if (h.method & CZ_M_LZ) {
+        if (cz_lz_decode(body, h.body, a, raw) != 0) return -1;
+    } else {
+        if (h.body != raw) return -1;
+        memcpy(a, body, raw);
+    }
+    if (h.method & CZ_M_SHUF) {
+        cz_unshuffle(a, n, b);
+        uint8_t *t = a;
+        a = b;
+        b = t;
+    }
+    const uint64_t *u = (const uint64_t *) a;
+    if (h.method & CZ_M_QUANT) {
+        int64_t v = 0;
+        for (size_t i = 0; i < n; i++) {
+            uint64_t z = u[i];
+            v = (int64_t) ((uint64_t) v + ((z >> 1) ^ (0 - (z & 1))));
+            x[i] = (double) v * h.step;
+        }
+    } else if (h.method & CZ_M_XOR) {
+        uint64_t prev = 0;
+        for (size_t i = 0; i < n; i++) {
+            prev ^= u[i];
+            memcpy(&x[i], &prev, 8);
+        }
+    } else {
+        memcpy(x, a, raw);
+    }
+    return 0;
+}
+
+/* ---- transport ---- */
+
+typedef struct {
+    uint8_t *buf[2], *work;
+    size_t chunk;
+} cz_bufs_t;
+
+static inline int cz_bufs_init(cz_bufs_t *b, size_t chunk) {
+    b->chunk = chunk;
+    b->buf[0] = malloc(CZ_BOUND(8 * chunk));
+    b->buf[1] = malloc(CZ_BOUND(8 * chunk));
+    b->work = malloc(16 * chunk);
+    return b->buf[0] && b->buf[1] && b->work ? 0 : -1;
+}
+
+static inline void cz_bufs_free(cz_bufs_t *b) {
+    free(b->buf[0]);
+    free(b->buf[1]);
+    free(b->work);
+}
+
+static inline size_t cz_chunk_len(size_t n, size_t chunk, size_t k) {
+    return n - k * chunk < chunk ? n - k * chunk : chunk;
+}
+
+static inline int cz_send(const double *x, size_t n, int dest, int tag, MPI_Comm comm,
+                          const cz_cfg_t *cfg, cz_stats_t *st) {
+    if (cfg->mode == CZ_NONE) {
+        for (size_t k = 0; k * cfg->chunk < n; k++)
+            MPI_Send(x + k * cfg->chunk, (int) cz_chunk_len(n, cfg->chunk, k), MPI_DOUBLE, dest, tag, comm);
+        st->raw += 8.0 * n;
+        st->wire += 8.0 * n;
+        return MPI_SUCCESS;
+    }
+    cz_bufs_t b;
+    if (cz_bufs_init(&b, cfg->chunk) != 0) return MPI_ERR_NO_MEM;
+    MPI_Request req[2] = { MPI_REQUEST_NULL, MPI_REQUEST_NULL };
+    for (size_t k = 0; k * cfg->chunk < n; k++) {
+        size_t m = cz_chunk_len(n, cfg->chunk, k);
+        MPI_Wait(&req[k & 1], MPI_STATUS_IGNORE);         /* buffer of chunk k - 2 free */
+        double t0 = MPI_Wtime();
+        size_t len = cz_encode(cfg, x + k * cfg->chunk, m, b.buf[k & 1], b.work);
+        st->t_code += MPI_Wtime() - t0;
+        st->raw += 8.0 * m;
+        st->wire += (double) len;
+        MPI_Isend(b.buf[k & 1], (int) len, MPI_BYTE, dest, tag, comm, &req[k & 1]);
+    }
+    MPI_Waitall(2, req, MPI_STATUSES_IGNORE);
+    cz_bufs_free(&b);
+    return MPI_SUCCESS;
+}
+
+static inline int cz_recv(double *x, size_t n, int src, int tag, MPI_Comm comm,
+                          const cz_cfg_t *cfg, cz_stats_t *st) {
+    if (cfg->mode == CZ_NONE) {
+        for (size_t k = 0; k * cfg->chunk < n; k++)
+            MPI_Recv(x + k * cfg->chunk, (int) cz_chunk_len(n, cfg->chunk, k), MPI_DOUBLE, src, tag, comm,
+                     MPI_STATUS_IGNORE);
+        return MPI_SUCCESS;
+    }
+    cz_bufs_t b;
+    if (cz_bufs_init(&b, cfg->chunk) != 0) return MPI_ERR_NO_MEM;
+    size_t nch = (n + cfg->chunk - 1) / cfg->chunk;
+    int cap = (int) CZ_BOUND(8 * cfg->chunk), err = MPI_SUCCESS;
+    MPI_Request req[2];
+    for (size_t k = 0; k < 2 && k < nch; k++) MPI_Irecv(b.buf[k], cap, MPI_BYTE, src, tag, comm, &req[k]);
+    for (size_t k = 0; k < nch; k++) {
+        MPI_Status s;
+        int len;
+        MPI_Wait(&req[k & 1], &s);
+        MPI_Get_count(&s, MPI_BYTE, &len);
+        double t0 = MPI_Wtime();
+        if (cz_decode(b.buf[k & 1], len, x + k * cfg->chunk, cz_chunk_len(n, cfg->chunk, k), b.work) != 0)
+            err = MPI_ERR_TRUNCATE;
+        st->t_decode += MPI_Wtime() - t0;
+        if (k + 2 < nch) MPI_Irecv(b.buf[k & 1], cap, MPI_BYTE, src, tag, comm, &req[k & 1]);
+    }
+    cz_bufs_free(&b);
+    return err;
+}
+
+static inline int cz_bcast(double *x, size_t n, int root, MPI_Comm comm, const cz_cfg_t *cfg, cz_stats_t *st) {
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    if (cfg->mode == CZ_NONE) {
+        for (size_t k = 0; k * cfg->chunk < n; k++)
+            MPI_Bcast(x + k * cfg->chunk, (int) cz_chunk_len(n, cfg->chunk, k), MPI_DOUBLE, root, comm);
+        st->raw += 8.0 * n;
+        st->wire += 8.0 * n;
+        return MPI_SUCCESS;
+    }
+    cz_bufs_t b;
+    if (cz_bufs_init(&b, cfg->chunk) != 0) return MPI_ERR_NO_MEM;
+    size_t nch = (n + cfg->chunk - 1) / cfg->chunk;
+    int len[2] = { 0, 0 }, err = MPI_SUCCESS;
+    MPI_Request dreq[2] = { MPI_REQUEST_NULL, MPI_REQUEST_NULL }, lreq;
+    for (size_t k = 0; k <= nch; k++) {
+        int cur = k & 1, prv = cur ^ 1;
+        if (k < nch) {
+            size_t m = cz_chunk_len(n, cfg->chunk, k);
+            MPI_Wait(&dreq[cur], MPI_STATUS_IGNORE);      /* chunk k - 2 done */
+            if (rank == root) {
+                double t0 = MPI_Wtime();
+                len[cur] = (int) cz_encode(cfg, x + k * cfg->chunk, m, b.buf[cur], b.work);
+                st->t_code += MPI_Wtime() - t0;
+                st->raw += 8.0 * m;
+                st->wire += len[cur];
+            }
+            MPI_Ibcast(&len[cur], 1, MPI_INT, root, comm, &lreq);
+            MPI_Wait(&lreq, MPI_STATUS_IGNORE);
+            MPI_Ibcast(b.buf[cur], len[cur], MPI_BYTE, root, comm, &dreq[cur]);
+        }
+        /* decode chunk k - 1 while chunk k is in flight (the root only in
+           lossy mode, to keep the same values as everyone else) */
+        if (k > 0 && (rank != root || cfg->mode == CZ_LOSSY)) {
+            size_t j = k - 1;
+            MPI_Wait(&dreq[prv], MPI_STATUS_IGNORE);
+            double t0 = MPI_Wtime();
+            if (cz_decode(b.buf[prv], len[prv], x + j * cfg->chunk, cz_chunk_len(n, cfg->chunk, j), b.work) != 0)
+                err = MPI_ERR_TRUNCATE;
+            st->t_decode += MPI_Wtime() - t0;
+        }
+    }
+    MPI_Waitall(2, dreq, MPI_STATUSES_IGNORE);
+    cz_bufs_free(&b);
+    return err;
+}
+
+/*
+ * Two lines on rank 0: wire ratio and effective bandwidth (raw bytes per
+ * second of the whole transfer, against raw_seconds of the same transfer
+ * uncompressed if > 0), then the coding throughput it cost. Collective
+ * over comm; byte counts come from the sending side, times are the max.
+ */
+static inline void cz_report(const cz_stats_t *st, double seconds, double raw_seconds, const char *label,
+                             MPI_Comm comm) {
+    double v[6] = { st->raw, st->wire, st->t_code, st->t_decode, seconds, raw_seconds }, m[6];
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Reduce(v, m, 6, MPI_DOUBLE, MPI_MAX, 0, comm);
+    if (rank != 0) return;
+    printf("%s: %.1f MB -> %.1f MB (ratio %.2f), %.4f s, %.0f MB/s effective", label, m[0] / 1e6, m[1] / 1e6,
+           m[1] > 0 ? m[0] / m[1] : 1.0, m[4], m[4] > 0 ? m[0] / m[4] / 1e6 : 0.0);
+    if (m[5] > 0) printf(" vs %.4f s uncompressed (%.2fx)", m[5], m[5] / m[4]);
+    printf("\n%s: compress %.4f s (%.0f MB/s), decompress %.4f s (%.0f MB/s)\n", label, m[2],
+           m[2] > 0 ? m[0] / m[2] / 1e6 : 0.0, m[3], m[3] > 0 ? m[0] / m[3] / 1e6 : 0.0);
+}
+
+#endif /* COMPRESS_H */
@@ -0,0 +1,162 @@
+/*
+ * fft.h
+ * Self-contained mixed-radix complex FFT (no external library).
+ *
+ *   fft_plan_init(&p, n)          factor n and build the twiddle table
+ *   fft_exec(&p, in, out, sign)   out = DFT(in), sign -1 forward, +1 inverse
+ *   fft_plan_free(&p)
+ *   fft_good_size(n, mult)        smallest multiple of mult >= n whose
+ *                                 cofactor has only the factors 2, 3, 5, 7
+ *
+ * Recursive decimation in time: n = r * m, the r interleaved sub-sequences
+ * of length m are transformed first, then combined by radix-r butterflies.
+ * Radices 2 and 4 have dedicated butterflies, any other prime factor up to
+ * FFT_MAX_RADIX uses the generic O(r^2) one. The inverse is unscaled.
+ *
+ * A plan is read-only during fft_exec, so one plan can be shared by threads
+ * transforming different rows.
+ */
+#ifndef FFT_H
+#define FFT_H
+
+#include <complex.h>
+#include <math.h>
+#include <stdlib.h>
+
+#define FFT_MAX_RADIX 64
+#define FFT_MAX_FACTORS 64
+
+typedef double complex fft_cpx;
+
+typedef struct {
+    size_t n;
+    int nf;
+    int factors[FFT_MAX_FACTORS];
+    fft_cpx *tw;        /* tw[j] = exp(-2 pi i j / n) */
+} fft_plan_t;
+
+static inline fft_cpx *fft_alloc(size_t n) {
+    void *p = NULL;
+    if (n == 0) n = 1;
+    if (posix_memalign(&p, 64, n * sizeof(fft_cpx)) != 0) return NULL;
+    return (fft_cpx *) p;
+}
+
+/* Returns 0, or -1 when n has a prime factor above FFT_MAX_RADIX */
+static inline int fft_plan_init(fft_plan_t *p, size_t n) {
+    p->n = n;
+    p->nf = 0;
+    p->tw = NULL;
+    size_t m = n;
+    while (m % 4 == 0) { p->factors[p->nf++] = 4; m /= 4; }
+    for (size_t f = 2; m > 1; f++) {
+        while (m % f == 0) {
+            if (f > FFT_MAX_RADIX) return -1;
+            p->factors[p->nf++] = (int) f;
+            m /= f;
+        }
+    }
+    p->tw = fft_alloc(n);
+    if (!p->tw) return -1;
+    for (size_t j = 0; j < n; j++) {
+        double a = -2.0 * M_PI * (double) j / (double) n;
+        p->tw[j] = cos(a) + I * sin(a);
+    }
+    return 0;
+}
+
+static inline void fft_plan_free(fft_plan_t *p) {
+    free(p->tw);
+    p->tw = NULL;
+}
+
+/*
+ * Plain complex product. The C99 operator has to handle inf/nan operands and
+ * becomes a library call (__muldc3) unless -ffast-math is given.
+ */
+static inline fft_cpx fft_mul(fft_cpx a, fft_cpx b) {
+    double ar = creal(a), ai = cimag(a), br = creal(b), bi = cimag(b);
+    return CMPLX(ar * br - ai * bi, ar * bi + ai * br);
+}
+
+/* W_n^j for 0 <= j < n; conjugated for the inverse */
+static inline fft_cpx fft_twiddle(const fft_plan_t *p, size_t j, int sign) {
+    fft_cpx w = p->tw[j];
+    return sign > 0 ? conj(w) : w;
+}
+
+/* Combine r transforms of length m (out[q*m + k]) into one of length r*m */
+static inline void fft_butterfly(const fft_plan_t *p, fft_cpx *out, size_t stride,
+                                 size_t m, int r, int sign) {
+    if (r == 2) {
+        for (size_t k = 0; k < m; k++) {
+            fft_cpx a = out[k], b = fft_mul(out[k + m], fft_twiddle(p, k * stride, sign));
+            out[k] = a + b;
+            out[k + m] = a - b;
+        }
+        return;
+    }
+    if (r == 4) {
+        for (size_t k = 0; k < m; k++) {
+            fft_cpx a0 = out[k];
+            fft_cpx a1 = fft_mul(out[k + m], fft_twiddle(p, k * stride, sign));
+            fft_cpx a2 = fft_mul(out[k + 2 * m], fft_twiddle(p, 2 * k * stride, sign));
+            fft_cpx a3 = fft_mul(out[k + 3 * m], fft_twiddle(p, 3 * k * stride, sign));
+            fft_cpx s02 = a0 + a2, d02 = a0 - a2, s13 = a1 + a3, d = a1 - a3;
+            /* d13 = d * (-i) forward, d * (+i) inverse */
+            fft_cpx d13 = sign > 0 ? CMPLX(-cimag(d), creal(d)) : CMPLX(cimag(d), -creal(d));
+            out[k] = s02 + s13;
+            out[k + m] = d02 + d13;
+            out[k + 2 * m] = s02 - s13;
+            out[k + 3 * m] = d02 - d13;
+        }
+        return;
+    }
+    /* generic radix: W_r^e = W_n^(e n / r), e = q s mod r */
+    fft_cpx t[FFT_MAX_RADIX], wr[FFT_MAX_RADIX];
+    for (int e = 0; e < r; e++) wr[e] = fft_twiddle(p, (size_t) e * m * stride, sign);
+    for (size_t k = 0; k < m; k++) {
+        t[0] = out[k];
+        for (int q = 1; q < r; q++)
+            t[q] = fft_mul(out[k + q * m], fft_twiddle(p, q * k * stride, sign));
+        for (int s = 0; s < r; s++) {
+            fft_cpx sum = t[0];
+            for (int q = 1, e = s; q < r; q++, e = (e + s) % r)
+                sum += fft_mul(t[q], wr[e]);
+            out[k + s * m] = sum;
+        }
+    }
+}
+
+/* Transform of n elements of in (spaced by stride) into contiguous out */
+static inline void fft_rec(const fft_plan_t *p, const fft_cpx *in, size_t stride,
+                           fft_cpx *out, size_t n, const int *f, int sign) {
+    int r = f[0];
+    size_t m = n / r;
+    if (m == 1) {
+        for (int q = 0; q < r; q++) out[q] = in[q * stride];
+    } else {
+        for (int q = 0; q < r; q++)
+            fft_rec(p, in + q * stride, stride * r, out + q * m, m, f + 1, sign);
+    }
+    fft_butterfly(p, out, stride, m, r, sign);
+}
+
+/* out = DFT of in (length p->n); in and out must not overlap */
+static inline void fft_exec(const fft_plan_t *p, const fft_cpx *in, fft_cpx *out, int sign) {
+    if (p->n == 1) { out[0] = in[0]; return; }
+    fft_rec(p, in, 1, out, p->n, p->factors, sign);
+}
+
+static inline size_t fft_good_size(size_t n, size_t mult) {
+    for (size_t m = (n + mult - 1) / mult;; m++) {
+        size_t x = m;
+        while (x % 2 == 0) x /= 2;
+        while (x % 3 == 0) x /= 3;
+        while (x % 5 == 0) x /= 5;
+        while (x % 7 == 0) x /= 7;
+        if (x == 1) return m * mult;
+    }
+}
+
+#endif /* FFT_H */
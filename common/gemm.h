@@ -0,0 +1,166 @@
+/*
+ * gemm.h
+ * Cache-blocked, register-blocked double GEMM for row-major matrices.
+ *
+ *   gemm(m, n, k, A, lda, B, ldb, C, ldc)     C += A * B
+ *
+ * A is m x k, B is k x n, C is m x n. The classic three-level blocking:
+ * a GEMM_KC x GEMM_NC panel of B is packed once per (jc, pc) and stays in
+ * L2/L3, a GEMM_MC x GEMM_KC block of A is packed into GEMM_MR-row slivers
+ * that stay in L1/L2, and a GEMM_MR x GEMM_NR micro-kernel keeps the whole C
+ * tile in vector registers while streaming the two packed slivers. Edges
+ * are zero padded in the packed buffers, so the micro-kernel never branches.
+ *
+ * Vectors are AVX (4 doubles), SSE2 (2) or scalar, as in transpose.h; build
+ * with -O2 -march=native for AVX/FMA. The jr loop over B slivers runs as an
+ * OpenMP parallel for; without -fopenmp the pragmas are ignored.
+ */
+#ifndef GEMM_H
+#define GEMM_H
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#if defined(__AVX__)
+typedef __m256d gemm_vec;
+#define GEMM_W 4
+#define gemm_set1(x) _mm256_set1_pd(x)
+#define gemm_zero() _mm256_setzero_pd()
+#define gemm_load(p) _mm256_loadu_pd(p)
+#define gemm_store(p, v) _mm256_storeu_pd(p, v)
+#define gemm_add(a, b) _mm256_add_pd(a, b)
+#if defined(__FMA__)
+#define gemm_madd(a, b, c) _mm256_fmadd_pd(a, b, c)
+#else
+#define gemm_madd(a, b, c) _mm256_add_pd(_mm256_mul_pd(a, b), c)
+#endif
+#elif defined(__SSE2__)
+typedef __m128d gemm_vec;
+#define GEMM_W 2
+#define gemm_set1(x) _mm_set1_pd(x)
+#define gemm_zero() _mm_setzero_pd()
+#define gemm_load(p) _mm_loadu_pd(p)
+#define gemm_store(p, v) _mm_storeu_pd(p, v)
+#define gemm_add(a, b) _mm_add_pd(a, b)
+#define gemm_madd(a, b, c) _mm_add_pd(_mm_mul_pd(a, b), c)
+#else
+typedef double gemm_vec;
+#define GEMM_W 1
+#define gemm_set1(x) (x)
+#define gemm_zero() 0.0
+#define gemm_load(p) (*(p))
+#define gemm_store(p, v) (*(p) = (v))
+#define gemm_add(a, b) ((a) + (b))
+#define gemm_madd(a, b, c) ((a) * (b) + (c))
+#endif
+
+#define GEMM_MR 4               /* micro-tile rows */
+#define GEMM_NR (2 * GEMM_W)    /* micro-tile cols: two vectors */
+#define GEMM_MC 64              /* A block rows,  MC x KC doubles = 128 KB */
+#define GEMM_KC 256             /* shared dimension per packed panel */
+#define GEMM_NC 2048            /* B panel cols,  KC x NC doubles = 4 MB */
+
+/* Pack A[mc x kc] into MR-row slivers: Ap[s][p][i] = A[s MR + i][p] */
+static inline void gemm_pack_a(size_t mc, size_t kc, const double *A, size_t lda, double *Ap) {
+    for (size_t s = 0; s < mc; s += GEMM_MR) {
+        size_t mr = mc - s < GEMM_MR ? mc - s : GEMM_MR;
+        for (size_t p = 0; p < kc; p++) {
+            for (size_t i = 0; i < mr; i++) Ap[i] = A[(s + i) * lda + p];
+            for (size_t i = mr; i < GEMM_MR; i++) Ap[i] = 0.0;
+            Ap += GEMM_MR;
+        }
+    }
+}
+
+/* Pack B[kc x nc] into NR-col slivers: Bp[s][p][j] = B[p][s NR + j] */
+static inline void gemm_pack_b(size_t kc, size_t nc, const double *B, size_t ldb, double *Bp) {
+    #pragma omp parallel for schedule(static)
+    for (size_t s = 0; s < nc; s += GEMM_NR) {
+        size_t nr = nc - s < GEMM_NR ? nc - s : GEMM_NR;
+        double *dst = Bp + s * kc;
+        for (size_t p = 0; p < kc; p++) {
+            const double *b = B + p * ldb + s;
+            for (size_t j = 0; j < nr; j++) dst[j] = b[j];
+            for (size_t j = nr; j < GEMM_NR; j++) dst[j] = 0.0;
+            dst += GEMM_NR;
+        }
+    }
+}
+
+/* C[mr x nr] += Ap sliver * Bp sliver, both kc long */
+static inline void gemm_micro(size_t kc, const double *Ap, const double *Bp,
+                              double *C, size_t ldc, size_t mr, size_t nr) {
+    gemm_vec c00 = gemm_zero(), c01 = gemm_zero(), c10 = gemm_zero(), c11 = gemm_zero();
+    gemm_vec c20 = gemm_zero(), c21 = gemm_zero(), c30 = gemm_zero(), c31 = gemm_zero();
+    for (size_t p = 0; p < kc; p++) {
+        gemm_vec b0 = gemm_load(Bp), b1 = gemm_load(Bp + GEMM_W), a;
+        a = gemm_set1(Ap[0]); c00 = gemm_madd(a, b0, c00); c01 = gemm_madd(a, b1, c01);
+        a = gemm_set1(Ap[1]); c10 = gemm_madd(a, b0, c10); c11 = gemm_madd(a, b1, c11);
+        a = gemm_set1(Ap[2]); c20 = gemm_madd(a, b0, c20); c21 = gemm_madd(a, b1, c21);
+        a = gemm_set1(Ap[3]); c30 = gemm_madd(a, b0, c30); c31 = gemm_madd(a, b1, c31);
+        Ap += GEMM_MR;
+        Bp += GEMM_NR;
+    }
+    if (mr == GEMM_MR && nr == GEMM_NR) {
+        double *c = C;
+        gemm_store(c, gemm_add(gemm_load(c), c00)); gemm_store(c + GEMM_W, gemm_add(gemm_load(c + GEMM_W), c01));
+        c += ldc;
+        gemm_store(c, gemm_add(gemm_load(c), c10)); gemm_store(c + GEMM_W, gemm_add(gemm_load(c + GEMM_W), c11));
+        c += ldc;
+        gemm_store(c, gemm_add(gemm_load(c), c20)); gemm_store(c + GEMM_W, gemm_add(gemm_load(c + GEMM_W), c21));
+        c += ldc;
+        gemm_store(c, gemm_add(gemm_load(c), c30)); gemm_store(c + GEMM_W, gemm_add(gemm_load(c + GEMM_W), c31));
+        return;
+    }
+    /* edge tile: spill and add the valid part */
+    double t[GEMM_MR * GEMM_NR];
+    gemm_store(t, c00);                   gemm_store(t + GEMM_W, c01);
+    gemm_store(t + GEMM_NR, c10);         gemm_store(t + GEMM_NR + GEMM_W, c11);
+    gemm_store(t + 2 * GEMM_NR, c20);     gemm_store(t + 2 * GEMM_NR + GEMM_W, c21);
+    gemm_store(t + 3 * GEMM_NR, c30);     gemm_store(t + 3 * GEMM_NR + GEMM_W, c31);
+    for (size_t i = 0; i < mr; i++)
+        for (size_t j = 0; j < nr; j++) C[i * ldc + j] += t[i * GEMM_NR + j];
+}
+
+/* C (m x n, ldc) += A (m x k, lda) * B (k x n, ldb) */
+static inline void gemm(size_t m, size_t n, size_t k, const double *A, size_t lda,
+                        const double *B, size_t ldb, double *C, size_t ldc) {
+    if (m == 0 || n == 0 || k == 0) return;
+    size_t ncap = n < GEMM_NC ? n : GEMM_NC, kcap = k < GEMM_KC ? k : GEMM_KC;
+    size_t mcap = m < GEMM_MC ? m : GEMM_MC;
+    size_t bsz = kcap * ((ncap + GEMM_NR - 1) / GEMM_NR * GEMM_NR);
+    size_t asz = kcap * ((mcap + GEMM_MR - 1) / GEMM_MR * GEMM_MR);
+    double *Bp = NULL, *Ap = NULL;
+    if (posix_memalign((void **) &Bp, 64, bsz * sizeof(double)) != 0 ||
+        posix_memalign((void **) &Ap, 64, asz * sizeof(double)) != 0)
+        abort();
+
+    for (size_t jc = 0; jc < n; jc += GEMM_NC) {
+        size_t nc = n - jc < GEMM_NC ? n - jc : GEMM_NC;
+        for (size_t pc = 0; pc < k; pc += GEMM_KC) {
+            size_t kc = k - pc < GEMM_KC ? k - pc : GEMM_KC;
+            gemm_pack_b(kc, nc, B + pc * ldb + jc, ldb, Bp);
+            for (size_t ic = 0; ic < m; ic += GEMM_MC) {
+                size_t mc = m - ic < GEMM_MC ? m - ic : GEMM_MC;
+                gemm_pack_a(mc, kc, A + ic * lda + pc, lda, Ap);
+                #pragma omp parallel for schedule(static)
+                for (size_t jr = 0; jr < nc; jr += GEMM_NR) {
+                    size_t nr = nc - jr < GEMM_NR ? nc - jr : GEMM_NR;
+                    for (size_t ir = 0; ir < mc; ir += GEMM_MR) {
+                        size_t mr = mc - ir < GEMM_MR ? mc - ir : GEMM_MR;
+                        gemm_micro(kc, Ap + ir * kc, Bp + jr * kc,
+                                   C + (ic + ir) * ldc + jc + jr, ldc, mr, nr);
+                    }
+                }
+            }
+        }
+    }
+    free(Ap);
+    free(Bp);
+}
+
+#endif /* GEMM_H */
@@ -0,0 +1,262 @@
+/*
+ * imgio.h
+ * Parallel image I/O with collective MPI-IO.
+ *
+ *   img_probe(comm, path, &info)     read the header on rank 0, share it
+ *   img_read(comm, path, &info, r0, c0, nr, nc, dst, ldd)
+ *   img_write(comm, path, &info, r0, c0, nr, nc, src, lds)
+ *
+ * Every rank passes its own rectangle [r0, r0 + nr) x [c0, c0 + nc) of the
+ * image (nr or nc may be 0). The rectangle becomes an MPI subarray file
+ * view, so each rank touches only its own bytes and the library can merge
+ * the accesses of all ranks (MPI_File_read_at_all / MPI_File_write_at_all).
+ * In memory the pixels are doubles with leading dimension ldd / lds.
+ *
+ * Formats (chosen by file extension, img_format()):
+ *   raw  rows x cols native doubles, no header; the size comes from the caller
+ *   pgm  P5 greyscale, 8-bit or 16-bit big-endian samples; written 8-bit,
+ *        values rounded and clamped to [0, 255]
+ *   pfm  Pf greyscale float32; a negative scale means little-endian. Rows
+ *        are stored bottom to top, so a rectangle is read from the mirrored
+ *        file rows and flipped in memory
+ *
+ * Functions return 0, or -1 on error (message printed on rank 0).
+ */
+#ifndef IMGIO_H
+#define IMGIO_H
+
+#include <mpi.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum { IMG_RAW, IMG_PGM, IMG_PFM } img_format_t;
+
+typedef struct {
+    img_format_t fmt;
+    int rows, cols;
+    int maxval;             /* pgm */
+    int little;             /* pfm: samples are little-endian */
+    MPI_Offset offset;      /* header length in bytes */
+} img_info_t;
+
+static inline img_format_t img_format(const char *path) {
+    const char *dot = strrchr(path, '.');
+    if (dot && (strcmp(dot, ".pgm") == 0 || strcmp(dot, ".PGM") == 0)) return IMG_PGM;
+    if (dot && (strcmp(dot, ".pfm") == 0 || strcmp(dot, ".PFM") == 0)) return IMG_PFM;
+    return IMG_RAW;
+}
+
+static inline int img_host_little(void) {
+    const uint16_t one = 1;
+    return *(const uint8_t *) &one == 1;
+}
+
+static inline size_t img_elem_size(const img_info_t *info) {
+    switch (info->fmt) {
+    case IMG_PGM: return info->maxval < 256 ? 1 : 2;
+    case IMG_PFM: return 4;
+    default:      return 8;
+    }
+}
+
+static inline MPI_Datatype img_elem_type(const img_info_t *info) {
+    switch (info->fmt) {
+    case IMG_PGM: return info->maxval < 256 ? MPI_UNSIGNED_CHAR : MPI_UNSIGNED_SHORT;
+    case IMG_PFM: return MPI_FLOAT;
+    default:      return MPI_DOUBLE;
+    }
+}
+
+/* Next whitespace-separated header token; '#' starts a comment (pgm) */
+static inline int img_token(const char *hdr, int len, int *pos, char *tok, int maxlen) {
+    int p = *pos, n = 0;
+    for (;;) {
+        while (p < len && (hdr[p] == ' ' || hdr[p] == '\t' || hdr[p] == '\n' || hdr[p] == '\r')) p++;
+        if (p < len && hdr[p] == '#') {
+            while (p < len && hdr[p] != '\n') p++;
+            continue;
+        }
+        break;
+    }
+    while (p < len && n < maxlen - 1 && !(hdr[p] == ' ' || hdr[p] == '\t' || hdr[p] == '\n' || hdr[p] == '\r'))
+        tok[n++] = hdr[p++];
+    tok[n] = '\0';
+    *pos = p;
+    return n > 0 && p < len ? 0 : -1;
+}
+
+/*
+ * Fill info for an existing file. For raw files info->rows/cols must be set
+ * by the caller; for pgm/pfm they come from the header. Collective.
+ */
+static inline int img_probe(MPI_Comm comm, const char *path, img_info_t *info) {
+    int rank, ok = 1;
+    MPI_Comm_rank(comm, &rank);
+    info->fmt = img_format(path);
+    info->offset = 0;
+    info->maxval = 255;
+    info->little = img_host_little();
+    if (info->fmt == IMG_RAW) return 0;
+
+    if (rank == 0) {
+        char hdr[512], tok[4][64];
+        int len = 0, pos = 0;
+        FILE *f = fopen(path, "rb");
+        if (f) {
+            len = (int) fread(hdr, 1, sizeof(hdr), f);
+            fclose(f);
+        }
+        for (int k = 0; k < 4 && ok; k++)
+            if (img_token(hdr, len, &pos, tok[k], sizeof(tok[k])) != 0) ok = 0;
+        if (ok) {
+            const char *magic = info->fmt == IMG_PGM ? "P5" : "Pf";
+            info->cols = atoi(tok[1]);
+            info->rows = atoi(tok[2]);
+            if (info->fmt == IMG_PGM) info->maxval = atoi(tok[3]);
+            else info->little = atof(tok[3]) < 0.0;
+            info->offset = pos + 1;     /* exactly one whitespace byte ends the header */
+            ok = strcmp(tok[0], magic) == 0 && info->rows > 0 && info->cols > 0 &&
+                 info->maxval > 0 && info->maxval < 65536;
+        }
+        if (!ok) fprintf(stderr, "%s: not a readable %s file\n", path, info->fmt == IMG_PGM ? "P5 pgm" : "Pf pfm");
+    }
+    MPI_Bcast(&ok, 1, MPI_INT, 0, comm);
+    MPI_Bcast(info, (int) sizeof(*info), MPI_BYTE, 0, comm);
+    return ok ? 0 : -1;
+}
+
+/* File view for [r0, r0 + nr) x [c0, c0 + nc); pfm rows are mirrored */
+static inline void img_set_view(MPI_File fh, const img_info_t *info, int r0, int c0, int nr, int nc) {
+    MPI_Datatype et = img_elem_type(info);
+    if (nr == 0 || nc == 0) {
+        MPI_File_set_view(fh, info->offset, et, et, "native", MPI_INFO_NULL);
+        return;
+    }
+    int fr0 = info->fmt == IMG_PFM ? info->rows - r0 - nr : r0;
+    int sizes[2] = { info->rows, info->cols }, sub[2] = { nr, nc }, start[2] = { fr0, c0 };
+    MPI_Datatype view;
+    MPI_Type_create_subarray(2, sizes, sub, start, MPI_ORDER_C, et, &view);
+    MPI_Type_commit(&view);
+    MPI_File_set_view(fh, info->offset, et, view, "native", MPI_INFO_NULL);
+    MPI_Type_free(&view);
+}
+
+static inline void img_swap(unsigned char *p, size_t n, size_t es) {
+    for (size_t i = 0; i < n; i++, p += es)
+        for (size_t a = 0, b = es - 1; a < b; a++, b--) {
+            unsigned char t = p[a]; p[a] = p[b]; p[b] = t;
+        }
+}
+
+/* File byte order differs from the host's */
+static inline int img_need_swap(const img_info_t *info) {
+    if (info->fmt == IMG_PGM) return info->maxval >= 256 && img_host_little();
+    if (info->fmt == IMG_PFM) return info->little != img_host_little();
+    return 0;
+}
+
+/* Collective read of a rectangle into dst (doubles, leading dimension ldd) */
+static inline int img_read(MPI_Comm comm, const char *path, const img_info_t *info,
+                           int r0, int c0, int nr, int nc, double *dst, size_t ldd) {
+    MPI_File fh;
+    if (MPI_File_open(comm, path, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+        int rank;
+        MPI_Comm_rank(comm, &rank);
+        if (rank == 0) fprintf(stderr, "%s: cannot open for reading\n", path);
+        return -1;
+    }
+    if (nr <= 0 || nc <= 0) nr = nc = 0;
+    size_t es = img_elem_size(info), n = (size_t) nr * nc;
+    unsigned char *tmp = malloc(n ? n * es : 1);
+
+    MPI_Datatype row;
+    MPI_Type_contiguous(nc ? nc : 1, img_elem_type(info), &row);
+    MPI_Type_commit(&row);
+    img_set_view(fh, info, r0, c0, nr, nc);
+    MPI_File_read_at_all(fh, 0, tmp, nr, row, MPI_STATUS_IGNORE);
+    MPI_Type_free(&row);
+    MPI_File_close(&fh);
+
+    if (img_need_swap(info)) img_swap(tmp, n, es);
+    for (int i = 0; i < nr; i++) {
+        int k = info->fmt == IMG_PFM ? nr - 1 - i : i;     /* file order is bottom-up */
+        double *d = dst + (size_t) i * ldd;
+        for (int j = 0; j < nc; j++) {
+            size_t e = (size_t) k * nc + j;
+            switch (info->fmt) {
+            case IMG_PGM: d[j] = es == 1 ? tmp[e] : ((const uint16_t *) tmp)[e]; break;
+            case IMG_PFM: d[j] = ((const float *) tmp)[e]; break;
+            default:      d[j] = ((const double *) tmp)[e]; break;
+            }
+        }
+    }
+    free(tmp);
+    return 0;
+}
+
+/*
+ * Collective write of a rectangle from src (doubles, leading dimension lds).
+ * Creates or truncates the file to the full image size; rank 0 writes the
+ * header. info->fmt, rows and cols must be set (maxval/scale are fixed:
+ * 8-bit pgm, little-endian pfm).
+ */
+static inline int img_write(MPI_Comm comm, const char *path, const img_info_t *in,
+                            int r0, int c0, int nr, int nc, const double *src, size_t lds) {
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    img_info_t info = *in;
+    char hdr[128] = "";
+    if (info.fmt == IMG_PGM) {
+        info.maxval = 255;
+        snprintf(hdr, sizeof(hdr), "P5\n%d %d\n255\n", info.cols, info.rows);
+    } else if (info.fmt == IMG_PFM) {
+        info.little = 1;
+        snprintf(hdr, sizeof(hdr), "Pf\n%d %d\n-1.0\n", info.cols, info.rows);
+    }
+    info.offset = (MPI_Offset) strlen(hdr);
+
+    MPI_File fh;
+    if (MPI_File_open(comm, path, MPI_MODE_WRONLY | MPI_MODE_CREATE, MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+        if (rank == 0) fprintf(stderr, "%s: cannot open for writing\n", path);
+        return -1;
+    }
+    size_t es = img_elem_size(&info);
+    MPI_File_set_size(fh, info.offset + (MPI_Offset) info.rows * info.cols * (MPI_Offset) es);
+    if (rank == 0 && info.offset > 0)
+        MPI_File_write_at(fh, 0, hdr, (int) info.offset, MPI_CHAR, MPI_STATUS_IGNORE);
+
+    if (nr <= 0 || nc <= 0) nr = nc = 0;
+    size_t n = (size_t) nr * nc;
+    unsigned char *tmp = malloc(n ? n * es : 1);
+    for (int i = 0; i < nr; i++) {
+        int k = info.fmt == IMG_PFM ? nr - 1 - i : i;
+        const double *s = src + (size_t) i * lds;
+        for (int j = 0; j < nc; j++) {
+            size_t e = (size_t) k * nc + j;
+            switch (info.fmt) {
+            case IMG_PGM: {
+                double v = s[j] < 0.0 ? 0.0 : s[j] > 255.0 ? 255.0 : s[j];
+                tmp[e] = (unsigned char) (v + 0.5);
+                break;
+            }
+            case IMG_PFM: ((float *) tmp)[e] = (float) s[j]; break;
+            default:      ((double *) tmp)[e] = s[j]; break;
+            }
+        }
+    }
+    if (img_need_swap(&info)) img_swap(tmp, n, es);
+
+    MPI_Datatype row;
+    MPI_Type_contiguous(nc ? nc : 1, img_elem_type(&info), &row);
+    MPI_Type_commit(&row);
+    img_set_view(fh, &info, r0, c0, nr, nc);
+    MPI_File_write_at_all(fh, 0, tmp, nr, row, MPI_STATUS_IGNORE);
+    MPI_Type_free(&row);
+    MPI_File_close(&fh);
+    free(tmp);
+    return 0;
+}
+
+#endif /* IMGIO_H */
@@ -0,0 +1,143 @@
+/*
+ * matlayout.h
+ * Tiled and Z-order (Morton) storage for square double matrices.
+ *
+ * Row-major (i*N + j) makes every recursive submatrix a strided view.
+ * The two layouts here store the matrix as T x T tiles, each tile
+ * contiguous and row-major inside:
+ *
+ *   MAT_TILED   tiles in row-major tile order
+ *   MAT_MORTON  tiles in Z-order (bit-interleaved tile row/col), so every
+ *               quadrant at every recursion level is one contiguous block:
+ *               for an n x n Morton block with q = (n/2)^2,
+ *                 X11 = X, X12 = X + q, X21 = X + 2q, X22 = X + 3q
+ *
+ * The logical size n is padded with zeros to np (a multiple of T, and
+ * T * 2^k for Morton). Use mat_index() for element access and mat_tile()
+ * for a pointer to a whole tile; mat_pack()/mat_unpack() convert from/to a
+ * plain row-major array.
+ */
+#ifndef MATLAYOUT_H
+#define MATLAYOUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef enum { MAT_ROWMAJOR = 0, MAT_TILED = 1, MAT_MORTON = 2 } mat_layout_t;
+
+typedef struct {
+    mat_layout_t layout;
+    size_t n;       /* logical dimension */
+    size_t np;      /* padded dimension; storage is np * np doubles */
+    size_t T;       /* tile edge (1 for row-major) */
+    size_t nt;      /* tiles per row, np / T */
+} mat_desc_t;
+
+/* Spread the low 32 bits of x to the even bit positions */
+static inline uint64_t mat_part1by1(uint64_t x) {
+    x &= 0xffffffffull;
+    x = (x | (x << 16)) & 0x0000ffff0000ffffull;
+    x = (x | (x << 8))  & 0x00ff00ff00ff00ffull;
+    x = (x | (x << 4))  & 0x0f0f0f0f0f0f0f0full;
+    x = (x | (x << 2))  & 0x3333333333333333ull;
+    x = (x | (x << 1))  & 0x5555555555555555ull;
+    return x;
+}
+
+/* Z-order index of tile (ti, tj); the row bit is the more significant one */
+static inline uint64_t mat_morton(uint64_t ti, uint64_t tj) {
+    return (mat_part1by1(ti) << 1) | mat_part1by1(tj);
+}
+
+/*
+ * Describe an n x n matrix in `layout` with tile edge T (T = 0 is taken as
+ * 1). Morton rounds the tile count up to a power of two so the quadrant
+ * recursion is exact.
+ */
+static inline mat_desc_t mat_desc(mat_layout_t layout, size_t n, size_t T) {
+    mat_desc_t d;
+    d.layout = layout;
+    d.n = n;
+    if (layout == MAT_ROWMAJOR) {
+        d.T = 1; d.nt = n; d.np = n;
+        return d;
+    }
+    if (T == 0) T = 1;
+    d.T = T;
+    d.nt = (n + T - 1) / T;
+    if (layout == MAT_MORTON) {
+        size_t p = 1;
+        while (p < d.nt) p <<= 1;
+        d.nt = p;
+    }
+    d.np = d.nt * T;
+    return d;
+}
+
+static inline size_t mat_elems(const mat_desc_t *d) { return d->np * d->np; }
+
+/* Offset of tile (ti, tj) in the storage */
+static inline size_t mat_tile_offset(const mat_desc_t *d, size_t ti, size_t tj) {
+    size_t tt = d->T * d->T;
+    switch (d->layout) {
+    case MAT_TILED:  return (ti * d->nt + tj) * tt;
+    case MAT_MORTON: return (size_t) mat_morton(ti, tj) * tt;
+    default:         return ti * d->np + tj;   /* T == 1 */
+    }
+}
+
+/* Pointer to tile (ti, tj): T x T doubles, row-major, leading dimension T */
+static inline double *mat_tile(const mat_desc_t *d, double *M, size_t ti, size_t tj) {
+    return M + mat_tile_offset(d, ti, tj);
+}
+
+/* Offset of logical element (i, j) */
+static inline size_t mat_index(const mat_desc_t *d, size_t i, size_t j) {
+    if (d->layout == MAT_ROWMAJOR) return i * d->np + j;
+    return mat_tile_offset(d, i / d->T, j / d->T) + (i % d->T) * d->T + (j % d->T);
+}
+
+/* Row-major src (n x n, leading dim ld) -> layout storage dst, zero padded */
+static inline void mat_pack(const mat_desc_t *d, const double *src, size_t ld, double *dst) {
+    size_t T = d->T;
+    if (d->layout == MAT_ROWMAJOR) {
+        for (size_t i = 0; i < d->n; i++)
+            memcpy(dst + i * d->np, src + i * ld, d->n * sizeof(double));
+        return;
+    }
+    #pragma omp parallel for collapse(2) schedule(static)
+    for (size_t ti = 0; ti < d->nt; ti++)
+        for (size_t tj = 0; tj < d->nt; tj++) {
+            double *t = mat_tile(d, dst, ti, tj);
+            for (size_t u = 0; u < T; u++) {
+                size_t i = ti * T + u, j0 = tj * T;
+                size_t w = (i < d->n && j0 < d->n) ? ((d->n - j0 < T) ? d->n - j0 : T) : 0;
+                if (w) memcpy(t + u * T, src + i * ld + j0, w * sizeof(double));
+                memset(t + u * T + w, 0, (T - w) * sizeof(double));
+            }
+        }
+}
+
+/* Layout storage src -> row-major dst (n x n, leading dim ld); padding dropped */
+static inline void mat_unpack(const mat_desc_t *d, const double *src, double *dst, size_t ld) {
+    size_t T = d->T;
+    if (d->layout == MAT_ROWMAJOR) {
+        for (size_t i = 0; i < d->n; i++)
+            memcpy(dst + i * ld, src + i * d->np, d->n * sizeof(double));
+        return;
+    }
+    #pragma omp parallel for collapse(2) schedule(static)
+    for (size_t ti = 0; ti < d->nt; ti++)
+        for (size_t tj = 0; tj < d->nt; tj++) {
+            const double *t = src + mat_tile_offset(d, ti, tj);
+            for (size_t u = 0; u < T; u++) {
+                size_t i = ti * T + u, j0 = tj * T;
+                if (i >= d->n || j0 >= d->n) continue;
+                size_t w = (d->n - j0 < T) ? d->n - j0 : T;
+                memcpy(dst + i * ld + j0, t + u * T, w * sizeof(double));
+            }
+        }
+}
+
+#endif /* MATLAYOUT_H */
@@ -0,0 +1,77 @@
+/*
+ * node_shared.h
+ * Node-level shared-memory windows for data that every rank needs a full
+ * copy of (a broadcast matrix, vector or kernel).
+ *
+ * Ranks are grouped with MPI_Comm_split_type(MPI_COMM_TYPE_SHARED). Each
+ * node keeps ONE copy of the replicated buffer in an MPI_Win_allocate_shared
+ * window owned by the node leader (node rank 0); all ranks on the node read
+ * it through plain loads. Broadcasts then go only between node leaders.
+ *
+ * Header-only; include from any MPI program:
+ *   #include "../../common/node_shared.h"
+ */
+#ifndef NODE_SHARED_H
+#define NODE_SHARED_H
+
+#include <mpi.h>
+#include <stddef.h>
+
+typedef struct {
+    MPI_Comm node;      /* ranks that share memory with this one */
+    MPI_Comm leaders;   /* node rank 0 of every node, MPI_COMM_NULL elsewhere */
+    int node_rank, node_size;
+    int num_nodes;      /* valid on every rank */
+} node_comms_t;
+
+/*
+ * Build node and leader communicators. Keys keep the parent ordering, so
+ * rank 0 of comm is node rank 0 on its node and rank 0 of the leaders comm.
+ */
+static inline void node_comms_init(node_comms_t *nc, MPI_Comm comm) {
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &nc->node);
+    MPI_Comm_rank(nc->node, &nc->node_rank);
+    MPI_Comm_size(nc->node, &nc->node_size);
+    MPI_Comm_split(comm, nc->node_rank == 0 ? 0 : MPI_UNDEFINED, rank, &nc->leaders);
+
+    nc->num_nodes = 0;
+    if (nc->leaders != MPI_COMM_NULL) MPI_Comm_size(nc->leaders, &nc->num_nodes);
+    MPI_Bcast(&nc->num_nodes, 1, MPI_INT, 0, nc->node);
+}
+
+static inline void node_comms_free(node_comms_t *nc) {
+    if (nc->leaders != MPI_COMM_NULL) MPI_Comm_free(&nc->leaders);
+    MPI_Comm_free(&nc->node);
+}
+
+/*
+ * Allocate `bytes` once per node. Every rank of the node gets a pointer to
+ * the same memory; the window must be released with MPI_Win_free.
+ */
+static inline void *node_shared_alloc(const node_comms_t *nc, size_t bytes, MPI_Win *win) {
+    void *base = NULL;
+    MPI_Aint sz = (nc->node_rank == 0) ? (MPI_Aint) bytes : 0;
+    MPI_Aint qsize;
+    int disp_unit;
+
+    MPI_Win_allocate_shared(sz, 1, MPI_INFO_NULL, nc->node, &base, win);
+    MPI_Win_shared_query(*win, 0, &qsize, &disp_unit, &base);
+    return base;
+}
+
+/*
+ * Broadcast a node-shared buffer from the rank-0 leader to every node.
+ * Only leaders move data; the fences order the leader's stores before any
+ * rank on the node reads the buffer. Collective over all ranks.
+ */
+static inline void node_shared_bcast(const node_comms_t *nc, void *buf, int count,
+                                     MPI_Datatype type, MPI_Win win) {
+    MPI_Win_fence(0, win);
+    if (nc->leaders != MPI_COMM_NULL)
+        MPI_Bcast(buf, count, type, 0, nc->leaders);
+    MPI_Win_fence(0, win);
+}
+
+#endif /* NODE_SHARED_H */
@@ -0,0 +1,110 @@
+/*
+ * phase_timer.h
+ * Per-phase wall-clock timing of an MPI program, summarized across ranks.
+ *
+ *   ptimer_init(&pt, comm)          barrier, then start the init phase
+ *   ptimer_phase(&pt, PT_COMPUTE)   close the running phase, start another
+ *   ptimer_stop(&pt)                close the running phase
+ *   ptimer_stats(&pt, st)           min / avg / max over ranks per phase
+ *   ptimer_report(&pt, label)       print the table on rank 0
+ *
+ * Phases follow the usual shape of the assignment programs:
+ *   init        allocation and generating (or reading) the input on the root
+ *   distribute  scatter / broadcast of the input
+ *   compute     the local kernel, including communication it overlaps with
+ *   collect     gather of the result
+ * Time outside any phase (reference measurements, validation, printing) is
+ * not counted. The sum of the four phases is reported as "total"; its
+ * maximum over ranks is the end-to-end time to use for speedups, since it
+ * includes the data movement a compute-only timer hides.
+ *
+ * Imbalance is max / avg over ranks (1.00 = balanced). In collective phases
+ * it mostly measures waiting: a rank that arrives early at a scatter is
+ * charged until the data reaches it.
+ *
+ * Collective over comm: ptimer_init, ptimer_stats and ptimer_report.
+ * mpi/bench/scaling.sh reads the "total" line of the report.
+ */
+#ifndef PHASE_TIMER_H
+#define PHASE_TIMER_H
+
+#include <mpi.h>
+#include <stdio.h>
+
+enum { PT_INIT, PT_DISTRIBUTE, PT_COMPUTE, PT_COLLECT, PT_NPHASES };
+
+static const char *const ptimer_names[PT_NPHASES] = { "init", "distribute", "compute", "collect" };
+
+typedef struct {
+    MPI_Comm comm;
+    double t[PT_NPHASES];   /* seconds accumulated per phase on this rank */
+    int cur;                /* running phase, -1 if none */
+    double since;           /* MPI_Wtime when cur started */
+} ptimer_t;
+
+typedef struct {
+    double min, avg, max;
+} ptimer_stat_t;
+
+static inline void ptimer_stop(ptimer_t *pt) {
+    if (pt->cur >= 0) pt->t[pt->cur] += MPI_Wtime() - pt->since;
+    pt->cur = -1;
+}
+
+static inline void ptimer_phase(ptimer_t *pt, int phase) {
+    ptimer_stop(pt);
+    pt->cur = phase;
+    pt->since = MPI_Wtime();
+}
+
+static inline void ptimer_init(ptimer_t *pt, MPI_Comm comm) {
+    pt->comm = comm;
+    for (int i = 0; i < PT_NPHASES; i++) pt->t[i] = 0.0;
+    pt->cur = -1;
+    MPI_Barrier(comm);
+    ptimer_phase(pt, PT_INIT);
+}
+
+/* st[PT_NPHASES] is the total (per-rank sum of the phases); valid on every rank */
+static inline void ptimer_stats(ptimer_t *pt, ptimer_stat_t st[PT_NPHASES + 1]) {
+    int P;
+    double v[PT_NPHASES + 1], lo[PT_NPHASES + 1], hi[PT_NPHASES + 1], sum[PT_NPHASES + 1];
+    if (pt->cur >= 0) {     /* include the running phase without closing it */
+        int cur = pt->cur;
+        ptimer_stop(pt);
+        ptimer_phase(pt, cur);
+    }
+    MPI_Comm_size(pt->comm, &P);
+    v[PT_NPHASES] = 0.0;
+    for (int i = 0; i < PT_NPHASES; i++) {
+        v[i] = pt->t[i];
+        v[PT_NPHASES] += pt->t[i];
+    }
+    MPI_Allreduce(v, lo, PT_NPHASES + 1, MPI_DOUBLE, MPI_MIN, pt->comm);
+    MPI_Allreduce(v, hi, PT_NPHASES + 1, MPI_DOUBLE, MPI_MAX, pt->comm);
+    MPI_Allreduce(v, sum, PT_NPHASES + 1, MPI_DOUBLE, MPI_SUM, pt->comm);
+    for (int i = 0; i <= PT_NPHASES; i++) {
+        st[i].min = lo[i];
+        st[i].avg = sum[i] / P;
+        st[i].max = hi[i];
+    }
+}
+
+static inline void ptimer_report(ptimer_t *pt, const char *label) {
+    ptimer_stat_t st[PT_NPHASES + 1];
+    int rank, P;
+    ptimer_stats(pt, st);
+    MPI_Comm_rank(pt->comm, &rank);
+    MPI_Comm_size(pt->comm, &P);
+    if (rank != 0) return;
+    printf("Phase times%s%s over %d ranks (s):\n", label ? " of " : "", label ? label : "", P);
+    printf("  %-12s %11s %11s %11s %8s %7s\n", "phase", "min", "avg", "max", "max/avg", "%max");
+    for (int i = 0; i <= PT_NPHASES; i++) {
+        double imb = st[i].avg > 0.0 ? st[i].max / st[i].avg : 1.0;
+        double pct = st[PT_NPHASES].max > 0.0 ? 100.0 * st[i].max / st[PT_NPHASES].max : 0.0;
+        printf("  %-12s %11.6f %11.6f %11.6f %8.2f %6.1f%%\n", i < PT_NPHASES ? ptimer_names[i] : "total",
+               st[i].min, st[i].avg, st[i].max, imb, pct);
+    }
+}
+
+#endif /* PHASE_TIMER_H */
@@ -0,0 +1,166 @@
+/*
+ * repro_sum.h
+ * Reproducible floating-point summation: the result is bitwise identical
+ * for any order of additions, i.e. any thread count, schedule, rank count
+ * or reduction tree.
+ *
+ *   rsum_t acc; rsum_init(&acc);
+ *   rsum_add(&acc, x)                add one double
+ *   rsum_merge(&acc, &other)         acc += other
+ *   rsum_value(&acc)                 the sum, rounded once to nearest
+ *
+ * Method (a binned "superaccumulator", like the exact accumulators behind
+ * ReproBLAS): every finite double is an integer multiple of 2^-1074, so the
+ * sum is kept exactly as a fixed-point integer in RSUM_BINS signed 64-bit
+ * bins of 32 bits each; bin b holds the digit of weight 2^(32 b - 1074).
+ * An addend's 53-bit mantissa, shifted to its exponent, touches at most
+ * three bins. Each bin has 31 bits of headroom for carries, which are
+ * propagated every RSUM_FLUSH additions and before rounding. After carry
+ * propagation every bin but the top one lies in [0, 2^32), a canonical
+ * form, so equal sums give equal bins and round to the same double.
+ * Inf and NaN addends are summed separately (+inf + -inf gives NaN).
+ *
+ * Reductions:
+ *   #pragma omp parallel for reduction(rsum : acc)    (declared below)
+ *   double s = rsum_allreduce(&acc, comm)              MPI, all ranks
+ * or rsum_mpi_create(&type, &op) for use with MPI_Reduce etc. The MPI parts
+ * are compiled only when mpi.h was included before this header.
+ *
+ * Cost: an addition is a few integer operations instead of one add; the
+ * programs that use it print the overhead against the plain reduction.
+ */
+#ifndef REPRO_SUM_H
+#define REPRO_SUM_H
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#define RSUM_BINS 70            /* 2098 bits of range + carry-out headroom */
+#define RSUM_FLUSH (1 << 30)    /* additions between carry propagations */
+
+typedef struct {
+    int64_t bin[RSUM_BINS];
+    double special;     /* sum of the inf/nan addends, 0 if none */
+    int64_t pending;    /* additions since the last carry propagation */
+} rsum_t;
+
+static inline void rsum_init(rsum_t *a) {
+    memset(a, 0, sizeof(*a));
+}
+
+/* Carry propagation into the canonical form */
+static inline void rsum_normalize(rsum_t *a) {
+    for (int b = 0; b < RSUM_BINS - 1; b++) {
+        int64_t lo = a->bin[b] & 0xffffffff;
+        int64_t carry = (a->bin[b] - lo) / 4294967296LL;   /* floor division */
+        a->bin[b] = lo;
+        a->bin[b + 1] += carry;
+    }
+    a->pending = 0;
+}
+
+static inline void rsum_add(rsum_t *a, double x) {
+    uint64_t u;
+    memcpy(&u, &x, sizeof(u));
+    int e = (int) (u >> 52) & 0x7ff;
+    uint64_t m = u & ((1ULL << 52) - 1);
+    if (e == 0x7ff) { a->special += x; return; }
+    if (e == 0) {
+        if (m == 0) return;
+    } else {
+        m |= 1ULL << 52;
+        e -= 1;         /* x = m 2^(e - 1074) with e the position of the lsb */
+    }
+    unsigned __int128 v = (unsigned __int128) m << (e & 31);
+    int64_t *p = a->bin + (e >> 5);
+    int64_t d0 = (int64_t) (uint32_t) v, d1 = (int64_t) (uint32_t) (v >> 32), d2 = (int64_t) (v >> 64);
+    if (u >> 63) {
+        p[0] -= d0; p[1] -= d1; p[2] -= d2;
+    } else {
+        p[0] += d0; p[1] += d1; p[2] += d2;
+    }
+    if (++a->pending == RSUM_FLUSH) rsum_normalize(a);
+}
+
+static inline void rsum_add_array(rsum_t *a, const double *x, size_t n) {
+    for (size_t i = 0; i < n; i++) rsum_add(a, x[i]);
+}
+
+/* a += b; b is left normalized */
+static inline void rsum_merge(rsum_t *a, rsum_t *b) {
+    rsum_normalize(a);
+    rsum_normalize(b);
+    for (int k = 0; k < RSUM_BINS; k++) a->bin[k] += b->bin[k];
+    a->special += b->special;
+    a->pending = 1;
+}
+
+/* The exact sum rounded to the nearest double (ties to even) */
+static inline double rsum_value(const rsum_t *acc) {
+    if (acc->special != 0.0) return acc->special;
+    rsum_t a = *acc;
+    rsum_normalize(&a);
+    int h = RSUM_BINS - 1;
+    while (h >= 0 && a.bin[h] == 0) h--;
+    if (h < 0) return 0.0;
+    int neg = a.bin[h] < 0;
+    if (neg) {
+        for (int k = 0; k < RSUM_BINS; k++) a.bin[k] = -a.bin[k];
+        rsum_normalize(&a);
+        while (a.bin[h] == 0) h--;
+    }
+    /* top three digits, the rest only as a sticky bit */
+    unsigned __int128 v = 0;
+    for (int k = h; k > h - 3; k--)
+        v = (v << 32) | (k >= 0 ? (uint64_t) a.bin[k] : 0);
+    int sticky = 0;
+    for (int k = h - 3; k >= 0 && !sticky; k--) sticky = a.bin[k] != 0;
+
+    int nb = 0;
+    for (unsigned __int128 t = v; t; t >>= 1) nb++;
+    int shift = nb - 53;    /* >= 12: the top digit is nonzero */
+    uint64_t mant = (uint64_t) (v >> shift);
+    unsigned __int128 rem = v & (((unsigned __int128) 1 << shift) - 1);
+    unsigned __int128 half = (unsigned __int128) 1 << (shift - 1);
+    if (rem > half || (rem == half && (sticky || (mant & 1)))) mant++;
+    /* results below 2^-1022 come from h <= 1 and only drop zero padding
+     * bits, so ldexp is exact there and no second rounding happens */
+    double r = ldexp((double) mant, shift + 32 * (h - 2) - 1074);
+    return neg ? -r : r;
+}
+
+#pragma omp declare reduction(rsum : rsum_t : rsum_merge(&omp_out, &omp_in)) initializer(rsum_init(&omp_priv))
+
+#ifdef MPI_VERSION
+static inline void rsum_mpi_fn(void *in, void *inout, int *len, MPI_Datatype *type) {
+    (void) type;
+    rsum_t *a = (rsum_t *) in, *b = (rsum_t *) inout;
+    for (int i = 0; i < *len; i++) {
+        rsum_t t = a[i];
+        rsum_merge(&b[i], &t);
+    }
+}
+
+/* Datatype and commutative op for reducing rsum_t values; free both after use */
+static inline void rsum_mpi_create(MPI_Datatype *type, MPI_Op *op) {
+    MPI_Type_contiguous((int) sizeof(rsum_t), MPI_BYTE, type);
+    MPI_Type_commit(type);
+    MPI_Op_create(rsum_mpi_fn, 1, op);
+}
+
+/* Combine the accumulators of all ranks; every rank gets the rounded sum */
+static inline double rsum_allreduce(const rsum_t *acc, MPI_Comm comm) {
+    MPI_Datatype type;
+    MPI_Op op;
+    rsum_t t = *acc;
+    rsum_normalize(&t);
+    rsum_mpi_create(&type, &op);
+    MPI_Allreduce(MPI_IN_PLACE, &t, 1, type, op, comm);
+    MPI_Op_free(&op);
+    MPI_Type_free(&type);
+    return rsum_value(&t);
+}
+#endif
+
+#endif /* REPRO_SUM_H */
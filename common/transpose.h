@@ -0,0 +1,186 @@
+/*
+ * transpose.h
+ * Cache-oblivious parallel matrix transpose for row-major double matrices.
+ *
+ *   transpose_oop(A, lda, B, ldb, rows, cols)   B = A^T   (A is rows x cols)
+ *   transpose_inplace(A, lda, n)                A = A^T   (A is n x n)
+ *
+ * Both recurse by halving the larger dimension until a block fits in L1
+ * (TR_BLOCK x TR_BLOCK), so every cache level is used without tuning.
+ * Leaf blocks are moved in 4x4 tiles transposed in registers (AVX), or 2x2
+ * (SSE2) when AVX is not enabled. The top levels of the recursion run as
+ * OpenMP tasks; without -fopenmp the pragmas are ignored and it runs serially.
+ *
+ * Compile with -O2 -mavx2 (or -march=native) to get the AVX path.
+ */
+#ifndef TRANSPOSE_H
+#define TRANSPOSE_H
+
+#include <stddef.h>
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#define TR_BLOCK 32             /* leaf block edge, 32x32 doubles = 8 KB */
+#define TR_TASK_MIN (256 * 256) /* do not spawn tasks below this many elements */
+
+/* ---- register tiles ---- */
+
+#if defined(__AVX__)
+/* 4x4 tile: load 4 rows of A, transpose in registers, store 4 rows of B */
+static inline void tr_tile4(const double *A, size_t lda, double *B, size_t ldb) {
+    __m256d r0 = _mm256_loadu_pd(A);
+    __m256d r1 = _mm256_loadu_pd(A + lda);
+    __m256d r2 = _mm256_loadu_pd(A + 2 * lda);
+    __m256d r3 = _mm256_loadu_pd(A + 3 * lda);
+    __m256d t0 = _mm256_unpacklo_pd(r0, r1);   /* a00 a10 a02 a12 */
+    __m256d t1 = _mm256_unpackhi_pd(r0, r1);   /* a01 a11 a03 a13 */
+    __m256d t2 = _mm256_unpacklo_pd(r2, r3);   /* a20 a30 a22 a32 */
+    __m256d t3 = _mm256_unpackhi_pd(r2, r3);   /* a21 a31 a23 a33 */
+    _mm256_storeu_pd(B,           _mm256_permute2f128_pd(t0, t2, 0x20));
+    _mm256_storeu_pd(B + ldb,     _mm256_permute2f128_pd(t1, t3, 0x20));
+    _mm256_storeu_pd(B + 2 * ldb, _mm256_permute2f128_pd(t0, t2, 0x31));
+    _mm256_storeu_pd(B + 3 * ldb, _mm256_permute2f128_pd(t1, t3, 0x31));
+}
+#define TR_TILE 4
+#elif defined(__SSE2__)
+static inline void tr_tile4(const double *A, size_t lda, double *B, size_t ldb) {
+    for (int bi = 0; bi < 4; bi += 2)
+        for (int bj = 0; bj < 4; bj += 2) {
+            const double *a = A + bi * lda + bj;
+            double *b = B + bj * ldb + bi;
+            __m128d r0 = _mm_loadu_pd(a);
+            __m128d r1 = _mm_loadu_pd(a + lda);
+            _mm_storeu_pd(b,       _mm_unpacklo_pd(r0, r1));
+            _mm_storeu_pd(b + ldb, _mm_unpackhi_pd(r0, r1));
+        }
+}
+#define TR_TILE 4
+#else
+static inline void tr_tile4(const double *A, size_t lda, double *B, size_t ldb) {
+    for (int i = 0; i < 4; i++)
+        for (int j = 0; j < 4; j++)
+            B[j * ldb + i] = A[i * lda + j];
+}
+#define TR_TILE 4
+#endif
+
+/* ---- out-of-place ---- */
+
+static inline void tr_leaf(const double *A, size_t lda, double *B, size_t ldb,
+                           size_t rows, size_t cols) {
+    size_t r4 = rows - rows % TR_TILE, c4 = cols - cols % TR_TILE;
+    for (size_t i = 0; i < r4; i += TR_TILE)
+        for (size_t j = 0; j < c4; j += TR_TILE)
+            tr_tile4(A + i * lda + j, lda, B + j * ldb + i, ldb);
+    /* ragged edges */
+    for (size_t i = 0; i < rows; i++)
+        for (size_t j = (i < r4 ? c4 : 0); j < cols; j++)
+            B[j * ldb + i] = A[i * lda + j];
+}
+
+static inline void tr_rec(const double *A, size_t lda, double *B, size_t ldb,
+                          size_t rows, size_t cols) {
+    if (rows <= TR_BLOCK && cols <= TR_BLOCK) {
+        tr_leaf(A, lda, B, ldb, rows, cols);
+        return;
+    }
+    if (rows >= cols) {
+        size_t h = rows / 2;
+        h -= h % TR_TILE;
+        #pragma omp task if(rows * cols >= TR_TASK_MIN)
+        tr_rec(A, lda, B, ldb, h, cols);
+        tr_rec(A + h * lda, lda, B + h, ldb, rows - h, cols);
+    } else {
+        size_t h = cols / 2;
+        h -= h % TR_TILE;
+        #pragma omp task if(rows * cols >= TR_TASK_MIN)
+        tr_rec(A, lda, B, ldb, rows, h);
+        tr_rec(A + h, lda, B + h * ldb, ldb, rows, cols - h);
+    }
+    #pragma omp taskwait
+}
+
+/* B (cols x rows, leading dim ldb) = transpose of A (rows x cols, leading dim lda) */
+static inline void transpose_oop(const double *A, size_t lda, double *B, size_t ldb,
+                                 size_t rows, size_t cols) {
+    #pragma omp parallel
+    #pragma omp single nowait
+    tr_rec(A, lda, B, ldb, rows, cols);
+}
+
+/* ---- in-place, square ---- */
+
+/* Swap-transpose two disjoint blocks: X <- Y^T and Y <- X^T (X is rows x cols) */
+static inline void tr_swap_leaf(double *X, double *Y, size_t ld, size_t rows, size_t cols) {
+    double tx[TR_TILE * TR_TILE], ty[TR_TILE * TR_TILE];
+    size_t r4 = rows - rows % TR_TILE, c4 = cols - cols % TR_TILE;
+    for (size_t i = 0; i < r4; i += TR_TILE)
+        for (size_t j = 0; j < c4; j += TR_TILE) {
+            double *x = X + i * ld + j, *y = Y + j * ld + i;
+            tr_tile4(x, ld, tx, TR_TILE);
+            tr_tile4(y, ld, ty, TR_TILE);
+            for (int u = 0; u < TR_TILE; u++)
+                for (int v = 0; v < TR_TILE; v++) {
+                    x[u * ld + v] = ty[u * TR_TILE + v];
+                    y[u * ld + v] = tx[u * TR_TILE + v];
+                }
+        }
+    for (size_t i = 0; i < rows; i++)
+        for (size_t j = (i < r4 ? c4 : 0); j < cols; j++) {
+            double t = X[i * ld + j];
+            X[i * ld + j] = Y[j * ld + i];
+            Y[j * ld + i] = t;
+        }
+}
+
+static inline void tr_swap_rec(double *X, double *Y, size_t ld, size_t rows, size_t cols) {
+    if (rows <= TR_BLOCK && cols <= TR_BLOCK) {
+        tr_swap_leaf(X, Y, ld, rows, cols);
+        return;
+    }
+    if (rows >= cols) {
+        size_t h = rows / 2;
+        h -= h % TR_TILE;
+        #pragma omp task if(rows * cols >= TR_TASK_MIN)
+        tr_swap_rec(X, Y, ld, h, cols);
+        tr_swap_rec(X + h * ld, Y + h, ld, rows - h, cols);
+    } else {
+        size_t h = cols / 2;
+        h -= h % TR_TILE;
+        #pragma omp task if(rows * cols >= TR_TASK_MIN)
+        tr_swap_rec(X, Y, ld, rows, h);
+        tr_swap_rec(X + h, Y + h * ld, ld, rows, cols - h);
+    }
+    #pragma omp taskwait
+}
+
+/* Diagonal block: transpose the two diagonal quadrants, swap the off-diagonal ones */
+static inline void tr_inplace_rec(double *A, size_t ld, size_t n) {
+    if (n <= TR_BLOCK) {
+        for (size_t i = 0; i < n; i++)
+            for (size_t j = i + 1; j < n; j++) {
+                double t = A[i * ld + j];
+                A[i * ld + j] = A[j * ld + i];
+                A[j * ld + i] = t;
+            }
+        return;
+    }
+    size_t h = n / 2;
+    h -= h % TR_TILE;
+    #pragma omp task if(n * n >= TR_TASK_MIN)
+    tr_inplace_rec(A, ld, h);
+    #pragma omp task if(n * n >= TR_TASK_MIN)
+    tr_inplace_rec(A + h * ld + h, ld, n - h);
+    tr_swap_rec(A + h, A + h * ld, ld, h, n - h);
+    #pragma omp taskwait
+}
+
+/* A (n x n, leading dim lda) = A^T */
+static inline void transpose_inplace(double *A, size_t lda, size_t n) {
+    #pragma omp parallel
+    #pragma omp single nowait
+    tr_inplace_rec(A, lda, n);
+}
+
+#endif /* TRANSPOSE_H */
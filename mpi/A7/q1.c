@@ -8,25 +8,45 @@
  * Build: mpicc -O2 -o matvec_mpi matvec_mpi.c
  * Run example: mpirun -np 4 ./matvec_mpi 4096
  *
- * Arguments: ./matvec_mpi N [validate]
+ * Arguments: ./matvec_mpi N [validate] [shared]
  *   N = matrix dimension (N x N)
  *   validate = optional 1 to run a sequential check (default 0)
+ *   shared = optional 1 to keep one copy of x per node in an MPI-3 shared
+ *            window, broadcast only between node leaders (default 0)
+ *
+ * Besides the compute time, the phase table (common/phase_timer.h) gives
+ * init / distribute / compute / collect times with their spread over ranks;
+ * use its max total, not the compute time, for end-to-end speedups.
  *
  * Uses MPI_Scatterv / MPI_Gatherv so that N doesn't have to be divisible by P.
+ * A is scattered in units of one row (a contiguous datatype of N doubles),
+ * so counts stay within int even when N*N > 2^31.
  */
 
 #include <mpi.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
+
+#include "../../common/node_shared.h"
+#include "../../common/phase_timer.h"
 
 /* Simple random init (deterministic) */
-static double drand(int seed) {
+static double drand(size_t seed) {
     unsigned int x = (unsigned int) seed;
     x = (1103515245u * x + 12345u) & 0x7fffffff;
     return (double)(x % 1000) / 1000.0;
 }
 
+/* 64-byte aligned allocation of n doubles (cache line / AVX-512 aligned) */
+static double *alloc_doubles(size_t n) {
+    void *p = NULL;
+    if (n == 0) n = 1;
+    if (posix_memalign(&p, 64, n * sizeof(double)) != 0) return NULL;
+    return (double *) p;
+}
+
 int main(int argc, char **argv) {
     int rank, size;
     MPI_Init(&argc, &argv);
@@ -34,35 +54,40 @@ int main(int argc, char **argv) {
     MPI_Comm_size(MPI_COMM_WORLD, &size);
 
     if (argc < 2) {
-        if (rank == 0) fprintf(stderr, "Usage: %s N [validate]\n", argv[0]);
+        if (rank == 0) fprintf(stderr, "Usage: %s N [validate] [shared]\n", argv[0]);
         MPI_Finalize();
         return EXIT_FAILURE;
     }
 
     const int N = atoi(argv[1]);
     const int validate = (argc >= 3) ? atoi(argv[2]) : 0;
+    const int shared = (argc >= 4) ? atoi(argv[3]) : 0;
+
+    ptimer_t pt;
+    ptimer_init(&pt, MPI_COMM_WORLD);
 
     /* compute row counts per process */
     int base = N / size;
     int rem = N % size;
     int *sendcounts = (int*) malloc(size * sizeof(int)); /* number of rows */
     int *displs = (int*) malloc(size * sizeof(int));     /* displacement in rows */
-    int *sendcounts_elems = (int*) malloc(size * sizeof(int)); /* number of elements (rows*N) */
-    int *displs_elems = (int*) malloc(size * sizeof(int));     /* displacement in elements */
 
     int offset_rows = 0;
     for (int p = 0; p < size; ++p) {
         int rows = base + (p < rem ? 1 : 0);
         sendcounts[p] = rows;
         displs[p] = offset_rows;
-        sendcounts_elems[p] = rows * N;
-        displs_elems[p] = offset_rows * N;
         offset_rows += rows;
     }
 
     /* Local rows for this process */
     int local_rows = sendcounts[rank];
 
+    /* One matrix row as a datatype, so A moves with row counts */
+    MPI_Datatype rowtype;
+    MPI_Type_contiguous(N, MPI_DOUBLE, &rowtype);
+    MPI_Type_commit(&rowtype);
+
     /* Buffers:
      * - local_A: local_rows x N
      * - x: N
@@ -70,44 +95,59 @@ int main(int argc, char **argv) {
      */
     double *local_A = NULL;
     if (local_rows > 0) {
-        local_A = (double*) malloc((size_t) local_rows * N * sizeof(double));
+        local_A = alloc_doubles((size_t) local_rows * N);
         if (!local_A) { fprintf(stderr, "alloc local_A failed\n"); MPI_Abort(MPI_COMM_WORLD, 1); }
     }
 
-    double *x = (double*) malloc((size_t) N * sizeof(double));
-    double *local_y = (double*) malloc((size_t) local_rows * sizeof(double));
+    /* x is either private per rank or one node-shared copy */
+    node_comms_t nc;
+    MPI_Win x_win = MPI_WIN_NULL;
+    double *x;
+    if (shared) {
+        node_comms_init(&nc, MPI_COMM_WORLD);
+        x = (double*) node_shared_alloc(&nc, (size_t) N * sizeof(double), &x_win);
+    } else {
+        x = alloc_doubles((size_t) N);
+    }
+    double *local_y = alloc_doubles((size_t) local_rows);
     if (!x || !local_y) { fprintf(stderr, "alloc x/local_y failed\n"); MPI_Abort(MPI_COMM_WORLD, 1); }
 
     /* Root constructs the matrix and vector (deterministic values for repeatability) */
     double *A = NULL;
     if (rank == 0) {
-        A = (double*) malloc((size_t) N * N * sizeof(double));
+        A = alloc_doubles((size_t) N * N);
         if (!A) { fprintf(stderr, "alloc A failed\n"); MPI_Abort(MPI_COMM_WORLD, 1); }
-        for (int i = 0; i < N; ++i) {
-            for (int j = 0; j < N; ++j) {
+        for (size_t i = 0; i < (size_t) N; ++i) {
+            for (size_t j = 0; j < (size_t) N; ++j) {
                 A[i*N + j] = drand(i * N + j + 1);
             }
             x[i] = drand(i + 12345);
         }
     }
 
+    ptimer_phase(&pt, PT_DISTRIBUTE);
+
     /* Broadcast vector x to all processes. Root has x, others receive */
     /* First root must fill x; other processes' x content is undefined until broadcast */
-    MPI_Bcast(x, N, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-
-    /* Scatter matrix A row-blocks to local_A (using scatterv with element counts sendcounts_elems) */
-    MPI_Scatterv(A, sendcounts_elems, displs_elems, MPI_DOUBLE,
-                 local_A, local_rows * N, MPI_DOUBLE,
+    if (shared)
+        node_shared_bcast(&nc, x, N, MPI_DOUBLE, x_win);
+    else
+        MPI_Bcast(x, N, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+
+    /* Scatter matrix A row-blocks to local_A (counts and displacements in rows) */
+    MPI_Scatterv(A, sendcounts, displs, rowtype,
+                 local_A, local_rows, rowtype,
                  0, MPI_COMM_WORLD);
 
     /* Synchronize and time local multiplication (exclude init time if needed) */
     MPI_Barrier(MPI_COMM_WORLD);
+    ptimer_phase(&pt, PT_COMPUTE);
     double t0 = MPI_Wtime();
 
     /* Local mat-vec: for each local row i, compute dot product of row with x */
     for (int i = 0; i < local_rows; ++i) {
         double sum = 0.0;
-        double *row = &local_A[i * N];
+        double *row = &local_A[(size_t) i * N];
         /* unrolled loop could be added for speed */
         for (int j = 0; j < N; ++j) sum += row[j] * x[j];
         local_y[i] = sum;
@@ -115,21 +155,19 @@ int main(int argc, char **argv) {
 
     double t1 = MPI_Wtime();
     double local_compute_time = t1 - t0;
+    ptimer_phase(&pt, PT_COLLECT);
 
     /* Gather results local_y into y at root */
     double *y = NULL;
     if (rank == 0) {
-        y = (double*) malloc((size_t) N * sizeof(double));
+        y = alloc_doubles((size_t) N);
         if (!y) { fprintf(stderr, "alloc y failed\n"); MPI_Abort(MPI_COMM_WORLD, 1); }
     }
 
     MPI_Gatherv(local_y, local_rows, MPI_DOUBLE,
                 y, sendcounts, displs, MPI_DOUBLE,
                 0, MPI_COMM_WORLD);
-
-    /* Optional: measure a wall-clock time for whole operation including communication:
-       do a barrier and measure from before scatterv to after gatherv if desired.
-       Here we measured only local compute time — but we can compute global max compute time. */
+    ptimer_stop(&pt);
 
     double max_compute_time;
     MPI_Reduce(&local_compute_time, &max_compute_time, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
@@ -137,13 +175,14 @@ int main(int argc, char **argv) {
     if (rank == 0) {
         printf("N=%d P=%d max_compute_time=%.6f sec\n", N, size, max_compute_time);
     }
+    ptimer_report(&pt, NULL);
 
     /* Optional validation: compute sequential result on root and compare */
     if (validate && rank == 0) {
         double *y_seq = (double*) malloc((size_t) N * sizeof(double));
-        for (int i = 0; i < N; ++i) {
+        for (size_t i = 0; i < (size_t) N; ++i) {
             double s = 0.0;
-            for (int j = 0; j < N; ++j) s += A[i*N + j] * x[j];
+            for (size_t j = 0; j < (size_t) N; ++j) s += A[i*N + j] * x[j];
             y_seq[i] = s;
         }
         /* compare vector y and y_seq (root has both) */
@@ -159,11 +198,15 @@ int main(int argc, char **argv) {
     /* cleanup */
     free(sendcounts);
     free(displs);
-    free(sendcounts_elems);
-    free(displs_elems);
+    MPI_Type_free(&rowtype);
     if (A) free(A);
     if (local_A) free(local_A);
-    free(x);
+    if (shared) {
+        MPI_Win_free(&x_win);
+        node_comms_free(&nc);
+    } else {
+        free(x);
+    }
     free(local_y);
     if (y) free(y);
 
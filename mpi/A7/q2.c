@@ -10,20 +10,126 @@
  *
  * Run example:
  *   mpirun -np 4 ./matmat_mpi 1024
+ *
+ * Arguments: ./matmat_mpi N [validate] [mode] [panels] [depth] [compress]
+ *   mode   = 0 blocking MPI_Bcast of B (default)
+ *            1 pipelined: B is broadcast as row panels with MPI_Ibcast and
+ *              each rank multiplies against panel k while the next ones
+ *              are in flight
+ *            2 node-shared: one copy of B per node in an MPI-3 shared
+ *              window, broadcast only between node leaders
+ *   panels = number of row panels of B in pipelined mode (default 8)
+ *   depth  = lookahead, i.e. panels kept in flight while computing (default 1)
+ *   compress = none (default), lossless or lossy=<abs error bound>: mode 0
+ *              broadcasts B through common/compress.h in overlapped chunks
+ *              and compares against a plain MPI_Bcast of B, which is run
+ *              first and not counted in any phase
+ *
+ * In modes 0 and 2 B is transposed in place after the broadcast (see
+ * common/transpose.h) so the inner k loop of the local product streams
+ * rows of B^T instead of striding down columns of B. Build with
+ * -march=native -fopenmp to get the SIMD and threaded transpose.
+ *
+ * The phase table (common/phase_timer.h) splits the run into init /
+ * distribute / compute / collect with min, avg and max over ranks. In mode 1
+ * the B broadcast is part of compute, since it overlaps with it; the
+ * reference blocking broadcast is not counted in any phase.
+ *
+ * Matrices are transferred in units of one row (a contiguous datatype of N
+ * doubles), so no single message count overflows int even when N*N > 2^31.
  */
 
 #include <mpi.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
+
+#include "../../common/compress.h"
+#include "../../common/node_shared.h"
+#include "../../common/phase_timer.h"
+#include "../../common/transpose.h"
 
 /* Initialize matrix with random but deterministic values */
-static double drand(int seed) {
+static double drand(size_t seed) {
     unsigned int x = (unsigned int) seed;
     x = (1103515245u * x + 12345u) & 0x7fffffff;
     return (double)(x % 1000) / 1000.0;
 }
 
+/* 64-byte aligned allocation of n doubles (cache line / AVX-512 aligned) */
+static double *alloc_doubles(size_t n) {
+    void *p = NULL;
+    if (n == 0) n = 1;
+    if (posix_memalign(&p, 64, n * sizeof(double)) != 0) return NULL;
+    return (double *) p;
+}
+
+/* Start the broadcast of row panel p (rows [p*pb, p*pb + pb) of B) */
+static void post_panel(double *B, int N, int pb, int p, MPI_Datatype rowtype,
+                       MPI_Comm comm, MPI_Request *req) {
+    int r0 = p * pb;
+    int nr = (N - r0 < pb) ? N - r0 : pb;
+    MPI_Ibcast(&B[(size_t) r0 * N], nr, rowtype, 0, comm, req);
+}
+
+/*
+ * Pipelined local product: localC = localA * B, with B arriving as row panels.
+ * Panel p holds rows [p*pb, (p+1)*pb) of B and contributes
+ * localA[:, panel] * B[panel, :] to localC. Up to `depth` panels beyond the
+ * one being multiplied are kept in flight; MPI_Testall is called between
+ * rows so the library can progress them. Returns the time spent blocked in
+ * MPI_Wait (the exposed part of the broadcast).
+ */
+static double matmul_pipelined(int N, int local_rows, const double *localA,
+                               double *B, double *localC,
+                               int npanels, int depth, MPI_Datatype rowtype,
+                               MPI_Comm comm) {
+    int pb = (N + npanels - 1) / npanels;
+    npanels = (N + pb - 1) / pb;
+
+    MPI_Request *req = malloc(npanels * sizeof(MPI_Request));
+    int posted = 0;
+    double exposed = 0.0;
+
+    memset(localC, 0, (size_t) local_rows * N * sizeof(double));
+    while (posted < npanels && posted <= depth) {
+        post_panel(B, N, pb, posted, rowtype, comm, &req[posted]);
+        posted++;
+    }
+
+    for (int p = 0; p < npanels; p++) {
+        double tw = MPI_Wtime();
+        MPI_Wait(&req[p], MPI_STATUS_IGNORE);
+        exposed += MPI_Wtime() - tw;
+
+        int k0 = p * pb;
+        int k1 = (k0 + pb < N) ? k0 + pb : N;
+        int inflight = posted - (p + 1);
+        for (int i = 0; i < local_rows; i++) {
+            double *c = &localC[(size_t) i * N];
+            for (int k = k0; k < k1; k++) {
+                double a = localA[(size_t) i * N + k];
+                const double *b = &B[(size_t) k * N];
+                for (int j = 0; j < N; j++)
+                    c[j] += a * b[j];
+            }
+            if (inflight > 0) {
+                int flag;
+                MPI_Testall(inflight, &req[p + 1], &flag, MPI_STATUSES_IGNORE);
+            }
+        }
+
+        if (posted < npanels) {
+            post_panel(B, N, pb, posted, rowtype, comm, &req[posted]);
+            posted++;
+        }
+    }
+
+    free(req);
+    return exposed;
+}
+
 int main(int argc, char *argv[]) {
     int rank, size;
     MPI_Init(&argc, &argv);
@@ -31,82 +137,175 @@ int main(int argc, char *argv[]) {
     MPI_Comm_size(MPI_COMM_WORLD, &size);
 
     if (argc < 2) {
-        if (rank == 0) fprintf(stderr, "Usage: %s N [validate]\n", argv[0]);
+        if (rank == 0) fprintf(stderr, "Usage: %s N [validate] [mode] [panels] [depth] [compress]\n", argv[0]);
         MPI_Finalize();
         return 1;
     }
 
     int N = atoi(argv[1]);
     int validate = (argc >= 3) ? atoi(argv[2]) : 0;
+    int mode = (argc >= 4) ? atoi(argv[3]) : 0;
+    int npanels = (argc >= 5) ? atoi(argv[4]) : 8;
+    int depth = (argc >= 6) ? atoi(argv[5]) : 1;
+    if (npanels < 1) npanels = 1;
+    if (npanels > N) npanels = N;
+    if (depth < 0) depth = 0;
+    cz_cfg_t cz;
+    if (cz_parse(&cz, argc >= 7 ? argv[6] : NULL) != 0) {
+        if (rank == 0) fprintf(stderr, "compress: none, lossless or lossy=<error bound>\n");
+        MPI_Finalize();
+        return 1;
+    }
+    if (mode != 0) cz.mode = CZ_NONE;
+    cz_stats_t czst = { 0 };
+
+    ptimer_t pt;
+    ptimer_init(&pt, MPI_COMM_WORLD);
 
     int base = N / size;
     int rem = N % size;
 
     int *sendcounts = malloc(size * sizeof(int));
     int *displs = malloc(size * sizeof(int));
-    int *sendcounts_elems = malloc(size * sizeof(int));
-    int *displs_elems = malloc(size * sizeof(int));
 
     int offset_rows = 0;
     for (int p = 0; p < size; p++) {
         int rows = base + (p < rem ? 1 : 0);
         sendcounts[p] = rows;
         displs[p] = offset_rows;
-        sendcounts_elems[p] = rows * N;
-        displs_elems[p] = offset_rows * N;
         offset_rows += rows;
     }
 
     int local_rows = sendcounts[rank];
+    const size_t NN = (size_t) N * N;
+
+    /* One matrix row as a datatype: counts and displacements below are in rows */
+    MPI_Datatype rowtype;
+    MPI_Type_contiguous(N, MPI_DOUBLE, &rowtype);
+    MPI_Type_commit(&rowtype);
+
+    /* Mode 2 keeps B in a per-node shared window instead of a private copy */
+    node_comms_t nc;
+    MPI_Win B_win = MPI_WIN_NULL;
+    double *B;
+    if (mode == 2) {
+        node_comms_init(&nc, MPI_COMM_WORLD);
+        B = node_shared_alloc(&nc, NN * sizeof(double), &B_win);
+    } else {
+        B = alloc_doubles(NN);
+    }
 
     double *A = NULL;
-    double *B = malloc(N * N * sizeof(double));
-    double *localA = malloc(local_rows * N * sizeof(double));
-    double *localC = malloc(local_rows * N * sizeof(double));
+    double *localA = alloc_doubles((size_t) local_rows * N);
+    double *localC = alloc_doubles((size_t) local_rows * N);
     double *C = NULL;
+    if (!B || !localA || !localC) { fprintf(stderr, "alloc B/localA/localC failed\n"); MPI_Abort(MPI_COMM_WORLD, 1); }
 
     if (rank == 0) {
-        A = malloc(N * N * sizeof(double));
-        C = malloc(N * N * sizeof(double));
+        A = alloc_doubles(NN);
+        C = alloc_doubles(NN);
+        if (!A || !C) { fprintf(stderr, "alloc A/C failed\n"); MPI_Abort(MPI_COMM_WORLD, 1); }
 
-        for (int i = 0; i < N; i++)
-            for (int j = 0; j < N; j++)
+        for (size_t i = 0; i < (size_t) N; i++)
+            for (size_t j = 0; j < (size_t) N; j++)
                 A[i * N + j] = drand(i * N + j + 1);
 
-        for (int i = 0; i < N; i++)
-            for (int j = 0; j < N; j++)
+        for (size_t i = 0; i < (size_t) N; i++)
+            for (size_t j = 0; j < (size_t) N; j++)
                 B[i * N + j] = drand(i + j + 12345);
     }
 
-    // Broadcast matrix B to all processes
-    MPI_Bcast(B, N * N, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    double local_time, exposed = 0.0, comm_ref = 0.0, cz_time = 0.0;
 
-    // Scatter rows of A to processes
-    MPI_Scatterv(A, sendcounts_elems, displs_elems, MPI_DOUBLE,
-                 localA, local_rows * N, MPI_DOUBLE,
-                 0, MPI_COMM_WORLD);
+    ptimer_phase(&pt, PT_DISTRIBUTE);
+    if (mode == 1) {
+        // Scatter rows of A first; B is streamed in panels during compute
+        MPI_Scatterv(A, sendcounts, displs, rowtype,
+                     localA, local_rows, rowtype,
+                     0, MPI_COMM_WORLD);
 
-    MPI_Barrier(MPI_COMM_WORLD);
-    double t0 = MPI_Wtime();
+        // Reference cost of the full blocking broadcast, to split the
+        // pipelined communication into hidden and exposed parts; the copies
+        // are wiped after it so the panels really have to deliver B
+        ptimer_stop(&pt);
+        MPI_Barrier(MPI_COMM_WORLD);
+        double tb = MPI_Wtime();
+        MPI_Bcast(B, N, rowtype, 0, MPI_COMM_WORLD);
+        comm_ref = MPI_Wtime() - tb;
+        if (rank != 0) memset(B, 0, NN * sizeof(double));
 
-    // Local computation: localC = localA * B
-    for (int i = 0; i < local_rows; i++) {
-        for (int j = 0; j < N; j++) {
-            double sum = 0.0;
-            for (int k = 0; k < N; k++) {
-                sum += localA[i * N + k] * B[k * N + j];
+        MPI_Barrier(MPI_COMM_WORLD);
+        ptimer_phase(&pt, PT_COMPUTE);
+        double t0 = MPI_Wtime();
+        exposed = matmul_pipelined(N, local_rows, localA, B, localC,
+                                   npanels, depth, rowtype, MPI_COMM_WORLD);
+        local_time = MPI_Wtime() - t0;
+    } else {
+        // Broadcast matrix B to all processes (to node leaders in mode 2)
+        if (mode == 2) {
+            node_shared_bcast(&nc, B, N, rowtype, B_win);
+        } else if (cz.mode != CZ_NONE) {
+            // Reference plain broadcast outside the phases, then wipe the
+            // copies so the compressed one has to deliver all of B
+            ptimer_stop(&pt);
+            MPI_Barrier(MPI_COMM_WORLD);
+            double tb = MPI_Wtime();
+            MPI_Bcast(B, N, rowtype, 0, MPI_COMM_WORLD);
+            comm_ref = MPI_Wtime() - tb;
+            if (rank != 0) memset(B, 0, NN * sizeof(double));
+            MPI_Barrier(MPI_COMM_WORLD);
+            ptimer_phase(&pt, PT_DISTRIBUTE);
+            tb = MPI_Wtime();
+            if (cz_bcast(B, NN, 0, MPI_COMM_WORLD, &cz, &czst) != MPI_SUCCESS) {
+                fprintf(stderr, "rank %d: corrupt compressed chunk\n", rank);
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+            cz_time = MPI_Wtime() - tb;
+        } else {
+            MPI_Bcast(B, N, rowtype, 0, MPI_COMM_WORLD);
+        }
+
+        // Scatter rows of A to processes
+        MPI_Scatterv(A, sendcounts, displs, rowtype,
+                     localA, local_rows, rowtype,
+                     0, MPI_COMM_WORLD);
+
+        MPI_Barrier(MPI_COMM_WORLD);
+        ptimer_phase(&pt, PT_COMPUTE);
+        double t0 = MPI_Wtime();
+
+        // B <- B^T so that column j of B is contiguous (one transpose per node in mode 2)
+        if (mode == 2) {
+            if (nc.node_rank == 0) transpose_inplace(B, N, N);
+            MPI_Win_fence(0, B_win);
+        } else {
+            transpose_inplace(B, N, N);
+        }
+        const double *BT = B;
+
+        // Local computation: localC = localA * B, row i of localA dot row j of B^T
+        for (size_t i = 0; i < (size_t) local_rows; i++) {
+            const double *a = &localA[i * N];
+            for (size_t j = 0; j < (size_t) N; j++) {
+                const double *bt = &BT[j * N];
+                double sum = 0.0;
+                for (size_t k = 0; k < (size_t) N; k++) {
+                    sum += a[k] * bt[k];
+                }
+                localC[i * N + j] = sum;
             }
-            localC[i * N + j] = sum;
         }
-    }
 
-    double t1 = MPI_Wtime();
-    double local_time = t1 - t0;
+        double t1 = MPI_Wtime();
+        local_time = t1 - t0;
+    }
 
     // Gather results
-    MPI_Gatherv(localC, local_rows * N, MPI_DOUBLE,
-                C, sendcounts_elems, displs_elems, MPI_DOUBLE,
+    ptimer_phase(&pt, PT_COLLECT);
+    MPI_Gatherv(localC, local_rows, rowtype,
+                C, sendcounts, displs, rowtype,
                 0, MPI_COMM_WORLD);
+    ptimer_stop(&pt);
 
     double max_time;
     MPI_Reduce(&local_time, &max_time, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
@@ -114,20 +313,53 @@ int main(int argc, char *argv[]) {
     if (rank == 0) {
         printf("N=%d P=%d max_compute_time=%.6f sec\n", N, size, max_time);
     }
+    ptimer_report(&pt, NULL);
+
+    if (mode == 2 && rank == 0) {
+        printf("node-shared B: %d copies for %d ranks, %.1f MB per node\n",
+               nc.num_nodes, size, NN * sizeof(double) / 1e6);
+    }
+
+    if (cz.mode != CZ_NONE) cz_report(&czst, cz_time, comm_ref, cz_name(&cz), MPI_COMM_WORLD);
+
+    if (mode == 1) {
+        // Exposed = time blocked in MPI_Wait; hidden = the rest of what a
+        // blocking broadcast of B costs, which overlapped with compute
+        double max_exposed, max_ref;
+        MPI_Reduce(&exposed, &max_exposed, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+        MPI_Reduce(&comm_ref, &max_ref, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+        if (rank == 0) {
+            double hidden = max_ref - max_exposed;
+            if (hidden < 0.0) hidden = 0.0;
+            printf("pipelined panels=%d depth=%d bcast_ref=%.6f exposed=%.6f hidden=%.6f sec\n",
+                   npanels, depth, max_ref, max_exposed, hidden);
+        }
+    }
 
     // Optional: Validation
     if (validate && rank == 0) {
-        double *Cseq = malloc(N * N * sizeof(double));
-        for (int i = 0; i < N; i++) {
-            for (int j = 0; j < N; j++) {
-                double s = 0.0;
-                for (int k = 0; k < N; k++)
-                    s += A[i * N + k] * B[k * N + j];
-                Cseq[i * N + j] = s;
+        // Same k order as the parallel kernels, on whichever layout B is in
+        double *Cseq = alloc_doubles(NN);
+        if (mode == 1) {
+            memset(Cseq, 0, NN * sizeof(double));
+            for (size_t i = 0; i < (size_t) N; i++)
+                for (size_t k = 0; k < (size_t) N; k++) {
+                    double a = A[i * N + k];
+                    for (size_t j = 0; j < (size_t) N; j++)
+                        Cseq[i * N + j] += a * B[k * N + j];
+                }
+        } else {
+            for (size_t i = 0; i < (size_t) N; i++) {
+                for (size_t j = 0; j < (size_t) N; j++) {
+                    double s = 0.0;
+                    for (size_t k = 0; k < (size_t) N; k++)
+                        s += A[i * N + k] * B[j * N + k];
+                    Cseq[i * N + j] = s;
+                }
             }
         }
         double max_diff = 0.0;
-        for (int i = 0; i < N * N; i++) {
+        for (size_t i = 0; i < NN; i++) {
             double diff = fabs(Cseq[i] - C[i]);
             if (diff > max_diff) max_diff = diff;
         }
@@ -137,13 +369,17 @@ int main(int argc, char *argv[]) {
 
     if (A) free(A);
     if (C) free(C);
-    free(B);
+    if (mode == 2) {
+        MPI_Win_free(&B_win);
+        node_comms_free(&nc);
+    } else {
+        free(B);
+    }
     free(localA);
     free(localC);
     free(sendcounts);
     free(displs);
-    free(sendcounts_elems);
-    free(displs_elems);
+    MPI_Type_free(&rowtype);
 
     MPI_Finalize();
     return 0;
@@ -1,144 +1,1558 @@
 /*
  * conv2d_mpi.c
- * Parallel 2D Convolution using MPI (row-wise decomposition)
+ * Parallel 2D Convolution using MPI (2D Cartesian domain decomposition)
  *
  * Compile:
- *   mpicc -O2 -o conv2d_mpi conv2d_mpi.c
+ *   mpicc -O2 -o conv2d_mpi conv2d_mpi.c -lm
+ *   (add -march=native for the AVX/FMA versions of the fixed-size kernels)
  *
  * Run Example:
  *   mpirun -np 4 ./conv2d_mpi 512 3
+ *   mpirun -np 4 ./conv2d_mpi -a fft 2048 63
+ *   mpirun -np 4 ./conv2d_mpi -t 100 -h 4 2048 3
+ *
+ * The N x N image is split into a Pr x Pc grid of tiles (MPI_Cart_create,
+ * dims from MPI_Dims_create unless -d is given). Each rank holds its tile
+ * with a pad-wide halo on all four sides and exchanges it with up to eight
+ * neighbours: row halos are contiguous pieces of a tile row, column halos
+ * and corners are strided MPI_Type_vector's. Pixels outside the image are
+ * zero, so the output is the full N x N "same" convolution.
+ *
+ * Options:
+ *   -s     keep one copy of the kernel per node in an MPI-3 shared window,
+ *          broadcast only between node leaders
+ *   -b     blocking halo exchange before computing, instead of the default
+ *          MPI_Isend/MPI_Irecv exchange overlapped with the tile interior;
+ *          use it as the reference for the exposed halo time
+ *   -d RxC process grid, e.g. -d 4x1 for the old row decomposition
+ *   -v     validate against a sequential convolution on rank 0, and check
+ *          that box, gauss and sobel plan as 1 separable term at M = 3..9
+ *   -k K   kernel: random (default), gauss, box or sobel
+ *   -e tol allow a low-rank approximation of the kernel with relative
+ *          Frobenius error <= tol (default 0: exact rank only)
+ *   -r R   force R separable terms (0 = direct M x M loops)
+ *   -a A   algorithm: auto (default), direct (tiled direct/separable) or fft
+ *   -g     use the generic direct loop instead of the fixed-size kernels
+ *   -p B   boundary: zero (default), replicate or reflect (tiled, single pass)
+ *   -i F   read the image from F (.pgm, .pfm, else raw doubles) with MPI-IO;
+ *          N may be given as 0 for pgm/pfm, the header has the size
+ *   -o F   write the result to F (format by extension) with MPI-IO
+ *   -n     do not gather the result on rank 0
+ *   -t T   time stepping: apply the kernel (scaled to sum |k| = 1) T times,
+ *          keeping the image distributed and double buffered; each step
+ *          runs the tiled plan, direct or separable (-a fft is rejected)
+ *   -h k   with -t: halo depth k * pad, exchanged once every k steps
+ *   -w S   with -t: temporal tiling strip height in rows (default from
+ *          STEP_CACHE_BYTES, 0 = sweep the whole tile once per step)
+ *
+ * I/O: with -i every rank reads only its tile and its halo (clipped to the
+ * image) through a subarray file view (common/imgio.h), so no halo exchange
+ * is needed before the single pass, and rank 0 never holds the image unless
+ * -v asks for it. With -o each rank writes its own output tile collectively;
+ * together with -n nothing is funnelled through rank 0.
+ *
+ * Direct kernels: M = 3, 5, 7 and 9 have compile-time specialised SIMD
+ * kernels (CONV_ROWS_FIXED) selected at run time, other M use the generic
+ * loop. Non-zero boundaries are written into the halo cells outside the
+ * image after the exchange, so no kernel tests bounds.
+ *
+ * Separable kernels: the kernel's SVD K = sum_t s_t u_t v_t^T is computed on
+ * every rank. When r terms reproduce K (to tol) and 2 r M < M^2, the tile is
+ * convolved as r horizontal 1D passes followed by r vertical 1D passes,
+ * 2 r M multiply-adds per pixel instead of M^2. A truncated approximation
+ * reports ||K - K_r||_F and the per-pixel bound ||K - K_r||_F * M * max|image|.
+ *
+ * FFT path (large kernels): image and kernel are zero padded to L x L with
+ * L >= N + M/2 (no wrap-around), L a multiple of P with small prime factors.
+ * Rows are split into P slabs; a 2D FFT is row FFTs, an MPI_Alltoall
+ * transpose and row FFTs again. After the pointwise product with the kernel
+ * spectrum the inverse runs the same way, so the spectrum is never transposed
+ * back. Cost O(L^2 log L) instead of O(N^2 M^2); -a auto picks the cheaper
+ * path from flop estimates (fft_flops / direct_flops).
+ *
+ * Tiles are moved with subarray datatypes (count 1), so message counts stay
+ * within int for images larger than 2^31 pixels.
+ *
+ * Every path ends with the phase table of common/phase_timer.h: init (setup,
+ * kernel planning), distribute (kernel broadcast, image scatter or read),
+ * compute and collect (gather or write), min / avg / max over ranks.
  */
 
 #include <mpi.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../../common/node_shared.h"
+#include "../../common/fft.h"
+#include "../../common/imgio.h"
+#include "../../common/phase_timer.h"
 
-#define IDX(i, j, N) ((i) * (N) + (j))
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#define IDX(i, j, N) ((size_t)(i) * (N) + (j))
+
+/* halo directions; opposite pairs are N/S, W/E, NW/SE, NE/SW */
+enum { DIR_N, DIR_S, DIR_W, DIR_E, DIR_NW, DIR_NE, DIR_SW, DIR_SE, NDIRS };
+static const int dir_opposite[NDIRS] = { DIR_S, DIR_N, DIR_E, DIR_W, DIR_SE, DIR_SW, DIR_NE, DIR_NW };
+static const int dir_drow[NDIRS] = { -1, 1, 0, 0, -1, -1, 1, 1 };
+static const int dir_dcol[NDIRS] = { 0, 0, -1, 1, -1, 1, -1, 1 };
+
+/*
+ * One rank's piece of the image: lr x lc interior pixels starting at global
+ * (gr0, gc0), stored with an H-wide halo on every side (row stride ld).
+ */
+typedef struct {
+    int gr0, gc0;
+    int lr, lc;
+    int H, ld;
+    int nbr[NDIRS];                     /* MPI_PROC_NULL at the image edge */
+    MPI_Datatype rowhalo, colhalo, corner;
+} tile_t;
+
+/* Pixel (i, j) of the tile, in interior coordinates (-H <= i < lr + H) */
+#define TPIX(t, buf, i, j) ((buf)[IDX((i) + (t)->H, (j) + (t)->H, (t)->ld)])
 
 void random_matrix(double *mat, int rows, int cols) {
-    for (int i = 0; i < rows * cols; i++)
+    for (size_t i = 0; i < (size_t) rows * cols; i++)
         mat[i] = (double)(rand() % 10);
 }
 
-int main(int argc, char *argv[]) {
-    int rank, size;
-    MPI_Init(&argc, &argv);
-    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-    MPI_Comm_size(MPI_COMM_WORLD, &size);
+/* 64-byte aligned allocation of n doubles (cache line / AVX-512 aligned) */
+static double *alloc_doubles(size_t n) {
+    void *p = NULL;
+    if (n == 0) n = 1;
+    if (posix_memalign(&p, 64, n * sizeof(double)) != 0) return NULL;
+    return (double *) p;
+}
 
-    if (argc < 3) {
-        if (rank == 0)
-            fprintf(stderr, "Usage: %s <image_size N> <kernel_size M>\n", argv[0]);
-        MPI_Finalize();
+/* Block p of n items split over P parts (first n % P parts get one extra) */
+static void block_range(int n, int P, int p, int *start, int *count) {
+    int base = n / P, rem = n % P;
+    *start = p * base + (p < rem ? p : rem);
+    *count = base + (p < rem ? 1 : 0);
+}
+
+/* Geometry and halo datatypes of the tile at grid coordinates coords */
+static void tile_init(tile_t *t, int N, const int dims[2], const int coords[2],
+                      int H, MPI_Comm cart) {
+    block_range(N, dims[0], coords[0], &t->gr0, &t->lr);
+    block_range(N, dims[1], coords[1], &t->gc0, &t->lc);
+    t->H = H;
+    t->ld = t->lc + 2 * H;
+
+    for (int d = 0; d < NDIRS; d++) {
+        int c[2] = { coords[0] + dir_drow[d], coords[1] + dir_dcol[d] };
+        if (c[0] < 0 || c[0] >= dims[0] || c[1] < 0 || c[1] >= dims[1])
+            t->nbr[d] = MPI_PROC_NULL;
+        else
+            MPI_Cart_rank(cart, c, &t->nbr[d]);
+    }
+
+    MPI_Type_vector(H, t->lc, t->ld, MPI_DOUBLE, &t->rowhalo);
+    MPI_Type_vector(t->lr, H, t->ld, MPI_DOUBLE, &t->colhalo);
+    MPI_Type_vector(H, H, t->ld, MPI_DOUBLE, &t->corner);
+    MPI_Type_commit(&t->rowhalo);
+    MPI_Type_commit(&t->colhalo);
+    MPI_Type_commit(&t->corner);
+}
+
+static void tile_free(tile_t *t) {
+    MPI_Type_free(&t->rowhalo);
+    MPI_Type_free(&t->colhalo);
+    MPI_Type_free(&t->corner);
+}
+
+/*
+ * Post the 8-neighbour halo exchange of buf. For each direction d we send
+ * the H-wide strip of our interior next to d and receive into the halo on
+ * side d; tags carry the sender's direction so each message matches the
+ * receive for the opposite side.
+ */
+static void halo_start(const tile_t *t, double *buf, MPI_Comm cart, MPI_Request req[2 * NDIRS]) {
+    int H = t->H, lr = t->lr, lc = t->lc;
+    for (int d = 0; d < NDIRS; d++) {
+        MPI_Datatype type = (dir_drow[d] == 0) ? t->colhalo
+                          : (dir_dcol[d] == 0) ? t->rowhalo : t->corner;
+        int ri = (dir_drow[d] < 0) ? -H : (dir_drow[d] > 0) ? lr : 0;
+        int rj = (dir_dcol[d] < 0) ? -H : (dir_dcol[d] > 0) ? lc : 0;
+        int si = (dir_drow[d] > 0) ? lr - H : 0;
+        int sj = (dir_dcol[d] > 0) ? lc - H : 0;
+        MPI_Irecv(&TPIX(t, buf, ri, rj), 1, type, t->nbr[d], dir_opposite[d], cart, &req[d]);
+        MPI_Isend(&TPIX(t, buf, si, sj), 1, type, t->nbr[d], d, cart, &req[NDIRS + d]);
+    }
+}
+
+/* ---- direct kernels ---- */
+
+/*
+ * Convolve output pixels rows [r0, r1) x cols [c0, c1) of tile t (rows and
+ * cols may reach into the halo). Pixel (i, j) is stored at
+ * out[(i + oh) * ldo + j + oh]: ldo = lc, oh = 0 for a bare output tile,
+ * ldo = ld, oh = H for a buffer with the same halo as the input.
+ */
+typedef void (*conv_rows_fn)(const tile_t *t, const double *in, double *out, size_t ldo, int oh,
+                             const double *kernel, int M, int r0, int r1, int c0, int c1);
+
+/* Generic fallback for any M */
+static void conv_rows_generic(const tile_t *t, const double *in, double *out, size_t ldo, int oh,
+                              const double *kernel, int M, int r0, int r1, int c0, int c1) {
+    int pad = M / 2;
+    for (int i = r0; i < r1; i++) {
+        double *dst = out + (size_t) (i + oh) * ldo + oh;
+        for (int j = c0; j < c1; j++) {
+            double sum = 0.0;
+            for (int u = 0; u < M; u++) {
+                const double *src = &TPIX(t, in, i + u - pad, j - pad);
+                const double *k = &kernel[IDX(u, 0, M)];
+                for (int v = 0; v < M; v++) sum += src[v] * k[v];
+            }
+            dst[j] = sum;
+        }
+    }
+}
+
+/* SIMD vectors of CV_W doubles: AVX, SSE2, or plain doubles */
+#if defined(__AVX__)
+typedef __m256d cv_vec;
+#define CV_W 4
+#define cv_set1(x) _mm256_set1_pd(x)
+#define cv_load(p) _mm256_loadu_pd(p)
+#define cv_store(p, v) _mm256_storeu_pd(p, v)
+#if defined(__FMA__)
+#define cv_madd(a, b, c) _mm256_fmadd_pd(a, b, c)
+#else
+#define cv_madd(a, b, c) _mm256_add_pd(_mm256_mul_pd(a, b), c)
+#endif
+#elif defined(__SSE2__)
+typedef __m128d cv_vec;
+#define CV_W 2
+#define cv_set1(x) _mm_set1_pd(x)
+#define cv_load(p) _mm_loadu_pd(p)
+#define cv_store(p, v) _mm_storeu_pd(p, v)
+#define cv_madd(a, b, c) _mm_add_pd(_mm_mul_pd(a, b), c)
+#else
+typedef double cv_vec;
+#define CV_W 1
+#define cv_set1(x) (x)
+#define cv_load(p) (*(p))
+#define cv_store(p, v) (*(p) = (v))
+#define cv_madd(a, b, c) ((a) * (b) + (c))
+#endif
+
+/*
+ * Kernel for a compile-time MM x MM kernel. The coefficients are broadcast
+ * into vectors once; each iteration produces 2 * CV_W adjacent output pixels
+ * in two accumulators, with the u/v loops fully unrolled and no bounds
+ * checks (the halo supplies every neighbour). Leftover columns go through
+ * the scalar loop. Without FMA the summation order equals the generic path.
+ */
+#define CONV_ROWS_FIXED(MM)                                                                 \
+static void conv_rows_##MM(const tile_t *t, const double *in, double *out, size_t ldo, int oh, \
+                           const double *kernel, int M, int r0, int r1, int c0, int c1) {  \
+    enum { K = MM, P = MM / 2 };                                                            \
+    (void) M;                                                                               \
+    cv_vec kv[K * K];                                                                       \
+    for (int e = 0; e < K * K; e++) kv[e] = cv_set1(kernel[e]);                             \
+    size_t ld = t->ld;                                                                      \
+    for (int i = r0; i < r1; i++) {                                                         \
+        const double *src = &TPIX(t, in, i - P, -P);                                        \
+        double *dst = out + (size_t) (i + oh) * ldo + oh;                                   \
+        int j = c0;                                                                         \
+        for (; j + 2 * CV_W <= c1; j += 2 * CV_W) {                                         \
+            cv_vec a0 = cv_set1(0.0), a1 = cv_set1(0.0);                                    \
+            _Pragma("GCC unroll 16")                                                        \
+            for (int u = 0; u < K; u++) {                                                   \
+                const double *s = src + u * ld + j;                                         \
+                _Pragma("GCC unroll 16")                                                    \
+                for (int v = 0; v < K; v++) {                                               \
+                    a0 = cv_madd(kv[u * K + v], cv_load(s + v), a0);                        \
+                    a1 = cv_madd(kv[u * K + v], cv_load(s + v + CV_W), a1);                 \
+                }                                                                           \
+            }                                                                               \
+            cv_store(dst + j, a0);                                                          \
+            cv_store(dst + j + CV_W, a1);                                                   \
+        }                                                                                   \
+        for (; j < c1; j++) {                                                               \
+            double sum = 0.0;                                                               \
+            for (int u = 0; u < K; u++)                                                     \
+                for (int v = 0; v < K; v++)                                                 \
+                    sum += src[u * ld + j + v] * kernel[u * K + v];                         \
+            dst[j] = sum;                                                                   \
+        }                                                                                   \
+    }                                                                                       \
+}
+
+CONV_ROWS_FIXED(3)
+CONV_ROWS_FIXED(5)
+CONV_ROWS_FIXED(7)
+CONV_ROWS_FIXED(9)
+
+/* Fixed-size kernel for M if there is one, else the generic loop */
+static conv_rows_fn conv_rows_select(int M, int generic) {
+    if (generic) return conv_rows_generic;
+    switch (M) {
+    case 3: return conv_rows_3;
+    case 5: return conv_rows_5;
+    case 7: return conv_rows_7;
+    case 9: return conv_rows_9;
+    default: return conv_rows_generic;
+    }
+}
+
+/* ---- boundary modes ---- */
+
+/*
+ * Pixels outside the image: zero, replicate (clamp to the edge pixel) or
+ * reflect (mirror about the edge pixel, x[-d] = x[d]). Non-zero modes are
+ * realised by filling the halo cells that lie outside the image after the
+ * exchange, so the kernels above never test bounds.
+ */
+typedef enum { BND_ZERO, BND_REPLICATE, BND_REFLECT } boundary_t;
+
+static const char *boundary_name[] = { "zero", "replicate", "reflect" };
+
+/* Image index for out-of-range x in [-(n-1), 2n - 2]; -1 for zero padding */
+static int boundary_map(int x, int n, boundary_t mode) {
+    if (x >= 0 && x < n) return x;
+    if (mode == BND_ZERO) return -1;
+    if (mode == BND_REPLICATE) return x < 0 ? 0 : n - 1;
+    return x < 0 ? -x : 2 * (n - 1) - x;
+}
+
+/*
+ * Fill the halo of buf outside the image from the tile. Columns first for
+ * all rows, so the N/S pass copies rows whose W/E halo is already complete
+ * and the image corners come out right.
+ */
+static void halo_fill_boundary(const tile_t *t, double *buf, boundary_t mode) {
+    if (mode == BND_ZERO) return;
+    int H = t->H, lr = t->lr, lc = t->lc;
+    int west = t->nbr[DIR_W] == MPI_PROC_NULL, east = t->nbr[DIR_E] == MPI_PROC_NULL;
+    int north = t->nbr[DIR_N] == MPI_PROC_NULL, south = t->nbr[DIR_S] == MPI_PROC_NULL;
+    for (int i = -H; i < lr + H; i++)
+        for (int d = 1; d <= H; d++) {
+            if (west) TPIX(t, buf, i, -d) = TPIX(t, buf, i, boundary_map(-d, lc, mode));
+            if (east) TPIX(t, buf, i, lc - 1 + d) = TPIX(t, buf, i, boundary_map(lc - 1 + d, lc, mode));
+        }
+    for (int d = 1; d <= H; d++) {
+        if (north) memcpy(&TPIX(t, buf, -d, -H), &TPIX(t, buf, boundary_map(-d, lr, mode), -H), t->ld * sizeof(double));
+        if (south) memcpy(&TPIX(t, buf, lr - 1 + d, -H), &TPIX(t, buf, boundary_map(lr - 1 + d, lr, mode), -H),
+                          t->ld * sizeof(double));
+    }
+}
+
+/*
+ * Split a tile into the block that needs no halo data, [pad, lr - pad) x
+ * [pad, lc - pad), and the pad-wide frame around it. Regions are
+ * {r0, r1, c0, c1}; returns the number of frame regions. When the tile is
+ * thinner than 2 * pad the interior is empty and the frame is the tile.
+ */
+static int tile_split(const tile_t *t, int pad, int interior[4], int frame[4][4]) {
+    int lr = t->lr, lc = t->lc;
+    int r0 = pad, r1 = lr - pad, c0 = pad, c1 = lc - pad;
+    if (r1 <= r0 || c1 <= c0) {
+        interior[0] = interior[1] = interior[2] = interior[3] = 0;
+        frame[0][0] = 0; frame[0][1] = lr; frame[0][2] = 0; frame[0][3] = lc;
         return 1;
     }
+    interior[0] = r0; interior[1] = r1; interior[2] = c0; interior[3] = c1;
+    int f[4][4] = { { 0, r0, 0, lc }, { r1, lr, 0, lc }, { r0, r1, 0, c0 }, { r0, r1, c1, lc } };
+    memcpy(frame, f, sizeof(f));
+    return 4;
+}
+
+/* ---- separable / low-rank kernels ---- */
+
+/*
+ * SVD of the M x M kernel by one-sided Jacobi: K = sum_t S[t] U[:,t] V[:,t]^T
+ * with S sorted in decreasing order. U, V are M x M row-major.
+ */
+static void kernel_svd(const double *K, int M, double *U, double *S, double *V) {
+    double *A = malloc((size_t) M * M * sizeof(double));
+    memcpy(A, K, (size_t) M * M * sizeof(double));
+    for (int i = 0; i < M; i++)
+        for (int j = 0; j < M; j++)
+            V[IDX(i, j, M)] = (i == j) ? 1.0 : 0.0;
+
+    for (int sweep = 0; sweep < 60; sweep++) {
+        int rotated = 0;
+        for (int p = 0; p < M - 1; p++)
+            for (int q = p + 1; q < M; q++) {
+                double alpha = 0.0, beta = 0.0, gamma = 0.0;
+                for (int i = 0; i < M; i++) {
+                    alpha += A[IDX(i, p, M)] * A[IDX(i, p, M)];
+                    beta += A[IDX(i, q, M)] * A[IDX(i, q, M)];
+                    gamma += A[IDX(i, p, M)] * A[IDX(i, q, M)];
+                }
+                if (fabs(gamma) <= 1e-15 * sqrt(alpha * beta) || gamma == 0.0) continue;
+                rotated = 1;
+                double zeta = (beta - alpha) / (2.0 * gamma);
+                double tn = (zeta >= 0 ? 1.0 : -1.0) / (fabs(zeta) + sqrt(1.0 + zeta * zeta));
+                double c = 1.0 / sqrt(1.0 + tn * tn), sn = c * tn;
+                for (int i = 0; i < M; i++) {
+                    double ap = A[IDX(i, p, M)], aq = A[IDX(i, q, M)];
+                    A[IDX(i, p, M)] = c * ap - sn * aq;
+                    A[IDX(i, q, M)] = sn * ap + c * aq;
+                    double vp = V[IDX(i, p, M)], vq = V[IDX(i, q, M)];
+                    V[IDX(i, p, M)] = c * vp - sn * vq;
+                    V[IDX(i, q, M)] = sn * vp + c * vq;
+                }
+            }
+        if (!rotated) break;
+    }
+
+    /* singular values are the column norms; sort columns by them */
+    int *order = malloc(M * sizeof(int));
+    double *norm = malloc(M * sizeof(double));
+    for (int j = 0; j < M; j++) {
+        double s2 = 0.0;
+        for (int i = 0; i < M; i++) s2 += A[IDX(i, j, M)] * A[IDX(i, j, M)];
+        norm[j] = sqrt(s2);
+        order[j] = j;
+    }
+    for (int a = 1; a < M; a++)
+        for (int b = a; b > 0 && norm[order[b]] > norm[order[b - 1]]; b--) {
+            int tmp = order[b]; order[b] = order[b - 1]; order[b - 1] = tmp;
+        }
+    double *Vs = malloc((size_t) M * M * sizeof(double));
+    memcpy(Vs, V, (size_t) M * M * sizeof(double));
+    for (int k = 0; k < M; k++) {
+        int j = order[k];
+        S[k] = norm[j];
+        for (int i = 0; i < M; i++) {
+            U[IDX(i, k, M)] = (norm[j] > 0.0) ? A[IDX(i, j, M)] / norm[j] : 0.0;
+            V[IDX(i, k, M)] = Vs[IDX(i, j, M)];
+        }
+    }
+    free(A); free(Vs); free(order); free(norm);
+}
+
+/* How the convolution is evaluated on a tile: direct M x M, or r separable passes */
+typedef struct {
+    int M, pad;
+    const double *kernel;
+    int r;              /* separable terms; 0 = direct */
+    double *col_f;      /* r x M, S[t] * U[:,t] (vertical pass) */
+    double *row_f;      /* r x M, V[:,t] (horizontal pass) */
+    double *tmp;        /* r planes of (lr + 2 pad) x lc horizontal-pass results */
+    double rel_err;     /* ||K - K_r||_F / ||K||_F */
+    double abs_err;     /* ||K - K_r||_F */
+    conv_rows_fn rows;  /* direct kernel for M */
+} conv_plan_t;
 
-    int N = atoi(argv[1]);  // Image size N x N
-    int M = atoi(argv[2]);  // Kernel size M x M
+/*
+ * Pick the evaluation for this kernel. force_r >= 0 forces r separable terms
+ * (0 = direct). Otherwise use the smallest r with relative Frobenius error
+ * <= tol (exact rank when tol is 0) if that is cheaper than direct, i.e.
+ * 2 r M < M^2 multiply-adds per pixel.
+ */
+static void conv_plan_init(conv_plan_t *pl, const double *kernel, int M, int force_r, double tol,
+                           int generic) {
+    pl->M = M;
+    pl->rows = conv_rows_select(M, generic);
+    pl->pad = M / 2;
+    pl->kernel = kernel;
+    pl->r = 0;
+    pl->col_f = pl->row_f = pl->tmp = NULL;
+    pl->rel_err = pl->abs_err = 0.0;
+
+    double *U = malloc((size_t) M * M * sizeof(double));
+    double *V = malloc((size_t) M * M * sizeof(double));
+    double *S = malloc(M * sizeof(double));
+    kernel_svd(kernel, M, U, S, V);
+
+    double total = 0.0;
+    for (int k = 0; k < M; k++) total += S[k] * S[k];
+    if (tol < 1e-12) tol = 1e-12;
+
+    int r = force_r;
+    if (r < 0) {
+        /* sum each tail from the small end: total - sum S[k]^2 leaves a residue
+         * of about eps * total, far above tol^2 * total */
+        for (r = 0; r < M; r++) {
+            double tail = 0.0;
+            for (int k = M - 1; k >= r; k--) tail += S[k] * S[k];
+            if (!(tail > tol * tol * total)) break;
+        }
+        if (2 * r * M >= M * M) r = 0;
+    }
+    if (r > M) r = M;
+
+    if (r > 0) {
+        double tail = 0.0;
+        for (int k = r; k < M; k++) tail += S[k] * S[k];
+        pl->abs_err = sqrt(tail);
+        pl->rel_err = (total > 0.0) ? sqrt(tail / total) : 0.0;
+        pl->r = r;
+        pl->col_f = malloc((size_t) r * M * sizeof(double));
+        pl->row_f = malloc((size_t) r * M * sizeof(double));
+        for (int k = 0; k < r; k++)
+            for (int u = 0; u < M; u++) {
+                pl->col_f[IDX(k, u, M)] = S[k] * U[IDX(u, k, M)];
+                pl->row_f[IDX(k, u, M)] = V[IDX(u, k, M)];
+            }
+    }
+    free(U); free(V); free(S);
+}
+
+/* Scratch for the horizontal-pass results of tile t */
+static void conv_plan_tile(conv_plan_t *pl, const tile_t *t) {
+    if (pl->r > 0)
+        pl->tmp = alloc_doubles((size_t) pl->r * (t->lr + 2 * pl->pad) * t->lc);
+}
+
+/* Multiply-adds per output pixel of the tiled path */
+static double conv_plan_cost(const conv_plan_t *pl) {
+    return pl->r ? 2.0 * pl->r * pl->M : (double) pl->M * pl->M;
+}
+
+static void conv_plan_free(conv_plan_t *pl) {
+    free(pl->col_f);
+    free(pl->row_f);
+    free(pl->tmp);
+}
+
+/* Horizontal 1D pass of every term over tile rows [x0, x1) (may include halo rows), cols [c0, c1) */
+static void sep_row_pass(const conv_plan_t *pl, const tile_t *t, const double *in,
+                         int x0, int x1, int c0, int c1) {
+    int M = pl->M, pad = pl->pad, lc = t->lc;
+    size_t plane = (size_t) (t->lr + 2 * pad) * lc;
+    for (int k = 0; k < pl->r; k++) {
+        const double *f = &pl->row_f[IDX(k, 0, M)];
+        double *tmp = pl->tmp + k * plane;
+        for (int x = x0; x < x1; x++)
+            for (int j = c0; j < c1; j++) {
+                const double *src = &TPIX(t, in, x, j - pad);
+                double sum = 0.0;
+                for (int v = 0; v < M; v++) sum += f[v] * src[v];
+                tmp[IDX(x + pad, j, lc)] = sum;
+            }
+    }
+}
+
+/* Vertical 1D pass summed over the terms, for output rows [r0, r1) x cols [c0, c1) */
+static void sep_col_pass(const conv_plan_t *pl, const tile_t *t, double *out,
+                         int r0, int r1, int c0, int c1) {
+    int M = pl->M, pad = pl->pad, lc = t->lc;
+    size_t plane = (size_t) (t->lr + 2 * pad) * lc;
+    for (int i = r0; i < r1; i++)
+        for (int j = c0; j < c1; j++) {
+            double sum = 0.0;
+            for (int k = 0; k < pl->r; k++) {
+                const double *f = &pl->col_f[IDX(k, 0, M)];
+                const double *tmp = pl->tmp + k * plane + IDX(i, j, lc);
+                for (int u = 0; u < M; u++) sum += f[u] * tmp[(size_t) u * lc];
+            }
+            out[IDX(i, j, lc)] = sum;
+        }
+}
+
+/* Everything that can be computed before the halo arrives */
+static void conv_interior(const conv_plan_t *pl, const tile_t *t, const double *in, double *out) {
+    int inner[4], frame[4][4];
+    tile_split(t, pl->pad, inner, frame);
+    if (pl->r == 0) {
+        pl->rows(t, in, out, t->lc, 0, pl->kernel, pl->M, inner[0], inner[1], inner[2], inner[3]);
+        return;
+    }
+    /* horizontal pass of own rows away from the W/E halo, then the vertical
+       pass of the interior block, which only reads own rows */
+    sep_row_pass(pl, t, in, 0, t->lr, inner[2], inner[3]);
+    sep_col_pass(pl, t, out, inner[0], inner[1], inner[2], inner[3]);
+}
+
+/* The rest, once the halo is in */
+static void conv_finish(const conv_plan_t *pl, const tile_t *t, const double *in, double *out) {
+    int inner[4], frame[4][4];
+    int nf = tile_split(t, pl->pad, inner, frame);
+    if (pl->r == 0) {
+        for (int f = 0; f < nf; f++)
+            pl->rows(t, in, out, t->lc, 0, pl->kernel, pl->M, frame[f][0], frame[f][1], frame[f][2], frame[f][3]);
+        return;
+    }
+    int pad = pl->pad, lr = t->lr, lc = t->lc;
+    if (inner[3] > inner[2]) {
+        sep_row_pass(pl, t, in, 0, lr, 0, inner[2]);
+        sep_row_pass(pl, t, in, 0, lr, inner[3], lc);
+    } else {
+        sep_row_pass(pl, t, in, 0, lr, 0, lc);
+    }
+    sep_row_pass(pl, t, in, -pad, 0, 0, lc);
+    sep_row_pass(pl, t, in, lr, lr + pad, 0, lc);
+    for (int f = 0; f < nf; f++)
+        sep_col_pass(pl, t, out, frame[f][0], frame[f][1], frame[f][2], frame[f][3]);
+}
+
+/* Named test kernels; "random" keeps the original rand() % 10 entries */
+static int make_kernel(const char *type, double *k, int M) {
+    if (strcmp(type, "box") == 0) {
+        for (int i = 0; i < M * M; i++) k[i] = 1.0 / (M * M);
+    } else if (strcmp(type, "gauss") == 0) {
+        double sigma = (M > 1) ? M / 6.0 : 1.0, sum = 0.0;
+        for (int u = 0; u < M; u++)
+            for (int v = 0; v < M; v++) {
+                double x = u - M / 2, y = v - M / 2;
+                k[IDX(u, v, M)] = exp(-(x * x + y * y) / (2 * sigma * sigma));
+                sum += k[IDX(u, v, M)];
+            }
+        for (int i = 0; i < M * M; i++) k[i] /= sum;
+    } else if (strcmp(type, "sobel") == 0) {
+        /* binomial smoothing (rows) x binomial difference (cols): [1 2 1]^T [-1 0 1] for M = 3 */
+        double *s = malloc((M + 1) * sizeof(double)), *b = malloc((M + 1) * sizeof(double));
+        for (int i = 0; i <= M; i++) s[i] = b[i] = 0.0;
+        s[0] = 1.0;
+        for (int n = 1; n < M; n++)
+            for (int i = n; i > 0; i--) s[i] += s[i - 1];
+        b[0] = 1.0;
+        for (int n = 1; n < M - 1; n++)
+            for (int i = n; i > 0; i--) b[i] += b[i - 1];
+        for (int u = 0; u < M; u++)
+            for (int v = 0; v < M; v++)
+                k[IDX(u, v, M)] = s[u] * ((v > 0 ? b[v - 1] : 0.0) - (v < M - 1 ? b[v] : 0.0));
+        free(s); free(b);
+    } else if (strcmp(type, "random") == 0) {
+        random_matrix(k, M, M);
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * box, gauss and sobel are rank 1 by construction: the exact-rank search must
+ * find r = 1 for them at every fixed-size M, whatever the rounding of the
+ * build (-march=native contracts the SVD into FMAs). Returns the misses.
+ */
+static int check_named_plans(void) {
+    static const char *names[] = { "box", "gauss", "sobel" };
+    double k[9 * 9];
+    int bad = 0;
+    for (int n = 0; n < 3; n++)
+        for (int M = 3; M <= 9; M++) {
+            conv_plan_t pl;
+            make_kernel(names[n], k, M);
+            conv_plan_init(&pl, k, M, -1, 0.0, 0);
+            if (pl.r != 1) {
+                printf("Plan check: kernel '%s' M = %d got %d separable term(s), expected 1\n", names[n], M, pl.r);
+                bad++;
+            }
+            conv_plan_free(&pl);
+        }
+    return bad;
+}
+
+/* Subarray of an (rows x cols) array: the sub_r x sub_c block at (r0, c0) */
+static MPI_Datatype subarray(int rows, int cols, int sub_r, int sub_c, int r0, int c0) {
+    MPI_Datatype t;
+    int sizes[2] = { rows, cols }, subs[2] = { sub_r, sub_c }, starts[2] = { r0, c0 };
+    MPI_Type_create_subarray(2, sizes, subs, starts, MPI_ORDER_C, MPI_DOUBLE, &t);
+    MPI_Type_commit(&t);
+    return t;
+}
+
+/* Sequential zero-padded reference on rank 0 */
+static void conv_reference(const double *image, double *ref, const double *kernel, int N, int M,
+                           boundary_t bnd) {
     int pad = M / 2;
+    for (int i = 0; i < N; i++)
+        for (int j = 0; j < N; j++) {
+            double sum = 0.0;
+            for (int u = 0; u < M; u++)
+                for (int v = 0; v < M; v++) {
+                    int x = boundary_map(i + u - pad, N, bnd), y = boundary_map(j + v - pad, N, bnd);
+                    if (x >= 0 && y >= 0)
+                        sum += image[IDX(x, y, N)] * kernel[IDX(u, v, M)];
+                }
+            ref[IDX(i, j, N)] = sum;
+        }
+}
 
-    double *image = NULL;
-    double *kernel = malloc(M * M * sizeof(double));
+/* ---- tile input / output ---- */
 
-    // Initialize kernel
+/* Where the image comes from and where the result goes */
+typedef struct {
+    const double *image;    /* rank 0: full image, scattered unless in_path */
+    const char *in_path;    /* read every tile (and its halo) with MPI-IO */
+    img_info_t in_info;
+    const char *out_path;   /* write every tile's result with MPI-IO */
+    img_info_t out_info;
+    int gather;             /* gather the result into output on rank 0 */
+    double *output;
+} conv_io_t;
+
+/*
+ * Fill the interior of buf from the image. With an input file every rank
+ * reads its tile plus whatever of the H-wide halo lies inside the image,
+ * so no exchange is needed afterwards; returns 1 in that case, 0 when the
+ * tile was scattered from rank 0 and the halo still has to be exchanged.
+ */
+static int tile_load(const tile_t *t, double *buf, const conv_io_t *io, int N,
+                     const int dims[2], MPI_Comm cart) {
+    int rank, size;
+    MPI_Comm_rank(cart, &rank);
+    MPI_Comm_size(cart, &size);
+
+    if (io->in_path) {
+        int H = t->H;
+        int r0 = t->gr0 - H > 0 ? t->gr0 - H : 0, r1 = t->gr0 + t->lr + H < N ? t->gr0 + t->lr + H : N;
+        int c0 = t->gc0 - H > 0 ? t->gc0 - H : 0, c1 = t->gc0 + t->lc + H < N ? t->gc0 + t->lc + H : N;
+        if (img_read(cart, io->in_path, &io->in_info, r0, c0, r1 - r0, c1 - c0,
+                     &TPIX(t, buf, r0 - t->gr0, c0 - t->gc0), t->ld) != 0)
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        return 1;
+    }
+
+    MPI_Datatype interior;
+    MPI_Type_vector(t->lr, t->lc, t->ld, MPI_DOUBLE, &interior);
+    MPI_Type_commit(&interior);
+    MPI_Request rreq;
+    MPI_Irecv(&TPIX(t, buf, 0, 0), 1, interior, 0, 0, cart, &rreq);
+    if (rank == 0) {
+        for (int p = 0; p < size; p++) {
+            int pc[2], r0, c0, nr, ncol;
+            MPI_Cart_coords(cart, p, 2, pc);
+            block_range(N, dims[0], pc[0], &r0, &nr);
+            block_range(N, dims[1], pc[1], &c0, &ncol);
+            MPI_Datatype part = subarray(N, N, nr, ncol, r0, c0);
+            MPI_Send(io->image, 1, part, p, 0, cart);
+            MPI_Type_free(&part);
+        }
+    }
+    MPI_Wait(&rreq, MPI_STATUS_IGNORE);
+    MPI_Type_free(&interior);
+    return 0;
+}
+
+/*
+ * Write and/or gather the tile result: pixel (i, j) at out[(i + oh) * ldo + j + oh].
+ * Returns the time spent writing the file.
+ */
+static double tile_store(const tile_t *t, const double *out, size_t ldo, int oh,
+                         const conv_io_t *io, int N, const int dims[2], MPI_Comm cart) {
+    int rank, size;
+    MPI_Comm_rank(cart, &rank);
+    MPI_Comm_size(cart, &size);
+    const double *first = out + (size_t) oh * ldo + oh;
+    double tw = 0.0;
+
+    if (io->out_path) {
+        tw = MPI_Wtime();
+        if (img_write(cart, io->out_path, &io->out_info, t->gr0, t->gc0, t->lr, t->lc, first, ldo) != 0)
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        tw = MPI_Wtime() - tw;
+    }
+    if (!io->gather) return tw;
+
+    MPI_Datatype block;
+    MPI_Type_vector(t->lr, t->lc, (int) ldo, MPI_DOUBLE, &block);
+    MPI_Type_commit(&block);
+    MPI_Request sreq;
+    MPI_Isend(first, 1, block, 0, 1, cart, &sreq);
     if (rank == 0) {
-        image = malloc(N * N * sizeof(double));
-        random_matrix(image, N, N);
-        random_matrix(kernel, M, M);
+        for (int p = 0; p < size; p++) {
+            int pc[2], r0, c0, nr, ncol;
+            MPI_Cart_coords(cart, p, 2, pc);
+            block_range(N, dims[0], pc[0], &r0, &nr);
+            block_range(N, dims[1], pc[1], &c0, &ncol);
+            MPI_Datatype part = subarray(N, N, nr, ncol, r0, c0);
+            MPI_Recv(io->output, 1, part, p, 1, cart, MPI_STATUS_IGNORE);
+            MPI_Type_free(&part);
+        }
     }
+    MPI_Wait(&sreq, MPI_STATUS_IGNORE);
+    MPI_Type_free(&block);
+    return tw;
+}
 
-    // Broadcast kernel to all processes
-    MPI_Bcast(kernel, M * M, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+/* ---- FFT convolution ---- */
 
-    // Determine local rows (with overlap)
-    int base = N / size;
-    int rem = N % size;
-    int start_row = rank * base + (rank < rem ? rank : rem);
-    int local_rows = base + (rank < rem ? 1 : 0);
+/*
+ * Slab-distributed L x L complex array: each of the P ranks owns b = L / P
+ * consecutive rows. slab_transpose() leaves rank r with rows [r b, r b + b)
+ * of the transpose: every rank packs its b x b blocks transposed, and
+ * MPI_Alltoall drops block q straight into columns [q b, q b + b) through a
+ * strided receive type.
+ */
+typedef struct {
+    int L, b, P, rank;
+    fft_plan_t plan;
+    fft_cpx *a, *work;
+    MPI_Datatype sendblk, recvblk;
+    MPI_Comm comm;
+} slab_t;
+
+static int slab_init(slab_t *s, int L, MPI_Comm comm) {
+    MPI_Comm_size(comm, &s->P);
+    MPI_Comm_rank(comm, &s->rank);
+    s->L = L;
+    s->b = L / s->P;
+    s->comm = comm;
+    if (fft_plan_init(&s->plan, L) != 0) return -1;
+    s->a = fft_alloc((size_t) s->b * L);
+    s->work = fft_alloc((size_t) s->b * L);
+    if (!s->a || !s->work) return -1;
+
+    MPI_Datatype row, vec;
+    MPI_Type_contiguous(s->b, MPI_C_DOUBLE_COMPLEX, &row);
+    MPI_Type_contiguous(s->b, row, &s->sendblk);
+    MPI_Type_commit(&s->sendblk);
+    MPI_Type_free(&row);
+    MPI_Type_vector(s->b, s->b, L, MPI_C_DOUBLE_COMPLEX, &vec);
+    MPI_Type_create_resized(vec, 0, (MPI_Aint) s->b * sizeof(fft_cpx), &s->recvblk);
+    MPI_Type_commit(&s->recvblk);
+    MPI_Type_free(&vec);
+    return 0;
+}
 
-    // Add padding rows (halo)
-    int local_rows_with_halo = local_rows + 2 * pad;
-    double *local_image = malloc(local_rows_with_halo * N * sizeof(double));
-    double *local_output = malloc(local_rows * N * sizeof(double));
+static void slab_free(slab_t *s) {
+    fft_plan_free(&s->plan);
+    free(s->a);
+    free(s->work);
+    MPI_Type_free(&s->sendblk);
+    MPI_Type_free(&s->recvblk);
+}
+
+/* 1D transform of every local row */
+static void slab_fft_rows(slab_t *s, int sign) {
+    for (int i = 0; i < s->b; i++)
+        fft_exec(&s->plan, s->a + (size_t) i * s->L, s->work + (size_t) i * s->L, sign);
+    fft_cpx *tmp = s->a; s->a = s->work; s->work = tmp;
+}
+
+static void slab_transpose(slab_t *s) {
+    int L = s->L, b = s->b;
+    for (int q = 0; q < s->P; q++)
+        for (int i = 0; i < b; i++)
+            for (int j = 0; j < b; j++)
+                s->work[IDX(q, 0, (size_t) b * b) + IDX(j, i, b)] = s->a[IDX(i, (size_t) q * b + j, L)];
+    MPI_Alltoall(s->work, 1, s->sendblk, s->a, 1, s->recvblk, s->comm);
+}
 
-    // Send counts and displacements for scatterv
-    int *sendcounts = NULL, *displs = NULL;
+/*
+ * Spectrum of the kernel zero padded to L x L, in the transposed slab layout
+ * (local row j is frequency column r b + j). Placing k[u][v] at
+ * ((pad - u) mod L, (pad - v) mod L) makes the circular convolution equal to
+ * the correlation computed by the direct kernels. Only M rows are non-zero, so each
+ * rank builds its own columns without communication.
+ */
+static void fft_kernel_spectrum(const slab_t *s, const double *kernel, int M, fft_cpx *khat) {
+    int L = s->L, b = s->b, pad = M / 2;
+    size_t c0 = (size_t) s->rank * b;
+    fft_cpx *rows = fft_alloc((size_t) M * b);
+    fft_cpx *in = fft_alloc(L), *out = fft_alloc(L);
+    for (int u = 0; u < M; u++) {
+        memset(in, 0, L * sizeof(fft_cpx));
+        for (int v = 0; v < M; v++) in[(pad - v + L) % L] = kernel[IDX(u, v, M)];
+        fft_exec(&s->plan, in, out, -1);
+        memcpy(rows + IDX(u, 0, b), out + c0, b * sizeof(fft_cpx));
+    }
+    for (int j = 0; j < b; j++) {
+        memset(in, 0, L * sizeof(fft_cpx));
+        for (int u = 0; u < M; u++) in[(pad - u + L) % L] = rows[IDX(u, j, b)];
+        fft_exec(&s->plan, in, khat + IDX(j, 0, L), -1);
+    }
+    free(in);
+    free(out);
+    free(rows);
+}
+
+/* Transform size: the linear convolution must not wrap, and L % P == 0 */
+static int fft_size(int N, int M, int P) {
+    int need = N + M / 2;
+    if (need < M) need = M;
+    return (int) fft_good_size(need, P);
+}
+
+/*
+ * Flop estimates for the automatic choice. The tiled path does 2 flops per
+ * multiply-add. The FFT path does two full L x L complex transforms
+ * (5 L^2 log2 L^2 flops each), about one more for the kernel spectrum and a
+ * 6 L^2 pointwise product; each of the two all-to-alls is charged
+ * FFT_XPOSE_FLOPS per complex element that leaves the rank. FFT flops run at
+ * roughly half the rate of the contiguous direct loops (strided butterflies,
+ * complex arithmetic), so they are weighted by FFT_FLOP_COST; with that the
+ * crossover for N = 1024 on one rank is measured near M = 21.
+ */
+#define FFT_XPOSE_FLOPS 8.0
+#define FFT_FLOP_COST 2.0
+
+static double direct_flops(int N, double madds_per_pixel) {
+    return 2.0 * madds_per_pixel * N * N;
+}
+
+static double fft_flops(int N, int M, int P) {
+    double L = fft_size(N, M, P), L2 = L * L;
+    return FFT_FLOP_COST * (3.0 * 5.0 * L2 * log2(L2) + 6.0 * L2) + 2.0 * FFT_XPOSE_FLOPS * L2 * (P - 1) / P;
+}
+
+/*
+ * FFT path: image rows are scattered to slabs (rows and columns past N are
+ * the zero padding), transformed along rows, transposed, transformed along
+ * the other axis, multiplied by the kernel spectrum and taken back the same
+ * way. Rank 0 gathers the N x N result into output. Returns -1 if L has a
+ * prime factor the FFT cannot handle.
+ */
+static int conv_fft(const conv_io_t *io, const double *kernel,
+                    int N, int M, ptimer_t *pt, MPI_Comm comm) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    slab_t s;
+    int L = fft_size(N, M, size);
+    if (slab_init(&s, L, comm) != 0) {
+        if (rank == 0) fprintf(stderr, "cannot plan an FFT of size %d\n", L);
+        return -1;
+    }
+    int b = s.b;
+    fft_cpx *khat = fft_alloc((size_t) b * L);
+
+    // Image rows [p b, p b + b) that lie inside the image go to rank p
+    int *counts = malloc(size * sizeof(int)), *displs = malloc(size * sizeof(int));
+    for (int p = 0; p < size; p++) {
+        int r0 = p * b, r1 = (p + 1) * b < N ? (p + 1) * b : N;
+        counts[p] = r1 > r0 ? r1 - r0 : 0;
+        displs[p] = r0 < N ? r0 : 0;
+    }
+    int nrows = counts[rank];
+    MPI_Datatype rowtype;
+    MPI_Type_contiguous(N, MPI_DOUBLE, &rowtype);
+    MPI_Type_commit(&rowtype);
+    double *rows = alloc_doubles((size_t) b * N);
+    ptimer_phase(pt, PT_DISTRIBUTE);
+    if (io->in_path) {
+        if (img_read(comm, io->in_path, &io->in_info, rank * b, 0, nrows, N, rows, N) != 0)
+            MPI_Abort(MPI_COMM_WORLD, 1);
+    } else {
+        MPI_Scatterv(io->image, counts, displs, rowtype, rows, nrows, rowtype, 0, comm);
+    }
+
+    MPI_Barrier(comm);
+    ptimer_phase(pt, PT_COMPUTE);
+    double t0 = MPI_Wtime(), xpose = 0.0, tx;
+
+    fft_kernel_spectrum(&s, kernel, M, khat);
+
+    memset(s.a, 0, (size_t) b * L * sizeof(fft_cpx));
+    for (int i = 0; i < nrows; i++)
+        for (int j = 0; j < N; j++)
+            s.a[IDX(i, j, L)] = rows[IDX(i, j, N)];
+
+    slab_fft_rows(&s, -1);
+    tx = MPI_Wtime();
+    slab_transpose(&s);
+    xpose += MPI_Wtime() - tx;
+    slab_fft_rows(&s, -1);
+
+    size_t n = (size_t) b * L;
+    for (size_t k = 0; k < n; k++) s.a[k] *= khat[k];
+
+    slab_fft_rows(&s, 1);
+    tx = MPI_Wtime();
+    slab_transpose(&s);
+    xpose += MPI_Wtime() - tx;
+    slab_fft_rows(&s, 1);
+
+    double scale = 1.0 / ((double) L * L);
+    for (int i = 0; i < nrows; i++)
+        for (int j = 0; j < N; j++)
+            rows[IDX(i, j, N)] = creal(s.a[IDX(i, j, L)]) * scale;
+
+    double local_time = MPI_Wtime() - t0;
+    ptimer_phase(pt, PT_COLLECT);
+
+    if (io->out_path &&
+        img_write(comm, io->out_path, &io->out_info, rank * b, 0, nrows, N, rows, N) != 0)
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    if (io->gather)
+        MPI_Gatherv(rows, nrows, rowtype, io->output, counts, displs, rowtype, 0, comm);
+    ptimer_stop(pt);
+
+    double max_time, max_xpose;
+    MPI_Reduce(&local_time, &max_time, 1, MPI_DOUBLE, MPI_MAX, 0, comm);
+    MPI_Reduce(&xpose, &max_xpose, 1, MPI_DOUBLE, MPI_MAX, 0, comm);
     if (rank == 0) {
-        sendcounts = malloc(size * sizeof(int));
-        displs = malloc(size * sizeof(int));
+        printf("Image Size: %dx%d, Kernel: %dx%d, Processes: %d (FFT %dx%d, %d rows per slab)\n",
+               N, N, M, M, size, L, L, b);
+        printf("Max compute time: %.6f sec (transposes included)\n", max_time);
+        printf("Max transpose time: %.6f sec (2 x MPI_Alltoall)\n", max_xpose);
+        printf("Transpose volume: %.0f complex per rank\n", 2.0 * b * L * (size - 1) / size);
+    }
 
-        int offset = 0;
-        for (int p = 0; p < size; p++) {
-            int rows = base + (p < rem ? 1 : 0);
-            sendcounts[p] = rows * N;
-            displs[p] = offset;
-            offset += rows * N;
-        }
-    }
-
-    // Scatter image (each process gets its part)
-    MPI_Scatterv(image, sendcounts, displs, MPI_DOUBLE,
-                 &local_image[pad * N], local_rows * N, MPI_DOUBLE,
-                 0, MPI_COMM_WORLD);
-
-    // Exchange halo rows
-    MPI_Status status;
-    if (rank > 0)
-        MPI_Sendrecv(&local_image[pad * N], pad * N, MPI_DOUBLE, rank - 1, 0,
-                     local_image, pad * N, MPI_DOUBLE, rank - 1, 0,
-                     MPI_COMM_WORLD, &status);
-    if (rank < size - 1)
-        MPI_Sendrecv(&local_image[(local_rows) * N], pad * N, MPI_DOUBLE, rank + 1, 0,
-                     &local_image[(local_rows + pad) * N], pad * N, MPI_DOUBLE, rank + 1, 0,
-                     MPI_COMM_WORLD, &status);
-
-    MPI_Barrier(MPI_COMM_WORLD);
+    MPI_Type_free(&rowtype);
+    free(rows);
+    free(counts);
+    free(displs);
+    free(khat);
+    slab_free(&s);
+    return 0;
+}
+
+/* ---- tiled direct / separable path ---- */
+
+/*
+ * Tiles of a Pr x Pc grid with halos exchanged between neighbours; rank 0
+ * gathers the result into output. Returns -1 if the tiles are too thin.
+ */
+static int conv_tiles(const conv_io_t *io, conv_plan_t *plan,
+                      int N, int dims[2], int blocking, boundary_t bnd, ptimer_t *pt, MPI_Comm comm) {
+    int rank, size, M = plan->M, pad = plan->pad;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    MPI_Dims_create(size, 2, dims);
+    int periods[2] = { 0, 0 }, coords[2];
+    MPI_Comm cart;
+    MPI_Cart_create(comm, 2, dims, periods, 0, &cart);
+    MPI_Cart_coords(cart, rank, 2, coords);
+
+    tile_t t;
+    tile_init(&t, N, dims, coords, pad, cart);
+
+    // A tile must be at least pad wide so halos come from direct neighbours;
+    // reflecting needs pad + 1 rows/cols to mirror from
+    int min_edge = (bnd == BND_REFLECT) ? pad + 1 : pad;
+    int too_thin = (t.lr < min_edge || t.lc < min_edge), any_thin;
+    MPI_Allreduce(&too_thin, &any_thin, 1, MPI_INT, MPI_LOR, cart);
+    if (any_thin) {
+        if (rank == 0) fprintf(stderr, "tiles of a %dx%d grid are thinner than the halo (%d)\n", dims[0], dims[1], pad);
+        tile_free(&t);
+        MPI_Comm_free(&cart);
+        return -1;
+    }
+
+    // Local tile with halo (zero outside the image) and local output
+    size_t tile_elems = (size_t) (t.lr + 2 * pad) * t.ld;
+    double *local_image = alloc_doubles(tile_elems);
+    double *local_output = alloc_doubles((size_t) t.lr * t.lc);
+    if (!local_image || !local_output) { fprintf(stderr, "alloc local buffers failed\n"); MPI_Abort(comm, 1); }
+    memset(local_image, 0, tile_elems * sizeof(double));
+
+    ptimer_phase(pt, PT_DISTRIBUTE);
+    int have_halo = tile_load(&t, local_image, io, N, dims, cart);
+
+    ptimer_phase(pt, PT_INIT);
+    conv_plan_tile(plan, &t);
+
+    MPI_Barrier(cart);
+    ptimer_phase(pt, PT_COMPUTE);
     double t0 = MPI_Wtime();
+    double exposed;
+    MPI_Request req[2 * NDIRS];
 
-    // Perform convolution on local rows
-    for (int i = pad; i < local_rows + pad; i++) {
-        for (int j = pad; j < N - pad; j++) {
-            double sum = 0.0;
-            for (int u = 0; u < M; u++) {
+    if (have_halo) {
+        // Halos came from the file with the tile
+        exposed = 0.0;
+        halo_fill_boundary(&t, local_image, bnd);
+
+        conv_interior(plan, &t, local_image, local_output);
+        conv_finish(plan, &t, local_image, local_output);
+    } else if (blocking) {
+        // Exchange all halos, then convolve the whole tile
+        halo_start(&t, local_image, cart, req);
+        MPI_Waitall(2 * NDIRS, req, MPI_STATUSES_IGNORE);
+        exposed = MPI_Wtime() - t0;
+        halo_fill_boundary(&t, local_image, bnd);
+
+        conv_interior(plan, &t, local_image, local_output);
+        conv_finish(plan, &t, local_image, local_output);
+    } else {
+        // Post the halo exchange, convolve the interior that only needs local
+        // data while it is in flight, then finish the frame next to the halo
+        halo_start(&t, local_image, cart, req);
+
+        conv_interior(plan, &t, local_image, local_output);
+
+        double tw = MPI_Wtime();
+        MPI_Waitall(2 * NDIRS, req, MPI_STATUSES_IGNORE);
+        exposed = MPI_Wtime() - tw;
+        halo_fill_boundary(&t, local_image, bnd);
+
+        conv_finish(plan, &t, local_image, local_output);
+    }
+
+    double local_time = MPI_Wtime() - t0;
+
+    ptimer_phase(pt, PT_COLLECT);
+    double write_time = tile_store(&t, local_output, t.lc, 0, io, N, dims, cart);
+    ptimer_stop(pt);
+
+    // Halo volume actually received: row strips, column strips and corners
+    double halo = 0.0;
+    for (int d = 0; d < NDIRS && !have_halo; d++) {
+        if (t.nbr[d] == MPI_PROC_NULL) continue;
+        halo += (dir_drow[d] == 0) ? (double) t.lr * pad
+              : (dir_dcol[d] == 0) ? (double) t.lc * pad : (double) pad * pad;
+    }
+    double max_time, max_exposed, max_halo, max_write;
+    MPI_Reduce(&local_time, &max_time, 1, MPI_DOUBLE, MPI_MAX, 0, comm);
+    MPI_Reduce(&exposed, &max_exposed, 1, MPI_DOUBLE, MPI_MAX, 0, comm);
+    MPI_Reduce(&halo, &max_halo, 1, MPI_DOUBLE, MPI_MAX, 0, comm);
+    MPI_Reduce(&write_time, &max_write, 1, MPI_DOUBLE, MPI_MAX, 0, comm);
+
+    if (rank == 0) {
+        printf("Image Size: %dx%d, Kernel: %dx%d, Processes: %d (grid %dx%d)\n",
+               N, N, M, M, size, dims[0], dims[1]);
+        printf("Max compute time: %.6f sec (halo exchange included)\n", max_time);
+        printf("Max exposed halo time: %.6f sec (%s)\n", max_exposed,
+               have_halo ? "read from file" : blocking ? "blocking" : "overlapped Isend/Irecv");
+        printf("Max halo volume: %.0f doubles per rank\n", max_halo);
+        if (io->out_path) printf("Max write time: %.6f sec (%s)\n", max_write, io->out_path);
+    }
+
+    free(local_image);
+    free(local_output);
+    tile_free(&t);
+    MPI_Comm_free(&cart);
+    return 0;
+}
+
+/* ---- time stepping ---- */
+
+#define STEP_CACHE_BYTES (1024 * 1024)  /* working set of one temporal strip (about L2) */
+#define STEP_MIN_STRIP 8
+
+/*
+ * Separable counterpart of the direct rows for time stepping: output rows
+ * [r0, r1) x cols [c0, c1) of buffers with the tile's H-wide halo. The
+ * horizontal pass covers the pad rows above and below as well; its planes in
+ * pl->tmp are indexed from r0 - pad, so a temporal strip stays at their front.
+ */
+static void sep_step_rows(const conv_plan_t *pl, const tile_t *t, const double *in, double *out,
+                          int r0, int r1, int c0, int c1) {
+    int M = pl->M, pad = pl->pad, H = t->H, ld = t->ld;
+    size_t plane = (size_t) (t->lr + 2 * H) * ld;
+    /* 2 * CV_W adjacent pixels per iteration in two accumulators, as in CONV_ROWS_FIXED */
+    for (int k = 0; k < pl->r; k++) {
+        const double *f = &pl->row_f[IDX(k, 0, M)];
+        for (int x = r0 - pad; x < r1 + pad; x++) {
+            const double *src = &TPIX(t, in, x, -pad);
+            double *dst = pl->tmp + k * plane + IDX(x - r0 + pad, H, ld);
+            int j = c0;
+            for (; j + 2 * CV_W <= c1; j += 2 * CV_W) {
+                cv_vec a0 = cv_set1(0.0), a1 = cv_set1(0.0);
                 for (int v = 0; v < M; v++) {
-                    int x = i + u - pad;
-                    int y = j + v - pad;
-                    sum += local_image[IDX(x, y, N)] * kernel[IDX(u, v, M)];
+                    cv_vec fv = cv_set1(f[v]);
+                    a0 = cv_madd(fv, cv_load(src + j + v), a0);
+                    a1 = cv_madd(fv, cv_load(src + j + v + CV_W), a1);
                 }
+                cv_store(dst + j, a0);
+                cv_store(dst + j + CV_W, a1);
             }
-            local_output[IDX(i - pad, j, N)] = sum;
+            for (; j < c1; j++) {
+                double sum = 0.0;
+                for (int v = 0; v < M; v++) sum += f[v] * src[j + v];
+                dst[j] = sum;
+            }
+        }
+    }
+    for (int i = r0; i < r1; i++) {
+        const double *src = pl->tmp + IDX(i - r0, H, ld);
+        double *dst = &TPIX(t, out, i, 0);
+        int j = c0;
+        for (; j + 2 * CV_W <= c1; j += 2 * CV_W) {
+            cv_vec a0 = cv_set1(0.0), a1 = cv_set1(0.0);
+            for (int k = 0; k < pl->r; k++)
+                for (int u = 0; u < M; u++) {
+                    const double *s = src + k * plane + (size_t) u * ld + j;
+                    cv_vec fu = cv_set1(pl->col_f[IDX(k, u, M)]);
+                    a0 = cv_madd(fu, cv_load(s), a0);
+                    a1 = cv_madd(fu, cv_load(s + CV_W), a1);
+                }
+            cv_store(dst + j, a0);
+            cv_store(dst + j + CV_W, a1);
+        }
+        for (; j < c1; j++) {
+            double sum = 0.0;
+            for (int k = 0; k < pl->r; k++)
+                for (int u = 0; u < M; u++) sum += pl->col_f[IDX(k, u, M)] * src[k * plane + (size_t) u * ld + j];
+            dst[j] = sum;
+        }
+    }
+}
+
+/*
+ * Advance buf[0] by nk <= H / pad steps after one halo exchange, ping-ponging
+ * between buf[0] and buf[1]; returns the number of pixel updates done.
+ *
+ * Step s recomputes the tile plus the (nk - s) pad rows/cols of halo that
+ * later steps still read (clipped to the image, which stays zero outside).
+ * With strip > 0 the steps are temporally tiled: rows are swept in strips of
+ * that height and each strip is taken through all nk steps while in cache,
+ * step s lagging step s - 1 by pad rows. That lag is what makes two buffers
+ * enough: step s only overwrites step s - 2 rows that step s - 1 has already
+ * consumed.
+ */
+static double step_block(const tile_t *t, double *buf[2], const conv_plan_t *pl, int N, int nk, int strip) {
+    int pad = pl->pad;
+    int rlo[nk + 1], rhi[nk + 1], clo[nk + 1], chi[nk + 1], done[nk + 1];
+    double updates = 0.0;
+    for (int s = 1; s <= nk; s++) {
+        int ext = (nk - s) * pad;
+        rlo[s] = -ext > -t->gr0 ? -ext : -t->gr0;
+        rhi[s] = t->lr + ext < N - t->gr0 ? t->lr + ext : N - t->gr0;
+        clo[s] = -ext > -t->gc0 ? -ext : -t->gc0;
+        chi[s] = t->lc + ext < N - t->gc0 ? t->lc + ext : N - t->gc0;
+        done[s] = rlo[s];
+        updates += (double) (rhi[s] - rlo[s]) * (chi[s] - clo[s]);
+    }
+    if (strip <= 0) strip = rhi[1] - rlo[1];
+
+    for (int a = rlo[1]; done[nk] < rhi[nk]; a += strip) {
+        for (int s = 1; s <= nk; s++) {
+            int hi = a + strip - (s - 1) * pad;
+            if (hi > rhi[s]) hi = rhi[s];
+            if (hi <= done[s]) continue;
+            if (pl->r == 0)
+                pl->rows(t, buf[(s - 1) & 1], buf[s & 1], t->ld, t->H, pl->kernel, pl->M, done[s], hi, clo[s], chi[s]);
+            else
+                sep_step_rows(pl, t, buf[(s - 1) & 1], buf[s & 1], done[s], hi, clo[s], chi[s]);
+            done[s] = hi;
         }
     }
+    if (nk & 1) {
+        double *tmp = buf[0]; buf[0] = buf[1]; buf[1] = tmp;
+    }
+    return updates;
+}
+
+/*
+ * Time-stepping mode: steps applications of the kernel with the image kept
+ * distributed. Tiles carry a depth * pad halo, so neighbours exchange once
+ * every depth steps (redundantly recomputing the overlap) instead of every
+ * step. Rank 0 gathers only the final image into output.
+ */
+static int conv_steps(const conv_io_t *io, conv_plan_t *pl, int N, int dims[2], int steps, int depth, int strip,
+                      ptimer_t *pt, MPI_Comm comm) {
+    int rank, size, M = pl->M, pad = pl->pad, H = depth * pad;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    MPI_Dims_create(size, 2, dims);
+    int periods[2] = { 0, 0 }, coords[2];
+    MPI_Comm cart;
+    MPI_Cart_create(comm, 2, dims, periods, 0, &cart);
+    MPI_Cart_coords(cart, rank, 2, coords);
+
+    tile_t t;
+    tile_init(&t, N, dims, coords, H, cart);
+
+    // The deep halo must still come from direct neighbours
+    int too_thin = (t.lr < H || t.lc < H), any_thin;
+    MPI_Allreduce(&too_thin, &any_thin, 1, MPI_INT, MPI_LOR, cart);
+    if (any_thin) {
+        if (rank == 0) fprintf(stderr, "tiles of a %dx%d grid are thinner than the halo (%d = %d x %d)\n",
+                               dims[0], dims[1], H, depth, pad);
+        tile_free(&t);
+        MPI_Comm_free(&cart);
+        return -1;
+    }
+
+    // Strip height: strip rows plus the 2 H they read, in both buffers, fit the cache
+    if (strip < 0) {
+        strip = STEP_CACHE_BYTES / (2 * (int) sizeof(double) * t.ld) - 2 * H;
+        if (strip < STEP_MIN_STRIP) strip = STEP_MIN_STRIP;
+    }
+
+    size_t tile_elems = (size_t) (t.lr + 2 * H) * t.ld;
+    double *buf[2] = { alloc_doubles(tile_elems), alloc_doubles(tile_elems) };
+    if (!buf[0] || !buf[1]) { fprintf(stderr, "alloc local buffers failed\n"); MPI_Abort(MPI_COMM_WORLD, 1); }
+    memset(buf[0], 0, tile_elems * sizeof(double));
+    memset(buf[1], 0, tile_elems * sizeof(double));
+    // horizontal-pass planes of the separable terms, as tall as the haloed tile
+    if (pl->r > 0 && !(pl->tmp = alloc_doubles((size_t) pl->r * tile_elems))) {
+        fprintf(stderr, "alloc separable scratch failed\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    ptimer_phase(pt, PT_DISTRIBUTE);
+    int have_halo = tile_load(&t, buf[0], io, N, dims, cart);
+
+    MPI_Barrier(cart);
+    ptimer_phase(pt, PT_COMPUTE);
+    double t0 = MPI_Wtime(), exposed = 0.0, updates = 0.0;
+    int exchanges = 0;
+    MPI_Request req[2 * NDIRS];
+
+    for (int done = 0; done < steps; done += depth) {
+        int nk = steps - done < depth ? steps - done : depth;
+        if (done > 0 || !have_halo) {
+            double tx = MPI_Wtime();
+            halo_start(&t, buf[0], cart, req);
+            MPI_Waitall(2 * NDIRS, req, MPI_STATUSES_IGNORE);
+            exposed += MPI_Wtime() - tx;
+            exchanges++;
+        }
+        updates += step_block(&t, buf, pl, N, nk, strip);
+    }
 
     double local_time = MPI_Wtime() - t0;
 
-    // Gather results
-    double *output = NULL;
-    if (rank == 0)
-        output = malloc(N * N * sizeof(double));
+    ptimer_phase(pt, PT_COLLECT);
+    tile_store(&t, buf[0], t.ld, H, io, N, dims, cart);
+    ptimer_stop(pt);
 
-    MPI_Gatherv(local_output, local_rows * N, MPI_DOUBLE,
-                output, sendcounts, displs, MPI_DOUBLE,
-                0, MPI_COMM_WORLD);
+    double max_time, max_exposed, total_updates;
+    MPI_Reduce(&local_time, &max_time, 1, MPI_DOUBLE, MPI_MAX, 0, comm);
+    MPI_Reduce(&exposed, &max_exposed, 1, MPI_DOUBLE, MPI_MAX, 0, comm);
+    MPI_Reduce(&updates, &total_updates, 1, MPI_DOUBLE, MPI_SUM, 0, comm);
 
-    double max_time;
-    MPI_Reduce(&local_time, &max_time, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    if (rank == 0) {
+        double useful = (double) N * N * steps;
+        printf("Image Size: %dx%d, Kernel: %dx%d, Processes: %d (grid %dx%d)\n",
+               N, N, M, M, size, dims[0], dims[1]);
+        printf("Steps: %d, halo depth %d (exchange every %d steps, %d exchanges), strip %d rows\n",
+               steps, H, depth, exchanges, strip);
+        printf("Max time: %.6f sec, %.6f sec per step, %.3f Mupdates/s\n",
+               max_time, max_time / steps, useful / max_time * 1e-6);
+        printf("Max exposed exchange time: %.6f sec, redundant updates: %.1f%%\n",
+               max_exposed, 100.0 * (total_updates - useful) / useful);
+    }
 
+    free(buf[0]);
+    free(buf[1]);
+    tile_free(&t);
+    MPI_Comm_free(&cart);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int rank, size;
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    int opt, shared = 0, blocking = 0, validate = 0, force_r = -1;
+    int steps = 0, depth = 1, strip = -1, generic = 0;
+    int dims[2] = { 0, 0 };
+    boundary_t bnd = BND_ZERO;
+    double tol = 0.0;
+    const char *ktype = "random", *algo = "auto", *in_path = NULL, *out_path = NULL;
+    int gather = 1;
+    while ((opt = getopt(argc, argv, "sbvgnd:k:e:r:a:t:h:w:p:i:o:")) != -1) {
+        switch (opt) {
+        case 's': shared = 1; break;
+        case 'b': blocking = 1; break;
+        case 'v': validate = 1; break;
+        case 'k': ktype = optarg; break;
+        case 'e': tol = atof(optarg); break;
+        case 'r': force_r = atoi(optarg); break;
+        case 'a': algo = optarg; break;
+        case 't': steps = atoi(optarg); break;
+        case 'h': depth = atoi(optarg); break;
+        case 'w': strip = atoi(optarg); break;
+        case 'g': generic = 1; break;
+        case 'i': in_path = optarg; break;
+        case 'o': out_path = optarg; break;
+        case 'n': gather = 0; break;
+        case 'p':
+            if (strcmp(optarg, "zero") == 0) bnd = BND_ZERO;
+            else if (strcmp(optarg, "replicate") == 0) bnd = BND_REPLICATE;
+            else if (strcmp(optarg, "reflect") == 0) bnd = BND_REFLECT;
+            else argc = 0;
+            break;
+        case 'd':
+            if (sscanf(optarg, "%dx%d", &dims[0], &dims[1]) != 2) argc = 0;
+            break;
+        default: argc = 0; break;
+        }
+    }
+    if (strcmp(algo, "auto") != 0 && strcmp(algo, "direct") != 0 && strcmp(algo, "fft") != 0)
+        argc = 0;
+    if (steps < 0 || depth < 1)
+        argc = 0;
+
+    if (argc - optind < 2) {
+        if (rank == 0)
+            fprintf(stderr, "Usage: %s [-s] [-b] [-v] [-g] [-n] [-i in] [-o out] [-d RxC] [-p zero|replicate|reflect] [-k kernel] [-e tol] [-r R] [-a auto|direct|fft] [-t steps [-h depth] [-w strip]] <image_size N> <kernel_size M>\n", argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+
+    int N = atoi(argv[optind]);      // Image size N x N
+    int M = atoi(argv[optind + 1]);  // Kernel size M x M
+
+    // Only the single-pass tiled path fills the halo for non-zero boundaries
+    if (bnd != BND_ZERO && (steps > 0 || strcmp(algo, "fft") == 0)) {
+        if (rank == 0) fprintf(stderr, "-p %s is supported by the tiled single-pass path only\n", boundary_name[bnd]);
+        MPI_Finalize();
+        return 1;
+    }
+
+    // Stepping runs the tiled plan (direct or separable) on the distributed
+    // image; -a auto stays tiled there, an explicit fft request is an error
+    if (steps > 0 && strcmp(algo, "fft") == 0) {
+        if (rank == 0) fprintf(stderr, "-a fft cannot be combined with -t: time stepping uses the tiled plan\n");
+        MPI_Finalize();
+        return 1;
+    }
+
+    // Process grid
+    if (dims[0] * dims[1] != 0 && dims[0] * dims[1] != size) {
+        if (rank == 0) fprintf(stderr, "-d %dx%d does not match %d processes\n", dims[0], dims[1], size);
+        MPI_Finalize();
+        return 1;
+    }
+
+    ptimer_t pt;
+    ptimer_init(&pt, MPI_COMM_WORLD);
+
+    // Image source and result destination
+    conv_io_t io = { .in_path = in_path, .out_path = out_path, .gather = gather };
+    if (in_path) {
+        io.in_info.rows = io.in_info.cols = N;
+        if (img_probe(MPI_COMM_WORLD, in_path, &io.in_info) != 0) {
+            MPI_Finalize();
+            return 1;
+        }
+        if (io.in_info.rows != io.in_info.cols || (N != 0 && N != io.in_info.rows) || io.in_info.rows <= 0) {
+            if (rank == 0) fprintf(stderr, "%s: %dx%d image, need a square image of size N = %d\n",
+                                   in_path, io.in_info.cols, io.in_info.rows, N);
+            MPI_Finalize();
+            return 1;
+        }
+        N = io.in_info.rows;
+    }
+    if (out_path) {
+        io.out_info.fmt = img_format(out_path);
+        io.out_info.rows = io.out_info.cols = N;
+    }
+    if (validate && !gather) {
+        if (rank == 0) fprintf(stderr, "-v needs the gathered result, drop -n\n");
+        MPI_Finalize();
+        return 1;
+    }
+
+    double *image = NULL, *output = NULL;
+
+    // Kernel: private per rank, or one node-shared copy with -s
+    node_comms_t nc;
+    MPI_Win kernel_win = MPI_WIN_NULL;
+    double *kernel;
+    if (shared) {
+        node_comms_init(&nc, MPI_COMM_WORLD);
+        kernel = node_shared_alloc(&nc, (size_t) M * M * sizeof(double), &kernel_win);
+    } else {
+        kernel = alloc_doubles((size_t) M * M);
+    }
+
+    // Full image on rank 0: random, or read from the file when validating
+    if (rank == 0 && (!in_path || validate)) {
+        image = alloc_doubles((size_t) N * N);
+        if (!image) { fprintf(stderr, "alloc image failed\n"); MPI_Abort(MPI_COMM_WORLD, 1); }
+        if (!in_path) random_matrix(image, N, N);
+    }
+    if (in_path && validate &&
+        img_read(MPI_COMM_WORLD, in_path, &io.in_info, 0, 0, rank == 0 ? N : 0, N, image, N) != 0)
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    io.image = image;
+
+    // Initialize kernel
     if (rank == 0) {
-        printf("Image Size: %dx%d, Kernel: %dx%d, Processes: %d\n", N, N, M, M, size);
-        printf("Max compute time: %.6f sec\n", max_time);
+        if (make_kernel(ktype, kernel, M) != 0) {
+            fprintf(stderr, "unknown kernel '%s'\n", ktype);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        // Repeated application must not blow up: scale to sum |k| = 1
+        if (steps > 0) {
+            double norm = 0.0;
+            for (int i = 0; i < M * M; i++) norm += fabs(kernel[i]);
+            if (norm > 0.0)
+                for (int i = 0; i < M * M; i++) kernel[i] /= norm;
+        }
+    }
+
+    // Broadcast kernel to all processes (to node leaders with -s)
+    ptimer_phase(&pt, PT_DISTRIBUTE);
+    if (shared)
+        node_shared_bcast(&nc, kernel, M * M, MPI_DOUBLE, kernel_win);
+    else
+        MPI_Bcast(kernel, M * M, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    ptimer_phase(&pt, PT_INIT);
+
+    // Direct M x M, separable passes or FFT, whichever is estimated cheapest
+    conv_plan_t plan;
+    conv_plan_init(&plan, kernel, M, force_r, tol, generic);
+    double fd = direct_flops(N, conv_plan_cost(&plan)), ff = fft_flops(N, M, size);
+    int use_fft = strcmp(algo, "fft") == 0 || (strcmp(algo, "auto") == 0 && bnd == BND_ZERO && ff < fd);
+
+    if (rank == 0 && gather)
+        output = alloc_doubles((size_t) N * N);
+    io.output = output;
+
+    int status = (steps > 0) ? conv_steps(&io, &plan, N, dims, steps, depth, strip, &pt, MPI_COMM_WORLD)
+               : use_fft ? conv_fft(&io, kernel, N, M, &pt, MPI_COMM_WORLD)
+                         : conv_tiles(&io, &plan, N, dims, blocking, bnd, &pt, MPI_COMM_WORLD);
+    if (status != 0) {
+        MPI_Finalize();
+        return 1;
+    }
+
+    if (rank == 0) {
+        if (steps > 0 && plan.r == 0)
+            printf("Kernel '%s': normalized to sum |k| = 1, direct (%s), %d multiply-adds per pixel\n",
+                   ktype, plan.rows == conv_rows_generic ? "generic" : "fixed-size SIMD", M * M);
+        else if (steps > 0)
+            printf("Kernel '%s': normalized to sum |k| = 1, %d separable term(s), %d multiply-adds per pixel "
+                   "(direct %d), ||K-K_r||_F/||K||_F = %.3e\n", ktype, plan.r, 2 * plan.r * M, M * M, plan.rel_err);
+        else if (use_fft)
+            printf("Kernel '%s': FFT (%s), est. %.3g Gflop vs %.3g Gflop tiled\n",
+                   ktype, algo, ff * 1e-9, fd * 1e-9);
+        else if (plan.r == 0)
+            printf("Kernel '%s': direct (%s, %s boundary), %d multiply-adds per pixel, est. %.3g Gflop vs %.3g Gflop FFT\n",
+                   ktype, plan.rows == conv_rows_generic ? "generic" : "fixed-size SIMD", boundary_name[bnd],
+                   M * M, fd * 1e-9, ff * 1e-9);
+        else {
+            double max_abs = 0.0;
+            for (size_t i = 0; image && i < (size_t) N * N; i++) max_abs = fmax(max_abs, fabs(image[i]));
+            printf("Kernel '%s': %d separable term(s), %d multiply-adds per pixel (direct %d), "
+                   "||K-K_r||_F/||K||_F = %.3e, ", ktype, plan.r, 2 * plan.r * M, M * M, plan.rel_err);
+            if (image)
+                printf("truncation error <= %.3e per pixel\n", plan.abs_err * M * max_abs);
+            else
+                printf("truncation error <= %.3e * max|image| per pixel\n", plan.abs_err * M);
+        }
+    }
+
+    ptimer_report(&pt, NULL);
+
+    if (validate && rank == 0) {
+        double *ref = alloc_doubles((size_t) N * N);
+        conv_reference(image, ref, kernel, N, M, bnd);
+        if (steps > 1) {
+            double *cur = alloc_doubles((size_t) N * N);
+            for (int k = 1; k < steps; k++) {
+                memcpy(cur, ref, (size_t) N * N * sizeof(double));
+                conv_reference(cur, ref, kernel, N, M, bnd);
+            }
+            free(cur);
+        }
+        double max_diff = 0.0;
+        for (size_t i = 0; i < (size_t) N * N; i++) {
+            double diff = fabs(ref[i] - output[i]);
+            if (diff > max_diff) max_diff = diff;
+        }
+        printf("Validation max_abs_diff = %.12e\n", max_diff);
+        if (check_named_plans() == 0) printf("Plan check: box, gauss and sobel separable at M = 3..9\n");
+        free(ref);
     }
 
     if (rank == 0) {
         free(image);
         free(output);
-        free(sendcounts);
-        free(displs);
     }
-    free(kernel);
-    free(local_image);
-    free(local_output);
+    if (shared) {
+        MPI_Win_free(&kernel_win);
+        node_comms_free(&nc);
+    } else {
+        free(kernel);
+    }
+    conv_plan_free(&plan);
 
     MPI_Finalize();
     return 0;
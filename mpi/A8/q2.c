@@ -1,69 +1,90 @@
 #include <mpi.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <time.h>
 
-#define N 1000000  // Size of vectors
+#include "../../common/dvec.h"
+
+#define N 1000000  // Default size of vectors
+
+// Pseudo-random value in [0, 100) for global index i, stream `seed`.
+// Every rank generates its own slice, so nothing is scattered.
+static double gen(size_t i, void *seed) {
+    unsigned long long x = (i + 1) * 0x9E3779B97F4A7C15ULL ^ *(unsigned long long *) seed;
+    x ^= x >> 31;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 29;
+    return (double) (x >> 11) * 0x1.0p-53 * 100.0;
+}
 
 int main(int argc, char** argv) {
     int rank, size;
-    double *A = NULL, *B = NULL;
-    double local_dot = 0.0, global_dot = 0.0;
-    int i, local_n;
+    unsigned long long seed_a = 1, seed_b = 2;
+    dvec_t A, B;
 
     MPI_Init(&argc, &argv);
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
 
-    // Divide work among processes
-    local_n = N / size;
+    size_t n = argc > 1 ? strtoull(argv[1], NULL, 10) : N;
 
-    double *local_A = (double*)malloc(local_n * sizeof(double));
-    double *local_B = (double*)malloc(local_n * sizeof(double));
+    // Start timer: everything from allocation to the result on all ranks
+    MPI_Barrier(MPI_COMM_WORLD);
+    double start = MPI_Wtime();
 
-    // Master process initializes the data
-    if (rank == 0) {
-        A = (double*)malloc(N * sizeof(double));
-        B = (double*)malloc(N * sizeof(double));
-
-        srand(time(NULL));
-        for (i = 0; i < N; i++) {
-            A[i] = rand() % 100;
-            B[i] = rand() % 100;
-        }
+    // Block distribution; the first n % size ranks hold one extra element
+    if (dvec_init(&A, n, MPI_COMM_WORLD) != 0 || dvec_init(&B, n, MPI_COMM_WORLD) != 0) {
+        fprintf(stderr, "Rank %d: allocation failed\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, 1);
     }
+    dvec_fill(&A, gen, &seed_a);
+    dvec_fill(&B, gen, &seed_b);
+    double t_gen = MPI_Wtime();
 
-    // Scatter data to all processes
-    MPI_Scatter(A, local_n, MPI_DOUBLE, local_A, local_n, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-    MPI_Scatter(B, local_n, MPI_DOUBLE, local_B, local_n, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    // Local dot product + MPI_Allreduce: every rank has the result
+    double dot = dvec_dot(&A, &B);
+    double end = MPI_Wtime();
 
-    // Start timer
-    double start = MPI_Wtime();
+    // Reproducible dot: bitwise the same for any number of ranks
+    double t0 = MPI_Wtime();
+    double rdot = dvec_dot_repro(&A, &B);
+    double t_repro = MPI_Wtime() - t0;
 
-    // Compute local dot product
-    for (i = 0; i < local_n; i++)
-        local_dot += local_A[i] * local_B[i];
+    // Same update done as axpy then dot (two passes) and fused (one pass)
+    double alpha = 0.5;
+    t0 = MPI_Wtime();
+    dvec_axpy(alpha, &A, &B);
+    double rr_sep = dvec_dot(&B, &B);
+    double t_sep = MPI_Wtime() - t0;
+    dvec_fill(&B, gen, &seed_b);
 
-    // Reduce all partial results to get the global dot product
-    MPI_Reduce(&local_dot, &global_dot, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    t0 = MPI_Wtime();
+    double rr_fused = dvec_axpy_dot(alpha, &A, &B, &B);
+    double t_fused = MPI_Wtime() - t0;
 
-    // Stop timer
-    double end = MPI_Wtime();
+    double local[6] = { t_gen - start, end - t_gen, end - start, t_sep, t_fused, t_repro }, maxt[6];
+    MPI_Reduce(local, maxt, 6, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
 
     // Master prints result and execution time
     if (rank == 0) {
-        printf("Dot Product = %f\n", global_dot);
-        printf("Execution Time: %f seconds with %d processes\n", end - start, size);
-    }
+        // Serial reproducible sum over the same generator: must match bitwise
+        rsum_t acc;
+        rsum_init(&acc);
+        for (size_t i = 0; i < n; i++) rsum_add(&acc, gen(i, &seed_a) * gen(i, &seed_b));
+        double ref = rsum_value(&acc);
 
-    // Free memory
-    free(local_A);
-    free(local_B);
-    if (rank == 0) {
-        free(A);
-        free(B);
+        printf("Dot Product = %.17g (%a)\n", dot, dot);
+        printf("Reproducible Dot Product = %.17g (%a), %s serial; plain differs by %.3e\n",
+               rdot, rdot, rdot == ref ? "bitwise equal to" : "MISMATCH with", fabs(dot - rdot) / fabs(rdot));
+        printf("Execution Time: %f seconds with %d processes (generate %f, dot + allreduce %f)\n",
+               maxt[2], size, maxt[0], maxt[1]);
+        printf("Reproducible dot + allreduce: %f sec (%.2fx the plain one)\n", maxt[5], maxt[5] / maxt[1]);
+        printf("axpy + dot: %f sec, fused axpy_dot: %f sec (%.2fx), y.y = %.1f / %.1f\n",
+               maxt[3], maxt[4], maxt[3] / maxt[4], rr_sep, rr_fused);
     }
 
+    dvec_free(&A);
+    dvec_free(&B);
+
     MPI_Finalize();
     return 0;
 }
@@ -0,0 +1,322 @@
+/*
+ * conv_layer_mpi.c
+ * Batched multi-channel 2D convolution (one CNN layer) using MPI
+ *
+ * Compile:
+ *   mpicc -O2 -march=native -o conv_layer_mpi conv_layer_mpi.c -lm
+ *   (add -fopenmp to also thread the GEMM inside each rank)
+ *
+ * Run Example:
+ *   mpirun -np 4 ./conv_layer_mpi -n 32 -c 16 -k 32 64 3
+ *
+ * Input X[B][C_in][N][N], weights W[C_out][C_in][M][M], output
+ * Y[B][C_out][N][N]: the "same" size correlation with zero padding of
+ * conv2d (q1.c), summed over input channels.
+ *
+ * The convolution is lowered to GEMM with im2col. For one image, the
+ * column matrix has K = C_in * M * M rows and one column per output pixel,
+ * col[(c, u, v)][(i, j)] = X[c][i + u - pad][j + v - pad], and
+ *   Y_b (C_out x N^2) = W (C_out x K) * col (K x N^2)
+ * is done by the blocked SIMD kernel in common/gemm.h. col is built one
+ * panel of whole image rows at a time (about PANEL_BYTES), so its size does
+ * not grow with N and the panel is still in cache when GEMM packs it.
+ *
+ * Distribution (-d):
+ *   batch    rank p convolves a block of images with all C_out kernels;
+ *            images are scattered, W is broadcast, results gathered per image
+ *   channel  rank p computes a block of output channels for every image;
+ *            X is broadcast, rows of W are scattered, and each rank's
+ *            channels are gathered with a strided datatype
+ * Batch needs only 1/P of X per rank and no W split; channel keeps the
+ * per-rank GEMM wide when B < P.
+ *
+ * Options:
+ *   -n B     batch size (default 16)
+ *   -c Cin   input channels (default 8)
+ *   -k Cout  output channels (default 16)
+ *   -d D     batch (default) or channel
+ *   -a A     gemm (default) or direct (plain 7-deep loops, for comparison)
+ *   -v       validate every rank's outputs against the direct loops
+ *
+ * Arguments: <image_size N> <kernel_size M>
+ */
+
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../../common/gemm.h"
+
+#define IDX(i, j, N) ((size_t)(i) * (N) + (j))
+
+#define PANEL_BYTES (1 << 20)   /* target size of one im2col panel */
+
+/* Deterministic pseudo-random value in [0, 1) for a global index */
+static double drand(size_t seed) {
+    unsigned int x = (unsigned int) seed;
+    x = (1103515245u * x + 12345u) & 0x7fffffff;
+    return (double)(x % 1000) / 1000.0;
+}
+
+/* 64-byte aligned allocation of n doubles (cache line / AVX-512 aligned) */
+static double *alloc_doubles(size_t n) {
+    void *p = NULL;
+    if (n == 0) n = 1;
+    if (posix_memalign(&p, 64, n * sizeof(double)) != 0) return NULL;
+    return (double *) p;
+}
+
+/* Block p of n items split over P parts (first n % P parts get one extra) */
+static void block_range(int n, int P, int p, int *start, int *count) {
+    int base = n / P, rem = n % P;
+    *start = p * base + (p < rem ? p : rem);
+    *count = base + (p < rem ? 1 : 0);
+}
+
+/*
+ * im2col for output rows [i0, i0 + R) of one image x (Cin x N x N):
+ * col is K x (R N), row (c, u, v) holds the input pixel each output pixel
+ * multiplies with weight (c, u, v); zeros outside the image.
+ */
+static void im2col_rows(const double *x, int Cin, int N, int M, int i0, int R, double *col) {
+    int pad = M / 2;
+    size_t ld = (size_t) R * N;
+    for (int c = 0; c < Cin; c++)
+        for (int u = 0; u < M; u++)
+            for (int v = 0; v < M; v++) {
+                double *dst = col + IDX((c * M + u) * M + v, 0, ld);
+                int j0 = pad - v > 0 ? pad - v : 0;              /* first j with j + v - pad >= 0 */
+                int j1 = N + pad - v < N ? N + pad - v : N;      /* first j with j + v - pad >= N */
+                for (int r = 0; r < R; r++, dst += N) {
+                    int y = i0 + r + u - pad;
+                    if (y < 0 || y >= N) {
+                        memset(dst, 0, N * sizeof(double));
+                        continue;
+                    }
+                    const double *src = x + IDX(c, 0, (size_t) N * N) + IDX(y, v - pad, N);
+                    for (int j = 0; j < j0; j++) dst[j] = 0.0;
+                    memcpy(dst + j0, src + j0, (size_t) (j1 - j0) * sizeof(double));
+                    for (int j = j1; j < N; j++) dst[j] = 0.0;
+                }
+            }
+}
+
+/* y (nk x N^2) = w (nk x K) conv x, via im2col panels and GEMM */
+static void conv_gemm(const double *x, const double *w, double *y, int Cin, int nk,
+                      int N, int M, double *col, int R, double *t_im2col) {
+    size_t K = (size_t) Cin * M * M, NN = (size_t) N * N;
+    memset(y, 0, (size_t) nk * NN * sizeof(double));
+    for (int i0 = 0; i0 < N; i0 += R) {
+        int rows = N - i0 < R ? N - i0 : R;
+        double t0 = MPI_Wtime();
+        im2col_rows(x, Cin, N, M, i0, rows, col);
+        *t_im2col += MPI_Wtime() - t0;
+        gemm(nk, (size_t) rows * N, K, w, K, col, (size_t) rows * N, y + IDX(i0, 0, N), NN);
+    }
+}
+
+/* Same result with plain loops */
+static void conv_direct(const double *x, const double *w, double *y, int Cin, int nk, int N, int M) {
+    int pad = M / 2;
+    size_t NN = (size_t) N * N;
+    for (int k = 0; k < nk; k++)
+        for (int i = 0; i < N; i++)
+            for (int j = 0; j < N; j++) {
+                double sum = 0.0;
+                for (int c = 0; c < Cin; c++)
+                    for (int u = 0; u < M; u++) {
+                        int yy = i + u - pad;
+                        if (yy < 0 || yy >= N) continue;
+                        for (int v = 0; v < M; v++) {
+                            int xx = j + v - pad;
+                            if (xx < 0 || xx >= N) continue;
+                            sum += x[IDX(c, 0, NN) + IDX(yy, xx, N)] * w[IDX(k, (c * M + u) * M + v, (size_t) Cin * M * M)];
+                        }
+                    }
+                y[IDX(k, 0, NN) + IDX(i, j, N)] = sum;
+            }
+}
+
+int main(int argc, char *argv[]) {
+    int rank, size;
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    int opt, B = 16, Cin = 8, Cout = 16, by_channel = 0, direct = 0, validate = 0;
+    while ((opt = getopt(argc, argv, "n:c:k:d:a:v")) != -1) {
+        switch (opt) {
+        case 'n': B = atoi(optarg); break;
+        case 'c': Cin = atoi(optarg); break;
+        case 'k': Cout = atoi(optarg); break;
+        case 'd':
+            if (strcmp(optarg, "channel") == 0) by_channel = 1;
+            else if (strcmp(optarg, "batch") != 0) argc = 0;
+            break;
+        case 'a':
+            if (strcmp(optarg, "direct") == 0) direct = 1;
+            else if (strcmp(optarg, "gemm") != 0) argc = 0;
+            break;
+        case 'v': validate = 1; break;
+        default: argc = 0; break;
+        }
+    }
+    if (argc - optind < 2 || B < 1 || Cin < 1 || Cout < 1) {
+        if (rank == 0)
+            fprintf(stderr, "Usage: %s [-n batch] [-c C_in] [-k C_out] [-d batch|channel] [-a gemm|direct] [-v] "
+                            "<image_size N> <kernel_size M>\n", argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+    int N = atoi(argv[optind]);
+    int M = atoi(argv[optind + 1]);
+    size_t NN = (size_t) N * N, K = (size_t) Cin * M * M;
+    size_t img_in = (size_t) Cin * NN, img_out = (size_t) Cout * NN;
+
+    // This rank's images [b0, b0 + nb) and output channels [k0, k0 + nk)
+    int b0 = 0, nb = B, k0 = 0, nk = Cout;
+    if (by_channel) block_range(Cout, size, rank, &k0, &nk);
+    else block_range(B, size, rank, &b0, &nb);
+
+    // Root generates the whole layer input
+    double *X = NULL, *W = NULL, *Y = NULL;
+    if (rank == 0) {
+        X = alloc_doubles(B * img_in);
+        W = alloc_doubles(Cout * K);
+        Y = alloc_doubles(B * img_out);
+        if (!X || !W || !Y) { fprintf(stderr, "alloc layer failed\n"); MPI_Abort(MPI_COMM_WORLD, 1); }
+        for (size_t i = 0; i < B * img_in; i++) X[i] = drand(i + 1);
+        for (size_t i = 0; i < Cout * K; i++) W[i] = drand(i + 7) - 0.5;
+    }
+
+    double *x = alloc_doubles(nb * img_in);
+    double *w = alloc_doubles(nk * K);
+    double *y = alloc_doubles((size_t) nb * nk * NN);
+    if (!x || !w || !y) { fprintf(stderr, "alloc local buffers failed\n"); MPI_Abort(MPI_COMM_WORLD, 1); }
+
+    // Units: one input image, one kernel (C_in x M x M)
+    MPI_Datatype image_t, kernel_t;
+    MPI_Type_contiguous((int) img_in, MPI_DOUBLE, &image_t);
+    MPI_Type_contiguous((int) K, MPI_DOUBLE, &kernel_t);
+    MPI_Type_commit(&image_t);
+    MPI_Type_commit(&kernel_t);
+
+    int *counts = malloc(size * sizeof(int)), *displs = malloc(size * sizeof(int));
+    for (int p = 0; p < size; p++)
+        block_range(by_channel ? Cout : B, size, p, &displs[p], &counts[p]);
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    double t0 = MPI_Wtime();
+    if (by_channel) {
+        if (rank == 0) memcpy(x, X, B * img_in * sizeof(double));
+        MPI_Bcast(x, B, image_t, 0, MPI_COMM_WORLD);
+        MPI_Scatterv(W, counts, displs, kernel_t, w, nk, kernel_t, 0, MPI_COMM_WORLD);
+    } else {
+        MPI_Scatterv(X, counts, displs, image_t, x, nb, image_t, 0, MPI_COMM_WORLD);
+        if (rank == 0) memcpy(w, W, Cout * K * sizeof(double));
+        MPI_Bcast(w, Cout, kernel_t, 0, MPI_COMM_WORLD);
+    }
+    double t_dist = MPI_Wtime() - t0;
+
+    // im2col panel of R whole output rows
+    int R = (int) (PANEL_BYTES / (K * N * sizeof(double)));
+    if (R < 1) R = 1;
+    if (R > N) R = N;
+    double *col = direct ? NULL : alloc_doubles(K * R * N);
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    t0 = MPI_Wtime();
+    double t_im2col = 0.0;
+    for (int b = 0; b < nb; b++) {
+        if (direct)
+            conv_direct(x + b * img_in, w, y + (size_t) b * nk * NN, Cin, nk, N, M);
+        else
+            conv_gemm(x + b * img_in, w, y + (size_t) b * nk * NN, Cin, nk, N, M, col, R, &t_im2col);
+    }
+    double t_comp = MPI_Wtime() - t0;
+
+    // Gather Y[B][Cout][N^2]: whole images, or each rank's channel block of every image
+    t0 = MPI_Wtime();
+    if (by_channel) {
+        // in units of one output plane (N^2 doubles), so counts stay in int
+        MPI_Datatype plane_t;
+        MPI_Type_contiguous((int) NN, MPI_DOUBLE, &plane_t);
+        MPI_Type_commit(&plane_t);
+        MPI_Request sreq;
+        MPI_Isend(y, nb * nk, plane_t, 0, 0, MPI_COMM_WORLD, &sreq);
+        if (rank == 0) {
+            for (int p = 0; p < size; p++) {
+                MPI_Datatype part;
+                MPI_Type_vector(B, counts[p], Cout, plane_t, &part);
+                MPI_Type_commit(&part);
+                MPI_Recv(Y + IDX(displs[p], 0, NN), 1, part, p, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+                MPI_Type_free(&part);
+            }
+        }
+        MPI_Wait(&sreq, MPI_STATUS_IGNORE);
+        MPI_Type_free(&plane_t);
+    } else {
+        MPI_Datatype outimg_t;
+        MPI_Type_contiguous((int) img_out, MPI_DOUBLE, &outimg_t);
+        MPI_Type_commit(&outimg_t);
+        MPI_Gatherv(y, nb, outimg_t, Y, counts, displs, outimg_t, 0, MPI_COMM_WORLD);
+        MPI_Type_free(&outimg_t);
+    }
+    double t_gather = MPI_Wtime() - t0;
+
+    double local[4] = { t_dist, t_comp, t_im2col, t_gather }, maxt[4];
+    MPI_Reduce(local, maxt, 4, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        double flops = 2.0 * B * Cout * K * NN;
+        double total = maxt[0] + maxt[1] + maxt[3];
+        printf("Layer: batch %d, %dx%d images, C_in %d -> C_out %d, kernel %dx%d, Processes: %d (by %s, %s)\n",
+               B, N, N, Cin, Cout, M, M, size, by_channel ? "channel" : "batch", direct ? "direct" : "im2col+GEMM");
+        if (!direct) printf("GEMM per image: %d x %d x %zu, im2col panel %d rows\n", Cout, N * N, K, R);
+        printf("Max compute time: %.6f sec (im2col %.6f), %.2f GFLOP/s, %.1f images/sec\n",
+               maxt[1], maxt[2], flops / maxt[1] * 1e-9, B / maxt[1]);
+        printf("Distribute %.6f sec, gather %.6f sec, end to end %.1f images/sec\n",
+               maxt[0], maxt[3], B / total);
+    }
+
+    if (validate) {
+        double *ref = alloc_doubles(nk * NN), diff = 0.0, max_diff;
+        for (int b = 0; b < nb; b++) {
+            conv_direct(x + b * img_in, w, ref, Cin, nk, N, M);
+            for (size_t i = 0; i < nk * NN; i++)
+                diff = fmax(diff, fabs(ref[i] - y[(size_t) b * nk * NN + i]));
+        }
+        // Rank 0 also checks the gathered layout for one image and channel
+        if (rank == 0) {
+            int bb = B - 1, kk = Cout - 1;
+            double *one = alloc_doubles(NN);
+            conv_direct(X + bb * img_in, W + kk * K, one, Cin, 1, N, M);
+            for (size_t i = 0; i < NN; i++)
+                diff = fmax(diff, fabs(one[i] - Y[(size_t) bb * img_out + kk * NN + i]));
+            free(one);
+        }
+        MPI_Reduce(&diff, &max_diff, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+        if (rank == 0) printf("Validation max_abs_diff = %.12e\n", max_diff);
+        free(ref);
+    }
+
+    if (rank == 0) {
+        free(X);
+        free(W);
+        free(Y);
+    }
+    free(x);
+    free(w);
+    free(y);
+    free(col);
+    free(counts);
+    free(displs);
+    MPI_Type_free(&image_t);
+    MPI_Type_free(&kernel_t);
+
+    MPI_Finalize();
+    return 0;
+}
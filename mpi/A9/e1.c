@@ -1,89 +1,445 @@
 // nqueens_parallel.cpp
 // Compile: g++ -std=c++17 -O2 nqueens_parallel.cpp -pthread -o nqueens
-// Usage: ./nqueens N num_threads
+//     MPI: mpicxx -std=c++17 -O2 -DUSE_MPI nqueens_parallel.cpp -pthread -o nqueens_mpi
+// Usage: ./nqueens N num_threads [depth]
+//        ./nqueens -f N num_threads [seed]
+//        mpirun -np P ./nqueens_mpi [-f] N threads_per_rank [depth | seed]
+//
+// Counts all solutions with a bitmask backtracker: the occupied columns and
+// the two diagonal directions of the rows placed so far are three masks, the
+// free squares of the next row are ~(cols | ld | rd), and they are visited
+// lowest bit first, so the recursion touches no memory beyond its frame.
+// Mirror symmetry halves the work: the first queen only goes into the left
+// half (and for odd N the middle column with the second queen in the left
+// half), and the count is doubled.
+//
+// The tree is pre-split into the partial boards of the first `depth` rows
+// (default 4); threads take them from a shared atomic index, so the uneven
+// subtrees spread over the threads.
+//
+// With -DUSE_MPI every rank builds the same task list and the index is a
+// counter in an RMA window on rank 0, advanced with MPI_Fetch_and_op under
+// a passive-target lock_all: ranks take tasks at their own pace without a
+// master loop answering requests. Threads of a rank take turns at the
+// counter (MPI_THREAD_SERIALIZED; one thread if the library cannot), the
+// counts meet in an MPI_Reduce, and rank 0 prints a table of tasks,
+// Fetch_and_op grabs (tasks + one final miss per thread) and busy time per
+// rank with a histogram bar.
+//
+// -f finds one placement instead, for N far beyond counting (10^6 and up),
+// by min-conflicts local search in the form of Sosic and Gu: the queens are
+// a permutation (row r in column q[r]), so only diagonals can clash, with
+// the queens per diagonal in two flat counter arrays. A greedy start puts
+// each row on a random free column, giving up on clash-free after a few
+// tries; the repair then swaps the columns of an attacked row and a random
+// row whenever that lowers their attacks. Every thread (and rank) runs
+// independent restarts with its own seed; the first clash-free board wins,
+// through an atomic flag (and with MPI a fetch-and-add claim on rank 0), and
+// is checked from scratch.
 #include <bits/stdc++.h>
 #include <thread>
 #include <atomic>
+#include <mutex>
+#ifdef USE_MPI
+#include <mpi.h>
+#endif
 using namespace std;
 
+typedef uint32_t mask_t;                 // one bit per column, N <= 32
+
+struct Task {
+    mask_t cols, ld, rd;                 // state after the prefix rows
+};
+
+// OEIS A000170, to check the counts
+static const long long known[] = {
+    1, 1, 0, 0, 2, 10, 4, 40, 92, 352, 724, 2680, 14200, 73712, 365596, 2279184,
+    14772512, 95815104, 666090624, 4968057848LL, 39029188884LL, 314666222712LL,
+    2691008701644LL, 24233937684440LL, 227514171973736LL, 2207893435808352LL,
+    22317699616364044LL, 234907967154122528LL
+};
+
 int N;
+mask_t full;
 atomic<long long> total_solutions{0};
 
-bool safe(const vector<int>& cols, int row, int c) {
-    for (int r = 0; r < row; ++r) {
-        int cc = cols[r];
-        if (cc == c) return false;
-        if (abs(cc - c) == abs(r - row)) return false;
+// What one rank did, for the load-balance table
+struct Load {
+    long long tasks = 0, grabs = 0, solutions = 0;
+    double busy = 0.0;                   // summed over threads
+};
+
+// Solutions below a partial board: lowbit iteration over the free columns
+static long long count_from(mask_t cols, mask_t ld, mask_t rd) {
+    if (cols == full) return 1;
+    long long n = 0;
+    mask_t avail = full & ~(cols | ld | rd);
+    while (avail) {
+        mask_t bit = avail & -avail;
+        avail ^= bit;
+        n += count_from(cols | bit, (ld | bit) << 1, (rd | bit) >> 1);
     }
-    return true;
+    return n;
 }
 
-void solve_from_prefix(vector<int> cols, int row) {
-    if (row == N) {
-        total_solutions.fetch_add(1, memory_order_relaxed);
+// Columns allowed in row 0 and row 1 under the mirror reduction
+static mask_t half_mask(int row, mask_t cols) {
+    mask_t left = (1u << (N / 2)) - 1;
+    if (row == 0) return N % 2 ? left | 1u << (N / 2) : left;
+    if (row == 1 && N % 2 && cols == 1u << (N / 2)) return left;   // middle first queen
+    return full;
+}
+
+// Partial boards of the first `depth` rows (fewer if a board fills up)
+static void split(int row, int depth, mask_t cols, mask_t ld, mask_t rd, vector<Task>& tasks) {
+    if (row == depth || cols == full) {
+        tasks.push_back({cols, ld, rd});
         return;
     }
-    for (int c = 0; c < N; ++c) {
-        if (safe(cols, row, c)) {
-            cols[row] = c;
-            solve_from_prefix(cols, row + 1);
+    mask_t avail = full & ~(cols | ld | rd) & half_mask(row, cols);
+    while (avail) {
+        mask_t bit = avail & -avail;
+        avail ^= bit;
+        split(row + 1, depth, cols | bit, (ld | bit) << 1, (rd | bit) >> 1, tasks);
+    }
+}
+
+// Count the tasks handed out by grab(first, last) with num_threads threads
+// (the calling thread is one of them); grab returns false when none are left
+template <class Grab>
+static void run_threads(const vector<Task>& tasks, int num_threads, Grab grab, Load& load) {
+    mutex load_mtx;
+    auto worker = [&](){
+        long long local = 0, done = 0;
+        auto t0 = chrono::steady_clock::now();
+        size_t first, last;
+        while (grab(first, last))
+            for (size_t i = first; i < last; ++i, ++done)
+                local += count_from(tasks[i].cols, tasks[i].ld, tasks[i].rd);
+        double busy = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+        total_solutions.fetch_add(local, memory_order_relaxed);
+        lock_guard<mutex> g(load_mtx);
+        load.tasks += done;
+        load.solutions += local;
+        load.busy += busy;
+    };
+    vector<thread> threads;
+    for (int t = 1; t < num_threads; ++t) threads.emplace_back(worker);
+    worker();
+    for (auto &th : threads) th.join();
+}
+
+// ---- first solution by min-conflicts ----
+
+struct Board {
+    int n;
+    vector<int> q;                       // column of the queen in each row, a permutation
+    vector<int> up, dn;                  // queens on diagonal r + c and on r - c + n - 1
+
+    explicit Board(int n) : n(n), q(n), up(2 * n - 1), dn(2 * n - 1) {}
+    int attacks(int r) const { return up[r + q[r]] + dn[r - q[r] + n - 1] - 2; }
+    void put(int r, int d) { up[r + q[r]] += d; dn[r - q[r] + n - 1] += d; }
+};
+
+// Random permutation built row by row, each row on a column with free
+// diagonals if one turns up within a few random picks
+static void greedy_start(Board& b, mt19937_64& rng) {
+    const int n = b.n, tries = 32;
+    iota(b.q.begin(), b.q.end(), 0);
+    fill(b.up.begin(), b.up.end(), 0);
+    fill(b.dn.begin(), b.dn.end(), 0);
+    for (int r = 0; r < n; ++r) {
+        for (int t = 0; t < tries; ++t) {
+            swap(b.q[r], b.q[r + rng() % (n - r)]);
+            if (b.up[r + b.q[r]] == 0 && b.dn[r - b.q[r] + n - 1] == 0) break;
+        }
+        b.put(r, 1);
+    }
+}
+
+// Swap the columns of rows i and j if that lowers their attacks
+static bool try_swap(Board& b, int i, int j) {
+    int before = b.attacks(i) + b.attacks(j);
+    b.put(i, -1); b.put(j, -1);
+    swap(b.q[i], b.q[j]);
+    b.put(i, 1); b.put(j, 1);
+    if (b.attacks(i) + b.attacks(j) < before) return true;
+    b.put(i, -1); b.put(j, -1);
+    swap(b.q[i], b.q[j]);
+    b.put(i, 1); b.put(j, 1);
+    return false;
+}
+
+// Repair until no row is attacked (true), or until stop() or the step limit
+template <class Stop>
+static bool repair(Board& b, mt19937_64& rng, long long max_steps, long long& steps, Stop stop) {
+    vector<int> bad;
+    for (;;) {
+        bad.clear();
+        for (int r = 0; r < b.n; ++r)
+            if (b.attacks(r)) bad.push_back(r);
+        if (bad.empty()) return true;
+        for (int i : bad) {
+            for (int t = 0; t < 64 && b.attacks(i); ++t) {
+                int j = (int)(rng() % b.n);
+                if (j != i && try_swap(b, i, j)) break;
+            }
+            if ((++steps & 1023) == 0 && (steps > max_steps || stop())) return false;
         }
     }
 }
 
-int main(int argc, char** argv) {
+// Check a placement from scratch: a permutation with one queen per diagonal
+static bool verify(const vector<int>& q) {
+    int n = (int)q.size();
+    vector<char> col(n), up(2 * n), dn(2 * n);
+    for (int r = 0; r < n; ++r) {
+        int c = q[r];
+        if (c < 0 || c >= n || col[c]++ || up[r + c]++ || dn[r - c + n]++) return false;
+    }
+    return true;
+}
+
+static int first_solution(int argc, char** argv, int rank, int nranks, bool threads_ok) {
     if (argc < 3) {
-        cerr << "Usage: " << argv[0] << " N num_threads\n";
+        if (rank == 0) cerr << "Usage: " << argv[0] << " -f N num_threads [seed]\n";
+        return 1;
+    }
+    int n = stoi(argv[1]), num_threads = max(1, stoi(argv[2]));
+    unsigned long long seed = argc > 3 ? stoull(argv[3]) : 12345;
+    if (n < 1 || n == 2 || n == 3) {
+        if (rank == 0) cerr << "no placement exists for N=" << n << "\n";
         return 1;
     }
+    if (!threads_ok) num_threads = 1;
+    (void)nranks;
+
+    auto t0 = chrono::steady_clock::now();
+    atomic<bool> found{false};
+    mutex result_mtx;
+    vector<int> result;
+    int win_thread = -1;
+    long long win_steps = 0, win_restart = 0;
+    double win_init = 0.0;
+
+#ifdef USE_MPI
+    // On rank 0: claims so far and the winning rank. The first claim (fetched
+    // count 0) wins; the count is what the others poll now and then.
+    long *winner;
+    MPI_Win win;
+    MPI_Win_allocate(rank == 0 ? 2 * sizeof(long) : 0, sizeof(long), MPI_INFO_NULL, MPI_COMM_WORLD, &winner, &win);
+    if (rank == 0) winner[0] = 0, winner[1] = -1;
+    MPI_Barrier(MPI_COMM_WORLD);
+    MPI_Win_lock_all(0, win);
+    MPI_Barrier(MPI_COMM_WORLD);
+    t0 = chrono::steady_clock::now();
+    mutex win_mtx;
+    auto stop = [&]() {
+        if (found.load(memory_order_relaxed)) return true;
+        unique_lock<mutex> g(win_mtx, try_to_lock);
+        if (!g.owns_lock()) return false;
+        long w, none = 0;
+        MPI_Fetch_and_op(&none, &w, MPI_LONG, 0, 0, MPI_NO_OP, win);
+        MPI_Win_flush(0, win);
+        if (w > 0) found = true;
+        return w > 0;
+    };
+    auto claim = [&]() {
+        long me = rank, one = 1, w;
+        lock_guard<mutex> g(win_mtx);
+        MPI_Fetch_and_op(&one, &w, MPI_LONG, 0, 0, MPI_SUM, win);
+        MPI_Win_flush(0, win);
+        if (w == 0) {
+            MPI_Accumulate(&me, 1, MPI_LONG, 0, 1, 1, MPI_LONG, MPI_REPLACE, win);
+            MPI_Win_flush(0, win);
+        }
+        return w == 0;
+    };
+#else
+    auto stop = [&]() { return found.load(memory_order_relaxed); };
+    auto claim = []() { return true; };
+#endif
+
+    auto worker = [&](int tid) {
+        mt19937_64 rng(seed ^ ((unsigned long long)rank << 40) ^ ((unsigned long long)tid << 20));
+        Board b(n);
+        for (long long restart = 0; !stop(); ++restart) {
+            auto ti = chrono::steady_clock::now();
+            greedy_start(b, rng);
+            double init = chrono::duration<double>(chrono::steady_clock::now() - ti).count();
+            long long steps = 0;
+            if (!repair(b, rng, 2LL * n + 1000, steps, stop)) continue;
+            lock_guard<mutex> g(result_mtx);
+            if (found.exchange(true) || !claim()) return;
+            result = b.q;
+            win_thread = tid;
+            win_steps = steps;
+            win_restart = restart;
+            win_init = init;
+            return;
+        }
+    };
+    vector<thread> threads;
+    for (int t = 1; t < num_threads; ++t) threads.emplace_back(worker, t);
+    worker(0);
+    for (auto &th : threads) th.join();
+    double secs = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+
+    bool ok = !result.empty() && verify(result);
+    int win_rank = rank;
+#ifdef USE_MPI
+    MPI_Win_unlock_all(win);
+    MPI_Barrier(MPI_COMM_WORLD);          // every claim has landed
+    long w = rank == 0 ? winner[1] : -1;
+    MPI_Bcast(&w, 1, MPI_LONG, 0, MPI_COMM_WORLD);
+    MPI_Win_free(&win);
+    win_rank = (int)w;
+    // the winner's report goes to rank 0
+    double rep[6] = { (double)win_thread, (double)win_restart, (double)win_steps, win_init, secs, (double)ok };
+    if (win_rank != 0) {
+        if (rank == win_rank) MPI_Send(rep, 6, MPI_DOUBLE, 0, 0, MPI_COMM_WORLD);
+        if (rank == 0) MPI_Recv(rep, 6, MPI_DOUBLE, win_rank, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    }
+    win_thread = (int)rep[0];
+    win_restart = (long long)rep[1];
+    win_steps = (long long)rep[2];
+    win_init = rep[3];
+    secs = rep[4];
+    ok = rep[5] != 0.0;
+#endif
+    if (rank == 0) {
+        printf("N=%d first solution: rank %d thread %d, restart %lld, %lld repair steps, "
+               "greedy start %.3f s, %.3f s total (%d ranks x %d threads), verified %s\n",
+               n, win_rank, win_thread, win_restart, win_steps, win_init, secs, nranks, num_threads,
+               ok ? "ok" : "FAILED");
+        if (ok && n <= 20 && !result.empty()) {
+            for (int r = 0; r < n; ++r) printf("%d%c", result[r], r + 1 < n ? ' ' : '\n');
+        }
+    }
+    return rank == 0 && !ok;
+}
+
+int main(int argc, char** argv) {
+    int rank = 0, nranks = 1;
+#ifdef USE_MPI
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_SERIALIZED, &provided);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+    auto finish = [](int code) { MPI_Finalize(); return code; };
+    bool threads_ok = provided >= MPI_THREAD_SERIALIZED;
+#else
+    auto finish = [](int code) { return code; };
+    bool threads_ok = true;
+#endif
+    if (argc > 1 && string(argv[1]) == "-f")
+        return finish(first_solution(argc - 1, argv + 1, rank, nranks, threads_ok));
+    if (argc < 3) {
+        if (rank == 0) cerr << "Usage: " << argv[0] << " [-f] N num_threads [depth | seed]\n";
+        return finish(1);
+    }
     N = stoi(argv[1]);
     int num_threads = stoi(argv[2]);
+    int depth = argc > 3 ? stoi(argv[3]) : 4;
+    if (N < 1 || N > 32) {
+        if (rank == 0) cerr << "N must be in 1..32\n";
+        return finish(1);
+    }
     if (num_threads < 1) num_threads = 1;
+    // for odd N the row-1 restriction must be part of the prefix
+    depth = max(N % 2 ? 2 : 1, min(depth, N));
+    full = N == 32 ? ~0u : (1u << N) - 1;
 
-    vector<thread> threads;
-    // we will assign distinct first-row column positions to threads.
-    // If threads > N, assign combinations of first two rows (simple extension).
-    vector<pair<int,int>> prefixes; // pair(row0col, row1col or -1)
-    for (int c0 = 0; c0 < N; ++c0) {
-        prefixes.emplace_back(c0, -1);
+    auto t0 = chrono::steady_clock::now();
+    vector<Task> tasks;
+    split(0, depth, 0, 0, 0, tasks);
+    int launch = max(1, min((int)tasks.size(), num_threads));
+    Load load;
+
+#ifdef USE_MPI
+    if (!threads_ok && launch > 1) {
+        if (rank == 0) cerr << "MPI library without MPI_THREAD_SERIALIZED: one thread per rank\n";
+        launch = 1;
     }
-    if (num_threads > N) {
-        // use two-row prefixes to get more tasks
-        prefixes.clear();
-        for (int c0 = 0; c0 < N; ++c0) {
-            for (int c1 = 0; c1 < N; ++c1) {
-                if (c1 == c0 || abs(c1 - c0) == 1) continue; // quick prune
-                prefixes.emplace_back(c0, c1);
-            }
+    // Shared task counter on rank 0, read-and-advanced atomically
+    long *counter;
+    MPI_Win win;
+    MPI_Win_allocate(rank == 0 ? sizeof(long) : 0, sizeof(long), MPI_INFO_NULL, MPI_COMM_WORLD, &counter, &win);
+    if (rank == 0) *counter = 0;
+    MPI_Barrier(MPI_COMM_WORLD);
+    MPI_Win_lock_all(0, win);
+    MPI_Barrier(MPI_COMM_WORLD);
+    t0 = chrono::steady_clock::now();
+
+    mutex win_mtx;
+    const long ntasks = (long)tasks.size(), one = 1;
+    run_threads(tasks, launch, [&](size_t& first, size_t& last) {
+        long i;
+        {
+            lock_guard<mutex> g(win_mtx);
+            MPI_Fetch_and_op(&one, &i, MPI_LONG, 0, 0, MPI_SUM, win);
+            MPI_Win_flush(0, win);
+            ++load.grabs;
         }
-    }
+        first = (size_t)i;
+        last = first + 1;
+        return i < ntasks;
+    }, load);
 
+    MPI_Win_unlock_all(win);
+    MPI_Win_free(&win);
+    long long half = total_solutions.load(), sum = 0;
+    MPI_Reduce(&half, &sum, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    total_solutions = sum;
+#else
     atomic<size_t> idx{0};
-    auto worker = [&](){
-        size_t i;
-        while ((i = idx.fetch_add(1, memory_order_relaxed)) < prefixes.size()) {
-            auto p = prefixes[i];
-            vector<int> cols(N, -1);
-            cols[0] = p.first;
-            int start_row = 1;
-            if (p.second != -1) {
-                cols[1] = p.second;
-                start_row = 2;
-            }
-            // validate prefix
-            bool ok = true;
-            for (int r = 0; r < start_row && ok; ++r)
-                for (int s = r+1; s < start_row && ok; ++s)
-                    if (cols[r] == cols[s] || abs(cols[r] - cols[s]) == abs(r - s)) ok = false;
-            if (!ok) continue;
-            solve_from_prefix(cols, start_row);
-        }
-    };
+    run_threads(tasks, launch, [&](size_t& first, size_t& last) {
+        first = idx.fetch_add(1, memory_order_relaxed);
+        last = first + 1;
+        return first < tasks.size();
+    }, load);
+#endif
 
-    int launch = min((int)prefixes.size(), num_threads);
-    for (int t = 0; t < launch; ++t) threads.emplace_back(worker);
-    for (auto &th : threads) th.join();
+    // every board was counted once for itself and once for its mirror image
+    long long solutions = N == 1 ? 1 : 2 * total_solutions.load();
+    double secs = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+
+#ifdef USE_MPI
+    // Load balance: tasks, counter grabs and busy thread-seconds per rank
+    double mine[4] = { (double)load.tasks, (double)load.grabs, (double)load.solutions, load.busy };
+    vector<double> all(rank == 0 ? 4 * nranks : 4);
+    MPI_Gather(mine, 4, MPI_DOUBLE, all.data(), 4, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    double max_secs;
+    MPI_Reduce(&secs, &max_secs, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    secs = max_secs;
+    if (rank == 0) {
+        double max_busy = 0.0, sum_busy = 0.0;
+        for (int r = 0; r < nranks; ++r) {
+            max_busy = max(max_busy, all[4 * r + 3]);
+            sum_busy += all[4 * r + 3];
+        }
+        printf("%6s %8s %7s %8s %8s %10s  %s\n", "rank", "tasks", "share", "grabs", "busy_s", "solutions",
+               "busy time");
+        for (int r = 0; r < nranks; ++r) {
+            const double* v = &all[4 * r];
+            int bar = max_busy > 0 ? (int)(40 * v[3] / max_busy + 0.5) : 0;
+            printf("%6d %8.0f %6.1f%% %8.0f %8.3f %10.0f  %s\n", r, v[0], 100.0 * v[0] / tasks.size(), v[1],
+                   v[3], 2 * v[2], string(bar, '#').c_str());
+        }
+        printf("busy max/avg %.3f over %d ranks x %d threads\n",
+               sum_busy > 0 ? max_busy * nranks / sum_busy : 1.0, nranks, launch);
+    }
+#endif
 
-    cout << "N=" << N << " solutions=" << total_solutions.load() << " (threads=" << launch << ")\n";
-    return 0;
+    // the total is only complete on rank 0
+    int bad = rank == 0 && N < (int)(sizeof known / sizeof known[0]) && solutions != known[N];
+    if (rank == 0) {
+        cout << "N=" << N << " solutions=" << solutions << " (";
+        if (nranks > 1) cout << "ranks=" << nranks << ", ";
+        cout << "threads=" << launch << ", tasks=" << tasks.size() << " at depth " << depth << ", " << secs << " s)";
+        if (N < (int)(sizeof known / sizeof known[0]))
+            cout << (bad ? " WRONG, expected " + to_string(known[N]) : " ok");
+        cout << "\n";
+    }
+    return finish(bad);
 }
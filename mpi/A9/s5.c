@@ -1,10 +1,16 @@
 /* spec_matmul_mpi.c
    Compile: mpicc -O2 -o spec_matmul_mpi spec_matmul_mpi.c
-   Run: mpirun -np 3 ./spec_matmul_mpi N
+   Run: mpirun -np 3 ./spec_matmul_mpi N [compress]
    Ranks:
      0 - coordinator
      1 - Strassen (method A, "approx"/fast)
      2 - Classical (method B, exact)
+   Matrices are sent as N rows of a contiguous row datatype, so message
+   counts stay within int for N*N > 2^31.
+   compress = none (default), lossless or lossy=<abs error bound>: A and B
+   go to the workers through common/compress.h (chunked, coding overlapped
+   with the transfer); the coordinator prints ratio and coding cost, each
+   worker its receive and decode time.
 */
 #include <mpi.h>
 #include <stdio.h>
@@ -12,21 +18,43 @@
 #include <string.h>
 #include <time.h>
 
+#include "../../common/compress.h"
+#include "../../common/matlayout.h"
+
 #define TAG_DATA 10
 #define TAG_DONE 20
 #define TAG_CANCEL 30
 #define TAG_RESULT 40
 
-/* Helper: allocate NxN double matrix contiguous */
-double *alloc_mat(int N){ return (double*)calloc((size_t)N*N, sizeof(double)); }
+#define STRASSEN_TILE 64   /* Morton tile edge = Strassen base case */
+
+/* set once a worker has consumed its TAG_CANCEL message */
+static int cancelled = 0;
+
+/* Helper: allocate NxN double matrix contiguous, zeroed, 64-byte aligned */
+double *alloc_mat(int N){
+    void *p = NULL;
+    size_t bytes = (size_t)N*N*sizeof(double);
+    if (posix_memalign(&p, 64, bytes ? bytes : 64) != 0) return NULL;
+    memset(p, 0, bytes);
+    return (double*)p;
+}
+
+/* Helper: datatype for one matrix row of N doubles (caller frees) */
+MPI_Datatype row_type(int N){
+    MPI_Datatype t;
+    MPI_Type_contiguous(N, MPI_DOUBLE, &t);
+    MPI_Type_commit(&t);
+    return t;
+}
 
 /* naive classical multiply with periodic cancel check */
 void classical_mul_check(int N, double *A, double *B, double *C, MPI_Comm comm) {
     int cancel=0;
-    for (int i=0;i<N;i++){
-        for (int k=0;k<N;k++){
+    for (size_t i=0;i<(size_t)N;i++){
+        for (size_t k=0;k<(size_t)N;k++){
             double aik = A[i*N + k];
-            for (int j=0;j<N;j++){
+            for (size_t j=0;j<(size_t)N;j++){
                 C[i*N + j] += aik * B[k*N + j];
             }
         }
@@ -34,6 +62,7 @@ void classical_mul_check(int N, double *A, double *B, double *C, MPI_Comm comm)
         MPI_Iprobe(0, TAG_CANCEL, comm, &cancel, MPI_STATUS_IGNORE);
         if (cancel) {
             int flag; MPI_Recv(&flag, 1, MPI_INT, 0, TAG_CANCEL, comm, MPI_STATUS_IGNORE);
+            cancelled = 1;
             return;
         }
     }
@@ -48,69 +77,75 @@ void classical_mul_block(int n, double *A, double *B, double *C){
       }
 }
 
-/* add/sub helpers */
-void add_block(int n, double *A, double *B, double *C){
-    for (int i=0;i<n*n;i++) C[i] = A[i] + B[i];
+/* add/sub helpers over len contiguous elements */
+void add_block(size_t len, double *A, double *B, double *C){
+    for (size_t i=0;i<len;i++) C[i] = A[i] + B[i];
 }
-void sub_block(int n, double *A, double *B, double *C){
-    for (int i=0;i<n*n;i++) C[i] = A[i] - B[i];
+void sub_block(size_t len, double *A, double *B, double *C){
+    for (size_t i=0;i<len;i++) C[i] = A[i] - B[i];
 }
 
-/* Strassen with cooperative cancel check: checks cancel at recursion entry */
-void strassen_rec(int n, double *A, double *B, double *C, MPI_Comm comm) {
+/* Strassen with cooperative cancel check: checks cancel at recursion entry.
+   A, B, C are n x n blocks in Morton tile layout (common/matlayout.h) with
+   tile edge T, so each quadrant is a contiguous (n/2)^2 block and the
+   recursion and add/sub helpers never touch strided submatrices. */
+void strassen_rec(int n, int T, double *A, double *B, double *C, MPI_Comm comm) {
     int cancel=0;
     /* Periodically check for cancel on recursion entry */
+    if (cancelled) return;
     MPI_Iprobe(0, TAG_CANCEL, comm, &cancel, MPI_STATUS_IGNORE);
-    if (cancel) { int flag; MPI_Recv(&flag,1,MPI_INT,0,TAG_CANCEL,comm,MPI_STATUS_IGNORE); return; }
+    if (cancel) { int flag; MPI_Recv(&flag,1,MPI_INT,0,TAG_CANCEL,comm,MPI_STATUS_IGNORE); cancelled = 1; return; }
 
-    if (n <= 64) { /* base case threshold */
+    if (n <= T) { /* base case: one contiguous row-major tile */
         classical_mul_block(n,A,B,C);
         return;
     }
     int m = n/2;
-    size_t bytes = (size_t)m*m*sizeof(double);
-    /* allocate temporaries */
+    size_t q = (size_t)m*m;
+    size_t bytes = q*sizeof(double);
+    /* quadrants are contiguous in Morton order: 11, 12, 21, 22 */
     double *A11 = A;
-    double *A12 = A + m;
-    double *A21 = A + m*n;
-    double *A22 = A + m*n + m;
+    double *A12 = A + q;
+    double *A21 = A + 2*q;
+    double *A22 = A + 3*q;
     double *B11 = B;
-    double *B12 = B + m;
-    double *B21 = B + m*n;
-    double *B22 = B + m*n + m;
+    double *B12 = B + q;
+    double *B21 = B + 2*q;
+    double *B22 = B + 3*q;
     double *C11 = C;
-    double *C12 = C + m;
-    double *C21 = C + m*n;
-    double *C22 = C + m*n + m;
+    double *C12 = C + q;
+    double *C21 = C + 2*q;
+    double *C22 = C + 3*q;
 
+    /* allocate temporaries (same Morton layout as the quadrants) */
     double *S1 = (double*)malloc(bytes), *S2 = (double*)malloc(bytes), *S3 = (double*)malloc(bytes);
     double *P1 = (double*)malloc(bytes), *P2 = (double*)malloc(bytes), *P3 = (double*)malloc(bytes);
     double *P4 = (double*)malloc(bytes), *P5 = (double*)malloc(bytes), *P6 = (double*)malloc(bytes), *P7 = (double*)malloc(bytes);
     /* compute S and P matrices (standard Strassen) */
     // P1 = A11 * (B12 - B22)
-    sub_block(m, B12, B22, S1); memset(P1,0,bytes); strassen_rec(m, A11, S1, P1, comm);
+    sub_block(q, B12, B22, S1); memset(P1,0,bytes); strassen_rec(m, T, A11, S1, P1, comm);
     // P2 = (A11 + A12) * B22
-    add_block(m, A11, A12, S2); memset(P2,0,bytes); strassen_rec(m, S2, B22, P2, comm);
+    add_block(q, A11, A12, S2); memset(P2,0,bytes); strassen_rec(m, T, S2, B22, P2, comm);
     // P3 = (A21 + A22) * B11
-    add_block(m, A21, A22, S3); memset(P3,0,bytes); strassen_rec(m, S3, B11, P3, comm);
+    add_block(q, A21, A22, S3); memset(P3,0,bytes); strassen_rec(m, T, S3, B11, P3, comm);
     // P4 = A22 * (B21 - B11)
-    sub_block(m, B21, B11, S1); memset(P4,0,bytes); strassen_rec(m, A22, S1, P4, comm);
+    sub_block(q, B21, B11, S1); memset(P4,0,bytes); strassen_rec(m, T, A22, S1, P4, comm);
     // P5 = (A11 + A22) * (B11 + B22)
-    add_block(m, A11, A22, S2); add_block(m, B11, B22, S3); memset(P5,0,bytes); strassen_rec(m, S2, S3, P5, comm);
+    add_block(q, A11, A22, S2); add_block(q, B11, B22, S3); memset(P5,0,bytes); strassen_rec(m, T, S2, S3, P5, comm);
     // P6 = (A12 - A22) * (B21 + B22)
-    sub_block(m, A12, A22, S2); add_block(m, B21, B22, S3); memset(P6,0,bytes); strassen_rec(m, S2, S3, P6, comm);
+    sub_block(q, A12, A22, S2); add_block(q, B21, B22, S3); memset(P6,0,bytes); strassen_rec(m, T, S2, S3, P6, comm);
     // P7 = (A11 - A21) * (B11 + B12)
-    sub_block(m, A11, A21, S2); add_block(m, B11, B12, S3); memset(P7,0,bytes); strassen_rec(m, S2, S3, P7, comm);
+    sub_block(q, A11, A21, S2); add_block(q, B11, B12, S3); memset(P7,0,bytes); strassen_rec(m, T, S2, S3, P7, comm);
 
     /* assemble C blocks */
     // C11 = P5 + P4 - P2 + P6
-    for (int i=0;i<m*m;i++) C11[i] = P5[i] + P4[i] - P2[i] + P6[i];
+    for (size_t i=0;i<q;i++) C11[i] = P5[i] + P4[i] - P2[i] + P6[i];
     // C12 = P1 + P2
-    for (int i=0;i<m*m;i++) C12[i] = P1[i] + P2[i];
+    for (size_t i=0;i<q;i++) C12[i] = P1[i] + P2[i];
     // C21 = P3 + P4
-    for (int i=0;i<m*m;i++) C21[i] = P3[i] + P4[i];
+    for (size_t i=0;i<q;i++) C21[i] = P3[i] + P4[i];
     // C22 = P5 + P1 - P3 - P7
-    for (int i=0;i<m*m;i++) C22[i] = P5[i] + P1[i] - P3[i] - P7[i];
+    for (size_t i=0;i<q;i++) C22[i] = P5[i] + P1[i] - P3[i] - P7[i];
 
     free(S1); free(S2); free(S3);
     free(P1); free(P2); free(P3); free(P4); free(P5); free(P6); free(P7);
@@ -125,17 +160,36 @@ int main(int argc,char**argv){
     }
     int N = 256;
     if (argc > 1) N = atoi(argv[1]);
+    cz_cfg_t cz; cz_stats_t czst = {0};
+    if (cz_parse(&cz, argc > 2 ? argv[2] : NULL) != 0) {
+        if (rank==0) fprintf(stderr,"compress: none, lossless or lossy=<error bound>\n");
+        MPI_Finalize(); return 1;
+    }
     if (rank == 0) {
         /* coordinator */
         srand((unsigned)time(NULL));
         double *A = alloc_mat(N), *B = alloc_mat(N);
-        for (int i=0;i<N*N;i++){ A[i] = (rand()%100)/10.0; B[i] = (rand()%100)/10.0; }
+        if (!A || !B) { fprintf(stderr,"[coord] alloc failed\n"); MPI_Abort(MPI_COMM_WORLD,1); }
+        for (size_t i=0;i<(size_t)N*N;i++){ A[i] = (rand()%100)/10.0; B[i] = (rand()%100)/10.0; }
         /* send N and data to workers */
+        MPI_Datatype row = row_type(N);
+        double ts = MPI_Wtime();
         for (int r=1;r<=2;r++){
             MPI_Send(&N,1,MPI_INT,r,TAG_DATA,MPI_COMM_WORLD);
-            MPI_Send(A,N*N,MPI_DOUBLE,r,TAG_DATA,MPI_COMM_WORLD);
-            MPI_Send(B,N*N,MPI_DOUBLE,r,TAG_DATA,MPI_COMM_WORLD);
+            if (cz.mode == CZ_NONE) {
+                MPI_Send(A,N,row,r,TAG_DATA,MPI_COMM_WORLD);
+                MPI_Send(B,N,row,r,TAG_DATA,MPI_COMM_WORLD);
+            } else {
+                cz_send(A,(size_t)N*N,r,TAG_DATA,MPI_COMM_WORLD,&cz,&czst);
+                cz_send(B,(size_t)N*N,r,TAG_DATA,MPI_COMM_WORLD,&cz,&czst);
+            }
         }
+        ts = MPI_Wtime() - ts;
+        if (cz.mode != CZ_NONE)
+            printf("[coord] %s send: %.1f MB -> %.1f MB (ratio %.2f) in %.4f s, compress %.4f s (%.0f MB/s)\n",
+                   cz_name(&cz), czst.raw/1e6, czst.wire/1e6, czst.raw/czst.wire, ts,
+                   czst.t_code, czst.raw/czst.t_code/1e6);
+        MPI_Type_free(&row);
         free(A); free(B);
 
         /* wait for first DONE from either worker */
@@ -150,32 +204,56 @@ int main(int argc,char**argv){
         /* receive result size then matrix result from winner */
         int recvN; MPI_Recv(&recvN,1,MPI_INT,src,TAG_RESULT,MPI_COMM_WORLD,MPI_STATUS_IGNORE);
         double *C = alloc_mat(recvN);
-        MPI_Recv(C, recvN*recvN, MPI_DOUBLE, src, TAG_RESULT, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        MPI_Datatype rrow = row_type(recvN);
+        MPI_Recv(C, recvN, rrow, src, TAG_RESULT, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        MPI_Type_free(&rrow);
         printf("[coord] received result from winner %d (N=%d). Sample C[0]=%f\n", src, recvN, C[0]);
         free(C);
     } else {
         /* worker: receive N and data */
         int n; MPI_Recv(&n,1,MPI_INT,0,TAG_DATA,MPI_COMM_WORLD,MPI_STATUS_IGNORE);
         double *A = alloc_mat(n), *B = alloc_mat(n);
-        MPI_Recv(A,n*n,MPI_DOUBLE,0,TAG_DATA,MPI_COMM_WORLD,MPI_STATUS_IGNORE);
-        MPI_Recv(B,n*n,MPI_DOUBLE,0,TAG_DATA,MPI_COMM_WORLD,MPI_STATUS_IGNORE);
+        if (!A || !B) { fprintf(stderr,"[rank%d] alloc failed\n",rank); MPI_Abort(MPI_COMM_WORLD,1); }
+        MPI_Datatype row = row_type(n);
+        if (cz.mode == CZ_NONE) {
+            MPI_Recv(A,n,row,0,TAG_DATA,MPI_COMM_WORLD,MPI_STATUS_IGNORE);
+            MPI_Recv(B,n,row,0,TAG_DATA,MPI_COMM_WORLD,MPI_STATUS_IGNORE);
+        } else {
+            double tr = MPI_Wtime();
+            if (cz_recv(A,(size_t)n*n,0,TAG_DATA,MPI_COMM_WORLD,&cz,&czst) != MPI_SUCCESS ||
+                cz_recv(B,(size_t)n*n,0,TAG_DATA,MPI_COMM_WORLD,&cz,&czst) != MPI_SUCCESS) {
+                fprintf(stderr,"[rank%d] corrupt compressed chunk\n",rank); MPI_Abort(MPI_COMM_WORLD,1);
+            }
+            printf("[rank%d] received A,B in %.4f s, decompress %.4f s\n", rank, MPI_Wtime()-tr, czst.t_decode);
+        }
         double *C = alloc_mat(n);
         int cancel=0;
         MPI_Request req_cancel;
         MPI_Status st;
 
         if (rank == 1) {
-            /* Strassen worker */
+            /* Strassen worker: convert to Morton tiles so every quadrant is contiguous */
             double t0 = MPI_Wtime();
-            strassen_rec(n,A,B,C,MPI_COMM_WORLD);
+            int T = (n < STRASSEN_TILE) ? n : STRASSEN_TILE;
+            mat_desc_t d = mat_desc(MAT_MORTON, n, T);
+            double *Am = malloc(mat_elems(&d)*sizeof(double));
+            double *Bm = malloc(mat_elems(&d)*sizeof(double));
+            double *Cm = calloc(mat_elems(&d), sizeof(double));
+            mat_pack(&d, A, n, Am);
+            mat_pack(&d, B, n, Bm);
+            strassen_rec((int)d.np, T, Am, Bm, Cm, MPI_COMM_WORLD);
+            mat_unpack(&d, Cm, C, n);
+            free(Am); free(Bm); free(Cm);
             double t1 = MPI_Wtime();
             /* before announcing done, check if cancel came in */
-            MPI_Iprobe(0,TAG_CANCEL,MPI_COMM_WORLD,&cancel,&st);
-            if (!cancel) {
+            if (!cancelled) MPI_Iprobe(0,TAG_CANCEL,MPI_COMM_WORLD,&cancel,&st);
+            if (cancelled) {
+                printf("[rank1] cancelled during Strassen\n");
+            } else if (!cancel) {
                 int done_msg = 1; MPI_Send(&done_msg,1,MPI_INT,0,TAG_DONE,MPI_COMM_WORLD);
                 /* send result */
                 MPI_Send(&n,1,MPI_INT,0,TAG_RESULT,MPI_COMM_WORLD);
-                MPI_Send(C,n*n,MPI_DOUBLE,0,TAG_RESULT,MPI_COMM_WORLD);
+                MPI_Send(C,n,row,0,TAG_RESULT,MPI_COMM_WORLD);
                 printf("[rank1] finished Strassen in %g s, sent result\n", t1-t0);
             } else {
                 /* consume cancel */
@@ -188,17 +266,20 @@ int main(int argc,char**argv){
             classical_mul_check(n,A,B,C,MPI_COMM_WORLD);
             double t1 = MPI_Wtime();
             /* check whether cancel arrived */
-            MPI_Iprobe(0,TAG_CANCEL,MPI_COMM_WORLD,&cancel,&st);
-            if (!cancel) {
+            if (!cancelled) MPI_Iprobe(0,TAG_CANCEL,MPI_COMM_WORLD,&cancel,&st);
+            if (cancelled) {
+                printf("[rank2] cancelled during multiply\n");
+            } else if (!cancel) {
                 int done_msg = 1; MPI_Send(&done_msg,1,MPI_INT,0,TAG_DONE,MPI_COMM_WORLD);
                 MPI_Send(&n,1,MPI_INT,0,TAG_RESULT,MPI_COMM_WORLD);
-                MPI_Send(C,n*n,MPI_DOUBLE,0,TAG_RESULT,MPI_COMM_WORLD);
+                MPI_Send(C,n,row,0,TAG_RESULT,MPI_COMM_WORLD);
                 printf("[rank2] finished Classical in %g s, sent result\n", t1-t0);
             } else {
                 int f; MPI_Recv(&f,1,MPI_INT,0,TAG_CANCEL,MPI_COMM_WORLD,&st);
                 printf("[rank2] cancelled before send\n");
             }
         }
+        MPI_Type_free(&row);
         free(A); free(B); free(C);
     }
     MPI_Finalize();
@@ -0,0 +1,150 @@
+// allreduce.c
+// MPI_Allreduce against the ring and Rabenseifner algorithms of
+// common/allreduce.h (double sum, in place), per message size.
+//
+// Build: mpicc -O2 -o allreduce allreduce.c
+// Run:   mpirun -np 4 ./allreduce [-m max_bytes] [-i iters] [-o results.csv]
+//
+// Every algorithm is first checked against MPI_Allreduce at each size on
+// integer-valued data (exact sums). The timed runs reduce zeros so that
+// repeating the in-place reduction cannot overflow. Timing follows
+// mpibench.c: warmup, barrier, mean over iterations (fewer above 8 KB), max
+// over ranks. The last lines give the crossovers measured on this machine
+// in the form ar_auto takes them (-DAR_SMALL_BYTES / -DAR_LARGE_BYTES):
+// the algorithm chosen above each must win at every larger size measured.
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../../common/allreduce.h"
+
+#define NALG 4
+
+typedef int (*ar_fn)(void *, int, MPI_Datatype, MPI_Op, MPI_Comm);
+
+static int ar_library(void *buf, int count, MPI_Datatype type, MPI_Op op, MPI_Comm comm) {
+    return MPI_Allreduce(MPI_IN_PLACE, buf, count, type, op, comm);
+}
+
+static const char *alg_name[NALG] = { "MPI_Allreduce", "ring", "rabenseifner", "auto" };
+static const ar_fn alg_fn[NALG] = { ar_library, ar_ring, ar_rabenseifner, ar_auto };
+
+static double *alloc_doubles(size_t n) {
+    void *p = NULL;
+    if (n == 0) n = 1;
+    if (posix_memalign(&p, 64, n * sizeof(double)) != 0) return NULL;
+    return (double *) p;
+}
+
+int main(int argc, char **argv) {
+    int rank, P;
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &P);
+
+    int opt, iters = 200;
+    size_t max_bytes = (size_t) 64 << 20;
+    const char *csv_path = NULL;
+    while ((opt = getopt(argc, argv, "m:i:o:")) != -1) {
+        switch (opt) {
+        case 'm': max_bytes = strtoull(optarg, NULL, 10); break;
+        case 'i': iters = atoi(optarg); break;
+        case 'o': csv_path = optarg; break;
+        default:
+            if (rank == 0) fprintf(stderr, "Usage: %s [-m max_bytes] [-i iters] [-o results.csv]\n", argv[0]);
+            MPI_Finalize();
+            return 1;
+        }
+    }
+    if (iters < 1) iters = 1;
+
+    size_t max_n = max_bytes / sizeof(double);
+    double *buf = alloc_doubles(max_n), *ref = alloc_doubles(max_n);
+    if (!buf || !ref) {
+        fprintf(stderr, "Rank %d: allocation failed\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    FILE *csv = NULL;
+    if (rank == 0 && csv_path) {
+        csv = fopen(csv_path, "w");
+        if (!csv) {
+            fprintf(stderr, "Cannot open %s\n", csv_path);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        fprintf(csv, "procs,bytes,algorithm,iters,max_us\n");
+    }
+    if (rank == 0) {
+        printf("# Allreduce (double sum, in place), %d processes\n", P);
+        printf("%12s %8s", "bytes", "iters");
+        for (int a = 0; a < NALG; a++) printf(" %14s", alg_name[a]);
+        printf("   best (us)\n");
+    }
+
+    size_t small = 0, large = 0;
+    int failed = 0;
+    for (size_t n = 1; n <= max_n; n *= 2) {
+        size_t bytes = n * sizeof(double);
+
+        // Correctness: integer-valued data, so every summation order is exact
+        for (size_t i = 0; i < n; i++) ref[i] = (double) ((rank * 7 + i * 13) % 1000);
+        MPI_Allreduce(MPI_IN_PLACE, ref, (int) n, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+        for (int a = 1; a < NALG; a++) {
+            for (size_t i = 0; i < n; i++) buf[i] = (double) ((rank * 7 + i * 13) % 1000);
+            alg_fn[a](buf, (int) n, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+            int bad = memcmp(buf, ref, n * sizeof(double)) != 0, any;
+            MPI_Allreduce(&bad, &any, 1, MPI_INT, MPI_LOR, MPI_COMM_WORLD);
+            if (any && rank == 0) printf("# %s WRONG at %zu bytes\n", alg_name[a], bytes);
+            failed |= any;
+        }
+
+        int n_it = iters, n_warm = iters / 10 > 0 ? iters / 10 : 1;
+        if (bytes > 8192) {
+            n_it = (int) ((double) iters * 8192 / bytes);
+            if (n_it < 5) n_it = 5;
+            n_warm = 1;
+        }
+        memset(buf, 0, n * sizeof(double));
+        double t[NALG];
+        for (int a = 0; a < NALG; a++) {
+            for (int i = 0; i < n_warm; i++) alg_fn[a](buf, (int) n, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+            MPI_Barrier(MPI_COMM_WORLD);
+            double t0 = MPI_Wtime();
+            for (int i = 0; i < n_it; i++) alg_fn[a](buf, (int) n, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+            t[a] = (MPI_Wtime() - t0) / n_it;
+        }
+        MPI_Allreduce(MPI_IN_PLACE, t, NALG, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+
+        if (rank == 0) {
+            int best = 0;
+            for (int a = 1; a < 3; a++) if (t[a] < t[best]) best = a;
+            printf("%12zu %8d", bytes, n_it);
+            for (int a = 0; a < NALG; a++) printf(" %14.2f", t[a] * 1e6);
+            printf("   %s\n", alg_name[best]);
+            if (csv)
+                for (int a = 0; a < NALG; a++)
+                    fprintf(csv, "%d,%zu,%s,%d,%.3f\n", P, bytes, alg_name[a], n_it, t[a] * 1e6);
+            // Crossovers: the size after the last one where the library
+            // wins, and after the last one where Rabenseifner beats the ring
+            if (best == 0) small = large = 0;
+            else if (!small) small = bytes;
+            if (best == 2) large = 0;
+            else if (best == 1 && !large) large = bytes;
+        }
+    }
+
+    if (rank == 0) {
+        printf("\n# Validation: %s\n", failed ? "FAILED" : "all algorithms match MPI_Allreduce");
+        // 0 = never switched within the measured range: stay above max_bytes
+        printf("# Measured selector: -DAR_SMALL_BYTES=%zu -DAR_LARGE_BYTES=%zu (compiled in: %d, %d)\n",
+               small ? small : 2 * max_bytes, large ? large : 2 * max_bytes, AR_SMALL_BYTES, AR_LARGE_BYTES);
+    }
+    if (csv) fclose(csv);
+    free(buf);
+    free(ref);
+
+    MPI_Finalize();
+    return failed;
+}
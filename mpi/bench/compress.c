@@ -0,0 +1,172 @@
+// compress.c
+// Point-to-point transfer of large double arrays, plain against the
+// compressed transport of common/compress.h, over several kinds of data.
+//
+// Build: mpicc -O2 -march=native -o compress compress.c -lm
+// Run:   mpirun -np 2 ./compress [-n doubles] [-r reps] [-e error_bound] [-o results.csv]
+//
+// Rank 0 sends n doubles to rank 1 (which answers with an empty message, so
+// the time covers delivery and decoding); best of -r reps for each of
+//   random     uniform doubles: little to find losslessly
+//   quantized  (rand() % 100) / 10.0, the inputs of mpi/A9/s5.c
+//   matrix     drand(i + j) rows as B of mpi/A7/q2.c: shifted copies
+//   smooth     a sampled sine, as from a PDE field
+//   large      magnitudes 1e6 .. 2e13, one per chunk, where x / (2 eb)
+//              and back stop being exact enough for the lossy bound
+// and modes none / lossless / lossy=<error bound>. Every transfer is checked:
+// bit-exact for lossless, |error| <= bound for lossy.
+//
+// Besides the measured gain (which on one node compares against a memcpy
+// through shared memory and so is usually < 1), the table gives the link
+// bandwidth below which compression pays: with coding overlapped, the
+// compressed transfer costs about max(compress, decompress) time, the plain
+// one bytes / bandwidth.
+#include <mpi.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../../common/compress.h"
+
+#define TAG 7
+
+enum { K_RANDOM, K_QUANT, K_MATRIX, K_SMOOTH, K_LARGE, NKINDS };
+static const char *kind_name[NKINDS] = { "random", "quantized", "matrix", "smooth", "large" };
+
+static double *alloc_doubles(size_t n) {
+    void *p = NULL;
+    if (n == 0) n = 1;
+    if (posix_memalign(&p, 64, n * sizeof(double)) != 0) return NULL;
+    return (double *) p;
+}
+
+static double drand(size_t seed) {
+    unsigned int x = (unsigned int) seed;
+    x = (1103515245u * x + 12345u) & 0x7fffffff;
+    return (double) (x % 1000) / 1000.0;
+}
+
+static void fill(int kind, double *x, size_t n) {
+    srand(12345);
+    for (size_t i = 0; i < n; i++) {
+        switch (kind) {
+        case K_RANDOM: x[i] = (double) rand() / RAND_MAX * 100.0; break;
+        case K_QUANT: x[i] = (rand() % 100) / 10.0; break;
+        case K_MATRIX: x[i] = drand(i / 1024 + i % 1024 + 12345); break;
+        case K_SMOOTH: x[i] = sin(i * 1e-4) * 10.0; break;
+        default: x[i] = pow(10.0, 6 + (double) (i / CZ_CHUNK * 3 % 8)) * (1.0 + (double) rand() / RAND_MAX); break;
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    int rank, P;
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &P);
+
+    int opt, reps = 3;
+    size_t n = (size_t) 4 << 20;
+    double eb = 1e-6;
+    const char *csv_path = NULL;
+    while ((opt = getopt(argc, argv, "n:r:e:o:")) != -1) {
+        switch (opt) {
+        case 'n': n = strtoull(optarg, NULL, 10); break;
+        case 'r': reps = atoi(optarg); break;
+        case 'e': eb = atof(optarg); break;
+        case 'o': csv_path = optarg; break;
+        default: P = 0; break;
+        }
+    }
+    if (P != 2 || n == 0 || eb <= 0.0) {
+        if (rank == 0)
+            fprintf(stderr, "Usage: mpirun -np 2 %s [-n doubles] [-r reps] [-e error_bound] [-o results.csv]\n",
+                    argv[0]);
+        MPI_Finalize();
+        return 1;
+    }
+    if (reps < 1) reps = 1;
+
+    double *x = alloc_doubles(n), *y = alloc_doubles(n);
+    if (!x || !y) {
+        fprintf(stderr, "Rank %d: allocation failed\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    char lossy[64];
+    snprintf(lossy, sizeof lossy, "lossy=%g", eb);
+    const char *modes[3] = { "none", "lossless", lossy };
+
+    FILE *csv = NULL;
+    if (rank == 0 && csv_path) {
+        csv = fopen(csv_path, "w");
+        if (!csv) {
+            fprintf(stderr, "Cannot open %s\n", csv_path);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        fprintf(csv, "data,mode,bytes,ratio,ms,gain,compress_MBps,decompress_MBps,breakeven_MBps\n");
+    }
+    if (rank == 0)
+        printf("# Compressed transfer of %zu doubles (%.1f MB), best of %d\n%-10s %-12s %7s %9s %7s %12s %14s %15s\n",
+               n, n * 8.0 / 1e6, reps, "data", "mode", "ratio", "ms", "gain", "compress_MB/s", "decompress_MB/s",
+               "breakeven_MB/s");
+
+    int failed = 0;
+    for (int kind = 0; kind < NKINDS; kind++) {
+        fill(kind, x, n);
+        double raw_t = 0.0;
+        for (int m = 0; m < 3; m++) {
+            cz_cfg_t cfg;
+            cz_parse(&cfg, modes[m]);
+            double best = 1e30;
+            cz_stats_t st = { 0 };
+            int bad = 0;
+            for (int r = 0; r < reps; r++) {
+                memset(&st, 0, sizeof st);
+                if (rank == 1) memset(y, 0, n * sizeof(double));
+                MPI_Barrier(MPI_COMM_WORLD);
+                double t0 = MPI_Wtime();
+                if (rank == 0) {
+                    cz_send(x, n, 1, TAG, MPI_COMM_WORLD, &cfg, &st);
+                    MPI_Recv(NULL, 0, MPI_BYTE, 1, TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+                } else {
+                    bad |= cz_recv(y, n, 0, TAG, MPI_COMM_WORLD, &cfg, &st) != MPI_SUCCESS;
+                    MPI_Send(NULL, 0, MPI_BYTE, 0, TAG, MPI_COMM_WORLD);
+                }
+                double t = MPI_Wtime() - t0;
+                if (t < best) best = t;
+            }
+            if (rank == 1) {
+                // y holds the last transfer; x is regenerated identically here
+                fill(kind, x, n);
+                for (size_t i = 0; i < n && !bad; i++)
+                    bad = cfg.mode == CZ_LOSSY ? !(fabs(x[i] - y[i]) <= eb) : x[i] != y[i];
+            }
+            // gather the sender's byte counts and coding time, the receiver's decoding time
+            double v[4] = { st.raw, st.wire, st.t_code, st.t_decode }, s[4];
+            MPI_Reduce(v, s, 4, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+            MPI_Allreduce(MPI_IN_PLACE, &bad, 1, MPI_INT, MPI_LOR, MPI_COMM_WORLD);
+            failed |= bad;
+            if (rank != 0) continue;
+            if (m == 0) raw_t = best;
+            double bytes = n * 8.0, ratio = s[1] > 0 ? s[0] / s[1] : 1.0;
+            double cmb = s[2] > 0 ? bytes / s[2] / 1e6 : 0.0, dmb = s[3] > 0 ? bytes / s[3] / 1e6 : 0.0;
+            double coding = s[2] > s[3] ? s[2] : s[3];
+            double be = m > 0 && coding > 0 && ratio > 1.0 ? bytes / coding / 1e6 : 0.0;
+            printf("%-10s %-12s %7.2f %9.3f %6.2fx %12.0f %14.0f %15.0f%s\n", kind_name[kind], modes[m], ratio,
+                   best * 1e3, raw_t / best, cmb, dmb, be, bad ? "  WRONG" : "");
+            if (csv)
+                fprintf(csv, "%s,%s,%.0f,%.3f,%.3f,%.3f,%.1f,%.1f,%.1f\n", kind_name[kind], modes[m], bytes, ratio,
+                        best * 1e3, raw_t / best, cmb, dmb, be);
+        }
+    }
+
+    if (rank == 0) printf("\n# Validation: %s\n", failed ? "FAILED" : "all transfers within their bound");
+    if (csv) fclose(csv);
+    free(x);
+    free(y);
+
+    MPI_Finalize();
+    return failed;
+}
@@ -0,0 +1,176 @@
+// hcoll.c
+// Flat collectives on MPI_COMM_WORLD against the hierarchical ones of
+// common/hcoll.h (node shared-memory phase + node-leader phase).
+//
+// Build: mpicc -O2 -o hcoll hcoll.c
+// Run:   mpirun -np 16 ./hcoll [-r ranks_per_node] [-m max_bytes] [-i iters] [-o results.csv]
+//
+// -r 0 (default) uses the real nodes. On a single machine -r k splits the
+// ranks into "nodes" of k consecutive ranks, so the leader phase is
+// exercised too (e.g. -np 16 -r 4 stands for 4 nodes x 4 ranks).
+//
+// Each size first checks the hierarchical result against the flat one
+// (integer-valued doubles, so the sums are exact; gatherv with a
+// rank-dependent count; the root moves from size to size so that non-leader
+// roots are covered), then times both with root 0 like mpibench.c: warmup,
+// barrier, mean per call, max over ranks.
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../../common/hcoll.h"
+
+#define SLOT_BYTES (256 * 1024)
+
+enum { OP_BCAST, OP_REDUCE, OP_ALLREDUCE, OP_GATHERV, NOPS };
+static const char *op_name[NOPS] = { "bcast", "reduce", "allreduce", "gatherv" };
+
+static double *alloc_doubles(size_t n) {
+    void *p = NULL;
+    if (n == 0) n = 1;
+    if (posix_memalign(&p, 64, n * sizeof(double)) != 0) return NULL;
+    return (double *) p;
+}
+
+// One call of op with n doubles per rank (gatherv: n + rank % 3)
+static void run(int op, int hier, hcoll_t *h, double *a, double *b, int n,
+                int *rcounts, int *displs, int rank, int root) {
+    switch (op) {
+    case OP_BCAST:
+        if (hier) hcoll_bcast(h, a, n, MPI_DOUBLE, root);
+        else MPI_Bcast(a, n, MPI_DOUBLE, root, MPI_COMM_WORLD);
+        break;
+    case OP_REDUCE:
+        if (hier) hcoll_reduce(h, a, b, n, MPI_DOUBLE, MPI_SUM, root);
+        else MPI_Reduce(a, b, n, MPI_DOUBLE, MPI_SUM, root, MPI_COMM_WORLD);
+        break;
+    case OP_ALLREDUCE:
+        if (hier) hcoll_allreduce(h, a, b, n, MPI_DOUBLE, MPI_SUM);
+        else MPI_Allreduce(a, b, n, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+        break;
+    case OP_GATHERV:
+        if (hier) hcoll_gatherv(h, a, n + rank % 3, MPI_DOUBLE, b, rcounts, displs, root);
+        else MPI_Gatherv(a, n + rank % 3, MPI_DOUBLE, b, rcounts, displs, MPI_DOUBLE, root, MPI_COMM_WORLD);
+        break;
+    }
+}
+
+int main(int argc, char **argv) {
+    int rank, P;
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &P);
+
+    int opt, rpn = 0, iters = 200;
+    size_t max_bytes = (size_t) 4 << 20;
+    const char *csv_path = NULL;
+    while ((opt = getopt(argc, argv, "r:m:i:o:")) != -1) {
+        switch (opt) {
+        case 'r': rpn = atoi(optarg); break;
+        case 'm': max_bytes = strtoull(optarg, NULL, 10); break;
+        case 'i': iters = atoi(optarg); break;
+        case 'o': csv_path = optarg; break;
+        default:
+            if (rank == 0)
+                fprintf(stderr, "Usage: %s [-r ranks_per_node] [-m max_bytes] [-i iters] [-o results.csv]\n", argv[0]);
+            MPI_Finalize();
+            return 1;
+        }
+    }
+    if (iters < 1) iters = 1;
+
+    hcoll_t h;
+    if (hcoll_init(&h, MPI_COMM_WORLD, SLOT_BYTES, rpn) != 0) {
+        fprintf(stderr, "Rank %d: hcoll_init failed\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    size_t max_n = max_bytes / sizeof(double);
+    size_t big = (max_n + 2) * P;     /* gatherv receive buffer */
+    double *a = alloc_doubles(max_n + 2), *b = alloc_doubles(big), *ref = alloc_doubles(big);
+    int *rcounts = malloc(P * sizeof(int)), *displs = malloc(P * sizeof(int));
+    if (!a || !b || !ref || !rcounts || !displs) {
+        fprintf(stderr, "Rank %d: allocation failed\n", rank);
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    FILE *csv = NULL;
+    if (rank == 0 && csv_path) {
+        csv = fopen(csv_path, "w");
+        if (!csv) {
+            fprintf(stderr, "Cannot open %s\n", csv_path);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        fprintf(csv, "procs,nodes,operation,bytes,iters,flat_us,hier_us\n");
+    }
+    if (rank == 0)
+        printf("# Hierarchical collectives: %d processes on %d node%s (%s)\n", P, h.nc.num_nodes,
+               h.nc.num_nodes == 1 ? "" : "s", rpn > 0 ? "emulated with -r" : "MPI_COMM_TYPE_SHARED");
+
+    int failed = 0;
+    for (int op = 0; op < NOPS; op++) {
+        if (rank == 0) printf("\n# %s\n%12s %8s %12s %12s %9s\n", op_name[op], "bytes", "iters",
+                              "flat_us", "hier_us", "speedup");
+        int step = 0;
+        for (size_t n = 1; n <= max_n; n *= 2, step++) {
+            size_t bytes = n * sizeof(double);
+            int vroot = (step * 3) % P;
+            for (int p = 0, d = 0; p < P; p++) {
+                rcounts[p] = (int) n + p % 3;
+                displs[p] = d;
+                d += rcounts[p];
+            }
+
+            // Check: same result as the flat collective, bit for bit
+            int bad = 0, any;
+            for (size_t i = 0; i < n + 2; i++) a[i] = (double) ((rank * 31 + i * 7) % 1000);
+            memset(ref, 0, big * sizeof(double));
+            run(op, 0, &h, a, ref, (int) n, rcounts, displs, rank, vroot);
+            if (op == OP_BCAST) memcpy(ref, a, n * sizeof(double));
+            for (size_t i = 0; i < n + 2; i++) a[i] = (double) ((rank * 31 + i * 7) % 1000);
+            memset(b, 0, big * sizeof(double));
+            run(op, 1, &h, a, b, (int) n, rcounts, displs, rank, vroot);
+            if (op == OP_BCAST) bad = memcmp(a, ref, n * sizeof(double)) != 0;
+            else if (op == OP_ALLREDUCE || rank == vroot)
+                bad = memcmp(b, ref, (op == OP_GATHERV ? (size_t) displs[P - 1] + rcounts[P - 1] : n) * sizeof(double)) != 0;
+            MPI_Allreduce(&bad, &any, 1, MPI_INT, MPI_LOR, MPI_COMM_WORLD);
+            if (any && rank == 0) printf("# %s WRONG at %zu bytes\n", op_name[op], bytes);
+            failed |= any;
+
+            int n_it = iters;
+            if (bytes > 8192) {
+                n_it = (int) ((double) iters * 8192 / bytes);
+                if (n_it < 5) n_it = 5;
+            }
+            double t[2];
+            for (int hier = 0; hier < 2; hier++) {
+                run(op, hier, &h, a, b, (int) n, rcounts, displs, rank, 0);
+                MPI_Barrier(MPI_COMM_WORLD);
+                double t0 = MPI_Wtime();
+                for (int i = 0; i < n_it; i++) run(op, hier, &h, a, b, (int) n, rcounts, displs, rank, 0);
+                t[hier] = (MPI_Wtime() - t0) / n_it;
+            }
+            MPI_Allreduce(MPI_IN_PLACE, t, 2, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+            if (rank == 0) {
+                printf("%12zu %8d %12.2f %12.2f %8.2fx\n", bytes, n_it, t[0] * 1e6, t[1] * 1e6, t[0] / t[1]);
+                if (csv)
+                    fprintf(csv, "%d,%d,%s,%zu,%d,%.3f,%.3f\n", P, h.nc.num_nodes, op_name[op], bytes, n_it,
+                            t[0] * 1e6, t[1] * 1e6);
+            }
+        }
+    }
+
+    if (rank == 0) printf("\n# Validation: %s\n", failed ? "FAILED" : "hierarchical results match the flat ones");
+    if (csv) fclose(csv);
+    free(a);
+    free(b);
+    free(ref);
+    free(rcounts);
+    free(displs);
+    hcoll_free(&h);
+
+    MPI_Finalize();
+    return failed;
+}
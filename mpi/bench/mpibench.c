@@ -0,0 +1,248 @@
+// mpibench.c
+// OSU-style latency and bandwidth micro-benchmarks for point-to-point and
+// collective MPI operations, per message size, with optional CSV output.
+//
+// Build: mpicc -O2 -o mpibench mpibench.c
+// Run:   mpirun -np 4 --mca btl self,vader ./mpibench [-t tests] [-m max_bytes]
+//            [-M max_total] [-i iters] [-w warmup] [-o results.csv]
+//
+// Tests (-t takes a comma-separated list, default all):
+//   pingpong   ranks 0 and 1 bounce one message; latency is half the round trip
+//   ring       every rank MPI_Sendrecv's to its right and from its left neighbour
+//   bcast, scatterv, gatherv, reduce, allreduce, alltoall   (root 0)
+//
+// Sizes are powers of two from 1 B (4 B for reduce/allreduce, which sum
+// MPI_FLOATs) to max_bytes, default 64 MB. For scatterv, gatherv and
+// alltoall the size is the block per rank, so the root (or every rank)
+// holds size x P bytes; sizes above max_total (default 256 MB) are skipped.
+//
+// Every size runs `warmup` untimed and `iters` timed repetitions after a
+// barrier; collective calls are timed one by one with a barrier between
+// them (as OSU does), so rooted collectives cannot pipeline. Above 8 KB the
+// counts shrink in proportion to the size (at least 5 timed, 1 warmup) so
+// large sizes take about as long as small ones. The mean time per
+// repetition is taken on each rank and min/avg/max over the ranks are
+// reported; MB/s is size / avg (the one-way rate for pingpong).
+//
+// On a single node Open MPI already uses shared memory (the vader BTL);
+// "--mca btl self,vader" just makes sure no network transport is picked.
+#include <mpi.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef enum {
+    T_PINGPONG, T_RING, T_BCAST, T_SCATTERV, T_GATHERV, T_REDUCE, T_ALLREDUCE, T_ALLTOALL, NTESTS
+} test_t;
+
+static const char *test_name[NTESTS] = {
+    "pingpong", "ring", "bcast", "scatterv", "gatherv", "reduce", "allreduce", "alltoall"
+};
+
+typedef struct {
+    char *s, *r;        /* send and receive buffers, `cap` bytes each */
+    size_t cap;
+    int *counts, *displs;
+} bufs_t;
+
+// Grow both buffers to n bytes and touch them, so no page faults get timed
+static int bufs_reserve(bufs_t *b, size_t n) {
+    if (n <= b->cap) return 0;
+    free(b->s);
+    free(b->r);
+    b->s = b->r = NULL;
+    b->cap = 0;
+    if (posix_memalign((void **) &b->s, 64, n) != 0 || posix_memalign((void **) &b->r, 64, n) != 0)
+        return -1;
+    memset(b->s, 1, n);
+    memset(b->r, 0, n);
+    b->cap = n;
+    return 0;
+}
+
+// Bytes each buffer needs for one rank at this size
+static size_t test_bytes(test_t t, size_t size, int P) {
+    return (t == T_SCATTERV || t == T_GATHERV || t == T_ALLTOALL) ? size * P : size;
+}
+
+static void run_once(test_t t, size_t size, bufs_t *b, int rank, int P) {
+    int n = (int) size, left = (rank - 1 + P) % P, right = (rank + 1) % P;
+    switch (t) {
+    case T_PINGPONG:
+        if (rank == 0) {
+            MPI_Send(b->s, n, MPI_BYTE, 1, 0, MPI_COMM_WORLD);
+            MPI_Recv(b->r, n, MPI_BYTE, 1, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        } else if (rank == 1) {
+            MPI_Recv(b->r, n, MPI_BYTE, 0, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            MPI_Send(b->s, n, MPI_BYTE, 0, 0, MPI_COMM_WORLD);
+        }
+        break;
+    case T_RING:
+        MPI_Sendrecv(b->s, n, MPI_BYTE, right, 0, b->r, n, MPI_BYTE, left, 0,
+                     MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        break;
+    case T_BCAST:
+        MPI_Bcast(b->s, n, MPI_BYTE, 0, MPI_COMM_WORLD);
+        break;
+    case T_SCATTERV:
+        MPI_Scatterv(b->s, b->counts, b->displs, MPI_BYTE, b->r, n, MPI_BYTE, 0, MPI_COMM_WORLD);
+        break;
+    case T_GATHERV:
+        MPI_Gatherv(b->s, n, MPI_BYTE, b->r, b->counts, b->displs, MPI_BYTE, 0, MPI_COMM_WORLD);
+        break;
+    case T_REDUCE:
+        MPI_Reduce(b->s, b->r, n / 4, MPI_FLOAT, MPI_SUM, 0, MPI_COMM_WORLD);
+        break;
+    case T_ALLREDUCE:
+        MPI_Allreduce(b->s, b->r, n / 4, MPI_FLOAT, MPI_SUM, MPI_COMM_WORLD);
+        break;
+    case T_ALLTOALL:
+        MPI_Alltoall(b->s, n, MPI_BYTE, b->r, n, MPI_BYTE, MPI_COMM_WORLD);
+        break;
+    default:
+        break;
+    }
+}
+
+int main(int argc, char **argv) {
+    int rank, P;
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &P);
+
+    int opt, iters = 1000, warmup = 100, enabled[NTESTS];
+    size_t max_bytes = (size_t) 64 << 20, max_total = (size_t) 256 << 20;
+    const char *csv_path = NULL;
+    for (int t = 0; t < NTESTS; t++) enabled[t] = 1;
+
+    while ((opt = getopt(argc, argv, "t:m:M:i:w:o:")) != -1) {
+        switch (opt) {
+        case 't': {
+            char *list = strdup(optarg), *save = NULL;
+            for (int t = 0; t < NTESTS; t++) enabled[t] = 0;
+            for (char *tok = strtok_r(list, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+                int found = 0;
+                for (int t = 0; t < NTESTS; t++)
+                    if (strcmp(tok, test_name[t]) == 0) enabled[t] = found = 1;
+                if (!found) {
+                    if (rank == 0) fprintf(stderr, "Unknown test '%s'\n", tok);
+                    MPI_Finalize();
+                    return 1;
+                }
+            }
+            free(list);
+            break;
+        }
+        case 'm': max_bytes = strtoull(optarg, NULL, 10); break;
+        case 'M': max_total = strtoull(optarg, NULL, 10); break;
+        case 'i': iters = atoi(optarg); break;
+        case 'w': warmup = atoi(optarg); break;
+        case 'o': csv_path = optarg; break;
+        default:
+            if (rank == 0)
+                fprintf(stderr, "Usage: %s [-t test,...] [-m max_bytes] [-M max_total] [-i iters] "
+                                "[-w warmup] [-o results.csv]\n", argv[0]);
+            MPI_Finalize();
+            return 1;
+        }
+    }
+    if (iters < 1) iters = 1;
+    if (warmup < 0) warmup = 0;
+    if (max_total > INT_MAX) max_total = INT_MAX;    /* int counts and displacements */
+
+    FILE *csv = NULL;
+    if (rank == 0 && csv_path) {
+        csv = fopen(csv_path, "w");
+        if (!csv) {
+            fprintf(stderr, "Cannot open %s\n", csv_path);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        fprintf(csv, "test,procs,bytes,iters,avg_us,min_us,max_us,mb_per_s\n");
+    }
+
+    bufs_t b = { NULL, NULL, 0, malloc(P * sizeof(int)), malloc(P * sizeof(int)) };
+    if (rank == 0) printf("# MPI micro-benchmarks, %d processes\n", P);
+
+    for (int t = 0; t < NTESTS; t++) {
+        if (!enabled[t]) continue;
+        if (t == T_PINGPONG && P < 2) {
+            if (rank == 0) printf("\n# pingpong needs at least 2 processes, skipped\n");
+            continue;
+        }
+        if (rank == 0) printf("\n# %s\n%12s %10s %12s %12s %12s %12s\n", test_name[t],
+                              "bytes", "iters", "avg_us", "min_us", "max_us", "MB/s");
+
+        size_t first = (t == T_REDUCE || t == T_ALLREDUCE) ? 4 : 1;
+        for (size_t size = first; size <= max_bytes; size *= 2) {
+            size_t need = test_bytes((test_t) t, size, P);
+            if (need > max_total) break;
+            int ok = bufs_reserve(&b, need) == 0, all_ok;
+            MPI_Allreduce(&ok, &all_ok, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+            if (!all_ok) {
+                if (rank == 0) printf("# %zu bytes: out of memory, stopping this test\n", size);
+                break;
+            }
+            for (int p = 0; p < P; p++) {
+                b.counts[p] = (int) size;
+                b.displs[p] = (int) (p * size);
+            }
+
+            int n_it = iters, n_warm = warmup;
+            if (size > 8192) {
+                n_it = (int) ((double) iters * 8192 / size);
+                n_warm = (int) ((double) warmup * 8192 / size);
+                if (n_it < 5) n_it = 5;
+                if (n_warm < 1) n_warm = 1;
+            }
+
+            for (int i = 0; i < n_warm; i++) run_once((test_t) t, size, &b, rank, P);
+            // Collectives: time each call alone with a barrier in between, or
+            // a rooted collective would overlap with the next repetition
+            double lat = 0.0;
+            MPI_Barrier(MPI_COMM_WORLD);
+            if (t >= T_BCAST) {
+                for (int i = 0; i < n_it; i++) {
+                    double t0 = MPI_Wtime();
+                    run_once((test_t) t, size, &b, rank, P);
+                    lat += MPI_Wtime() - t0;
+                    MPI_Barrier(MPI_COMM_WORLD);
+                }
+            } else {
+                double t0 = MPI_Wtime();
+                for (int i = 0; i < n_it; i++) run_once((test_t) t, size, &b, rank, P);
+                lat = MPI_Wtime() - t0;
+            }
+            lat /= n_it;
+            if (t == T_PINGPONG) lat /= 2.0;
+
+            // pingpong: only rank 0's time is meaningful
+            double mm[2] = { lat, -lat }, mx[2], sum;
+            MPI_Reduce(mm, mx, 2, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+            MPI_Reduce(&lat, &sum, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+            if (rank == 0) {
+                double avg = sum / P, mn = -mx[1], mxx = mx[0];
+                if (t == T_PINGPONG) avg = mn = mxx = lat;
+                double mbps = size / avg / 1e6;
+                printf("%12zu %10d %12.2f %12.2f %12.2f %12.2f\n", size, n_it,
+                       avg * 1e6, mn * 1e6, mxx * 1e6, mbps);
+                if (csv)
+                    fprintf(csv, "%s,%d,%zu,%d,%.3f,%.3f,%.3f,%.2f\n", test_name[t], P, size, n_it,
+                            avg * 1e6, mn * 1e6, mxx * 1e6, mbps);
+            }
+        }
+    }
+
+    if (csv) {
+        fclose(csv);
+        printf("\nCSV written to %s\n", csv_path);
+    }
+    free(b.s);
+    free(b.r);
+    free(b.counts);
+    free(b.displs);
+
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,118 @@
+#!/usr/bin/env bash
+# scaling.sh
+# Strong- and weak-scaling sweeps of a program that prints the phase table
+# of common/phase_timer.h (mpi/A7/q1, mpi/A7/q2, mpi/A8/q1).
+#
+# Run:   ./scaling.sh [-m strong|weak|both] [-p "1 2 4 8"] [-n "1024 2048"]
+#                     [-e exponent] [-r reps] [-o results.csv] -- ./q1 {N}
+#
+#   -p  process counts; the first one is the baseline (use 1 for true
+#       speedups and serial fractions, otherwise they are relative)
+#   -n  problem sizes: N for strong scaling, N at the baseline for weak
+#   -e  work exponent of the program, work ~ N^e (2 for matvec and the
+#       convolution, 3 for matmat); weak scaling runs N * (P / P0)^(1/e) so
+#       the work per rank stays constant
+#   -r  repetitions per point, the fastest is kept (default 3)
+#   {N} in the command is replaced by the problem size.
+#   MPIRUN (default mpirun) and MPIRUN_FLAGS choose the launcher, e.g.
+#   MPIRUN_FLAGS="--oversubscribe" for more ranks than cores.
+#
+# Times are the max over ranks of the per-rank phase totals, i.e.
+# distribution and collection included. Per point the CSV has the phase
+# breakdown (max over ranks), the compute imbalance (max / avg), and
+#   strong: S = T(P0) / T(P), efficiency S / p
+#   weak:   S = p T(P0) / T(P) (scaled speedup), efficiency T(P0) / T(P)
+# with p = P / P0, and the Karp-Flatt serial fraction
+#   e = (1/S - 1/p) / (1 - 1/p)
+# which stays flat when the loss is a fixed serial part and grows with p
+# when it is overhead (communication, imbalance) that grows with P.
+set -euo pipefail
+
+mode=both
+procs="1 2 4 8"
+sizes="1024"
+expo=2
+reps=3
+csv=scaling.csv
+
+usage() {
+    sed -n '6,7p' "$0" | sed 's/^# //' >&2
+    exit 1
+}
+
+while getopts "m:p:n:e:r:o:" opt; do
+    case $opt in
+    m) mode=$OPTARG ;;
+    p) procs=$OPTARG ;;
+    n) sizes=$OPTARG ;;
+    e) expo=$OPTARG ;;
+    r) reps=$OPTARG ;;
+    o) csv=$OPTARG ;;
+    *) usage ;;
+    esac
+done
+shift $((OPTIND - 1))
+[ "${1:-}" = "--" ] && shift
+[ $# -gt 0 ] || usage
+case $mode in strong | weak | both) ;; *) usage ;; esac
+
+MPIRUN=${MPIRUN:-mpirun}
+read -r -a mpirun_flags <<<"${MPIRUN_FLAGS:-}"
+p0=${procs%% *}
+
+# run P N: prints "total init distribute compute collect imbalance" of the
+# fastest of $reps runs
+run() {
+    local P=$1 N=$2 best="" out line
+    local -a cmd=()
+    for a in "${prog[@]}"; do cmd+=("${a//\{N\}/$N}"); done
+    for ((i = 0; i < reps; i++)); do
+        out=$("$MPIRUN" "${mpirun_flags[@]}" -np "$P" "${cmd[@]}") || {
+            echo "scaling.sh: run failed: -np $P ${cmd[*]}" >&2
+            exit 1
+        }
+        line=$(awk '$1 == "init" && NF == 6 { i = $4 } $1 == "distribute" && NF == 6 { d = $4 }
+                    $1 == "compute" && NF == 6 { c = $4; imb = $5 } $1 == "collect" && NF == 6 { g = $4 }
+                    $1 == "total" && NF == 6 { t = $4 }
+                    END { if (t != "") print t, i, d, c, g, imb }' <<<"$out")
+        if [ -z "$line" ]; then
+            echo "scaling.sh: no phase table in the output of ${cmd[*]}" >&2
+            exit 1
+        fi
+        if [ -z "$best" ] || awk -v a="${line%% *}" -v b="${best%% *}" 'BEGIN { exit !(a < b) }'; then
+            best=$line
+        fi
+    done
+    echo "$best"
+}
+
+# sweep strong|weak: one CSV row per (size, P)
+sweep() {
+    local kind=$1 n0 N P res t1=""
+    for n0 in $sizes; do
+        t1=""
+        for P in $procs; do
+            if [ "$kind" = weak ]; then
+                N=$(awk -v n="$n0" -v p="$P" -v p0="$p0" -v e="$expo" 'BEGIN { printf "%d", n * (p / p0) ^ (1 / e) + 0.5 }')
+            else
+                N=$n0
+            fi
+            res=$(run "$P" "$N")
+            [ -n "$t1" ] || t1=${res%% *}
+            awk -v kind="$kind" -v n0="$n0" -v N="$N" -v P="$P" -v p0="$p0" -v t1="$t1" -v r="$res" 'BEGIN {
+                split(r, f, " ")
+                t = f[1]; p = P / p0
+                S = (kind == "weak") ? p * t1 / t : t1 / t
+                eff = S / p
+                kf = (p > 1) ? (1 / S - 1 / p) / (1 - 1 / p) : 0
+                printf "%s,%d,%d,%d,%.6f,%.6f,%.6f,%.6f,%.6f,%.2f,%.3f,%.3f,%.4f\n",
+                       kind, n0, N, P, t, f[2], f[3], f[4], f[5], f[6], S, eff, kf
+            }' | tee -a "$csv"
+        done
+    done
+}
+
+prog=("$@")
+echo "mode,n0,N,procs,total_s,init_s,distribute_s,compute_s,collect_s,compute_imbalance,speedup,efficiency,karp_flatt" | tee "$csv"
+[ "$mode" = weak ] || sweep strong
+[ "$mode" = strong ] || sweep weak
@@ -0,0 +1,94 @@
+#!/usr/bin/env bash
+# service.sh
+# Jobs per second of the persistent mpisvcd service against one mpirun per
+# job with the existing one-shot programs (mpi/A7/q1 matvec, mpi/A7/q2
+# matmul, mpi/A9/s7 sort).
+#
+# Build (from mpi/bench):
+#   mpicc -O2 -march=native -o mpisvcd ../tools/mpisvcd.c && gcc -O2 -o mpisvc ../tools/mpisvc.c -lm
+#   mpicc -O2 -o q1 ../A7/q1.c -lm && mpicc -O2 -o q2 ../A7/q2.c -lm && mpicc -O2 -o s7 ../A9/s7.c
+# Run:   ./service.sh [-p procs] [-n "matvec_N matmul_N sort_N"] [-j jobs] [-k oneshot_jobs] [-o results.csv]
+#
+# The service is started once with -p ranks and gets -j jobs per kind over
+# one connection; the one-shot side runs -k complete mpirun launches per
+# kind (s7 always uses 3 ranks, its fixed layout). Both include input
+# generation and result delivery; only the one-shot side pays process
+# startup, MPI_Init and allocation every time. MPIRUN and MPIRUN_FLAGS as
+# in scaling.sh.
+#
+# s7 can hang when both of its workers finish before the cancel arrives
+# (the loser's result send is never received), unless the result is small
+# enough to go eagerly: hence the small default sort size, and every
+# one-shot launch is killed after ONESHOT_TIMEOUT seconds (default 60).
+set -euo pipefail
+
+procs=4
+sizes="256 128 400"
+jobs=200
+oneshot=10
+csv=service.csv
+
+usage() {
+    sed -n '10p' "$0" | sed 's/^# //' >&2
+    exit 1
+}
+
+while getopts "p:n:j:k:o:" opt; do
+    case $opt in
+    p) procs=$OPTARG ;;
+    n) sizes=$OPTARG ;;
+    j) jobs=$OPTARG ;;
+    k) oneshot=$OPTARG ;;
+    o) csv=$OPTARG ;;
+    *) usage ;;
+    esac
+done
+read -r n_mv n_mm n_sort <<<"$sizes"
+[ -n "${n_sort:-}" ] || usage
+
+MPIRUN=${MPIRUN:-mpirun}
+read -r -a mpirun_flags <<<"${MPIRUN_FLAGS:-}"
+for b in mpisvcd mpisvc q1 q2 s7; do
+    [ -x "./$b" ] || { echo "service.sh: ./$b not built (see the Build lines)" >&2; exit 1; }
+done
+
+sock=$(mktemp -u /tmp/mpisvc.XXXXXX)
+"$MPIRUN" "${mpirun_flags[@]}" -np "$procs" ./mpisvcd -s "$sock" >/dev/null &
+svc_pid=$!
+trap './mpisvc -s "$sock" shutdown 2>/dev/null || kill $svc_pid 2>/dev/null; rm -f "$sock"' EXIT
+for _ in $(seq 300); do
+    [ -S "$sock" ] && break
+    sleep 0.1
+done
+[ -S "$sock" ] || { echo "service.sh: mpisvcd did not come up" >&2; exit 1; }
+
+# jobs/s of k one-shot launches of the given command
+oneshot_rate() {
+    local np=$1 t0 t1
+    shift
+    t0=$(date +%s.%N)
+    for ((i = 0; i < oneshot; i++)); do
+        timeout "${ONESHOT_TIMEOUT:-60}" "$MPIRUN" "${mpirun_flags[@]}" -np "$np" "$@" >/dev/null || {
+            echo "service.sh: one-shot run failed or timed out: $*" >&2
+            exit 1
+        }
+    done
+    t1=$(date +%s.%N)
+    awk -v k="$oneshot" -v a="$t0" -v b="$t1" 'BEGIN { printf "%.2f", k / (b - a) }'
+}
+
+echo "job,N,procs,service_jobs,service_jobs_per_s,service_ms,oneshot_jobs,oneshot_jobs_per_s,gain" | tee "$csv"
+for kind in matvec matmul sort; do
+    case $kind in
+    matvec) n=$n_mv; np=$procs; cmd=(./q1 "$n") ;;
+    matmul) n=$n_mm; np=$procs; cmd=(./q2 "$n") ;;
+    sort) n=$n_sort; np=3; cmd=(./s7 "$n") ;;
+    esac
+    ./mpisvc -s "$sock" -n "$n" -c "$kind" >/dev/null     # warm up, check once
+    line=$(./mpisvc -s "$sock" -n "$n" -j "$jobs" "$kind")
+    svc=$(awk '{ for (i = 1; i <= NF; i++) if ($(i + 1) == "jobs/s,") print $i }' <<<"$line")
+    svc_ms=$(awk '{ for (i = 1; i <= NF; i++) if ($i == "service") print $(i + 1) }' <<<"$line")
+    one=$(oneshot_rate "$np" "${cmd[@]}")
+    awk -v k="$kind" -v n="$n" -v p="$procs" -v j="$jobs" -v s="$svc" -v ms="$svc_ms" -v o="$oneshot" -v r="$one" \
+        'BEGIN { printf "%s,%d,%d,%d,%.1f,%s,%d,%.2f,%.1f\n", k, n, p, j, s, ms, o, r, s / r }' | tee -a "$csv"
+done
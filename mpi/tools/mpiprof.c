@@ -0,0 +1,497 @@
+// mpiprof.c
+// PMPI interposition library: per-call profile, wait-state analysis and a
+// deadlock watchdog for any of the MPI programs, without changing them.
+//
+// Build: mpicc -O2 -shared -fPIC -o libmpiprof.so mpiprof.c -lpthread
+// Use:   mpirun -np 2 -x LD_PRELOAD=$PWD/libmpiprof.so ./prog ...
+//   or link it in front of the MPI library:
+//        mpicc -O2 -o prog prog.c -L. -lmpiprof -Wl,-rpath,$PWD
+//
+// Every wrapped call below goes to the PMPI_ entry point, timed. At
+// MPI_Finalize rank 0 prints one table per rank: calls, bytes, time, and
+// the part of the time spent waiting on other ranks (the "wait" column):
+//   MPI_Recv, MPI_Sendrecv   late sender: time until the message arrived
+//                            (found by PMPI_Probe before the receive)
+//   MPI_Send                 late receiver: a send that blocks past the
+//                            eager limit is waiting for the receive to post
+//   MPI_Wait, MPI_Waitall,   the whole blocked time
+//   MPI_Waitany
+//   collectives              imbalance: time in a PMPI_Barrier entered just
+//                            before the collective, i.e. waiting for the
+//                            last rank to arrive (MPIPROF_SYNC=0 disables
+//                            the barrier; then wait stays 0)
+// MPI_Isend, MPI_Irecv and MPI_Ibcast only count their calls, bytes and
+// posting time and enter the pending table; MPI_Test, MPI_Testall and
+// MPI_Iprobe polls count calls and time. Requests leave the table when a
+// Wait* or Test* call completes them.
+//
+// Watchdog: a thread checks once a second whether this rank has been inside
+// one blocking MPI call for MPIPROF_TIMEOUT seconds (default 30, 0 = off).
+// If so it prints the blocked call and the table of pending nonblocking
+// requests to stderr and, unless MPIPROF_STALL=dump, exits the process so
+// mpirun takes the job down instead of hanging (e.g. mpi/A6/q3.c):
+//   [mpiprof] rank 1: no progress for 30.0 s, blocked in MPI_Recv(peer 0, tag 0, 4 bytes)
+//
+// Only single-threaded MPI use is tracked (MPI_THREAD_FUNNELED or less).
+#include <mpi.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+enum {
+    PF_SEND, PF_RECV, PF_ISEND, PF_IRECV, PF_WAIT, PF_WAITALL, PF_WAITANY, PF_TEST, PF_TESTALL, PF_IPROBE,
+    PF_SENDRECV, PF_BARRIER, PF_BCAST, PF_IBCAST, PF_REDUCE, PF_ALLREDUCE, PF_SCATTER, PF_SCATTERV, PF_GATHER,
+    PF_GATHERV, PF_ALLGATHER, PF_ALLTOALL, PF_ALLTOALLV, NFUNC
+};
+
+static const char *fn_name[NFUNC] = {
+    "MPI_Send", "MPI_Recv", "MPI_Isend", "MPI_Irecv", "MPI_Wait", "MPI_Waitall", "MPI_Waitany", "MPI_Test",
+    "MPI_Testall", "MPI_Iprobe", "MPI_Sendrecv", "MPI_Barrier", "MPI_Bcast", "MPI_Ibcast", "MPI_Reduce",
+    "MPI_Allreduce", "MPI_Scatter", "MPI_Scatterv", "MPI_Gather", "MPI_Gatherv", "MPI_Allgather", "MPI_Alltoall",
+    "MPI_Alltoallv"
+};
+
+typedef struct {
+    double calls, bytes, time, wait;    /* doubles: reduced with one PMPI_Gather */
+} prof_stat_t;
+
+typedef struct {
+    MPI_Request req;
+    int fn, peer, tag;
+    size_t bytes;
+    double t0;
+} prof_pending_t;
+
+#define PROF_MAX_PENDING 4096
+
+static prof_stat_t stats[NFUNC];
+static prof_pending_t pending[PROF_MAX_PENDING];
+static int npending, my_rank = -1, coll_sync = 1;
+static double t_init, timeout = 30.0;
+
+/* the blocking call in progress; shared with the watchdog */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct { int active, fn, peer, tag; size_t bytes; double t0; } cur;
+static pthread_t watchdog;
+static pthread_cond_t watchdog_cv = PTHREAD_COND_INITIALIZER;
+static int watchdog_stop;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+static size_t type_bytes(int count, MPI_Datatype type) {
+    int sz = 0;
+    if (count <= 0 || type == MPI_DATATYPE_NULL) return 0;
+    PMPI_Type_size(type, &sz);
+    return (size_t) count * sz;
+}
+
+static double enter(int fn, int peer, int tag, size_t bytes) {
+    double t = now();
+    pthread_mutex_lock(&lock);
+    cur.active = 1;
+    cur.fn = fn;
+    cur.peer = peer;
+    cur.tag = tag;
+    cur.bytes = bytes;
+    cur.t0 = t;
+    pthread_mutex_unlock(&lock);
+    return t;
+}
+
+static void leave(int fn, size_t bytes, double t0, double wait) {
+    double t = now() - t0;
+    pthread_mutex_lock(&lock);
+    cur.active = 0;
+    pthread_mutex_unlock(&lock);
+    stats[fn].calls += 1;
+    stats[fn].bytes += (double) bytes;
+    stats[fn].time += t;
+    stats[fn].wait += wait;
+}
+
+static void pending_add(MPI_Request req, int fn, int peer, int tag, size_t bytes) {
+    pthread_mutex_lock(&lock);
+    if (npending < PROF_MAX_PENDING)
+        pending[npending++] = (prof_pending_t) { req, fn, peer, tag, bytes, now() };
+    pthread_mutex_unlock(&lock);
+}
+
+static void pending_remove(MPI_Request req) {
+    pthread_mutex_lock(&lock);
+    for (int i = 0; i < npending; i++)
+        if (pending[i].req == req) {
+            pending[i] = pending[--npending];
+            break;
+        }
+    pthread_mutex_unlock(&lock);
+}
+
+// Called with the lock held
+static void dump_state(FILE *f, double t) {
+    fprintf(f, "[mpiprof] rank %d: no progress for %.1f s, blocked in %s(peer %d, tag %d, %zu bytes)\n",
+            my_rank, t - cur.t0, fn_name[cur.fn], cur.peer, cur.tag, cur.bytes);
+    fprintf(f, "[mpiprof] rank %d: %d pending nonblocking request%s\n", my_rank, npending, npending == 1 ? "" : "s");
+    for (int i = 0; i < npending; i++)
+        fprintf(f, "[mpiprof] rank %d:   %s(peer %d, tag %d, %zu bytes) posted %.1f s ago\n", my_rank,
+                fn_name[pending[i].fn], pending[i].peer, pending[i].tag, pending[i].bytes, t - pending[i].t0);
+    fflush(f);
+}
+
+static void *watchdog_main(void *arg) {
+    const char *mode = getenv("MPIPROF_STALL");
+    int dump_only = mode && strcmp(mode, "dump") == 0;
+    double reported = -1.0;
+    (void) arg;
+    pthread_mutex_lock(&lock);
+    while (!watchdog_stop) {
+        struct timespec wake;
+        clock_gettime(CLOCK_REALTIME, &wake);
+        wake.tv_sec += 1;
+        pthread_cond_timedwait(&watchdog_cv, &lock, &wake);
+        double t = now();
+        if (cur.active && t - cur.t0 > timeout && cur.t0 != reported) {
+            dump_state(stderr, t);
+            reported = cur.t0;      /* once per stalled call */
+            if (!dump_only) {
+                fprintf(stderr, "[mpiprof] rank %d: exiting (set MPIPROF_STALL=dump to keep waiting)\n", my_rank);
+                _exit(3);
+            }
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+static void prof_start(void) {
+    const char *s;
+    PMPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+    if ((s = getenv("MPIPROF_TIMEOUT"))) timeout = atof(s);
+    if ((s = getenv("MPIPROF_SYNC"))) coll_sync = atoi(s) != 0;
+    t_init = now();
+    if (timeout > 0.0 && pthread_create(&watchdog, NULL, watchdog_main, NULL) != 0) timeout = 0.0;
+}
+
+int MPI_Init(int *argc, char ***argv) {
+    int rc = PMPI_Init(argc, argv);
+    prof_start();
+    return rc;
+}
+
+int MPI_Init_thread(int *argc, char ***argv, int required, int *provided) {
+    int rc = PMPI_Init_thread(argc, argv, required, provided);
+    prof_start();
+    return rc;
+}
+
+int MPI_Finalize(void) {
+    double wall = now() - t_init, in_mpi = 0.0, wait = 0.0;
+    int size;
+    if (timeout > 0.0) {
+        pthread_mutex_lock(&lock);
+        watchdog_stop = 1;
+        pthread_cond_signal(&watchdog_cv);
+        pthread_mutex_unlock(&lock);
+        pthread_join(watchdog, NULL);
+    }
+    PMPI_Comm_size(MPI_COMM_WORLD, &size);
+    for (int f = 0; f < NFUNC; f++) {
+        in_mpi += stats[f].time;
+        wait += stats[f].wait;
+    }
+
+    double mine[4 * NFUNC + 3], *all = NULL;
+    memcpy(mine, stats, sizeof(stats));
+    mine[4 * NFUNC] = wall;
+    mine[4 * NFUNC + 1] = in_mpi;
+    mine[4 * NFUNC + 2] = wait;
+    if (my_rank == 0) all = malloc((size_t) size * sizeof(mine));
+    PMPI_Gather(mine, 4 * NFUNC + 3, MPI_DOUBLE, all, 4 * NFUNC + 3, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+
+    if (my_rank == 0) {
+        for (int p = 0; p < size; p++) {
+            const double *r = all + (size_t) p * (4 * NFUNC + 3);
+            const prof_stat_t *st = (const prof_stat_t *) r;
+            double w = r[4 * NFUNC], m = r[4 * NFUNC + 1];
+            printf("[mpiprof] rank %d: %.6f s in MPI of %.6f s (%.1f%%), %.6f s waiting on other ranks\n",
+                   p, m, w, w > 0 ? 100.0 * m / w : 0.0, r[4 * NFUNC + 2]);
+            printf("[mpiprof] %-14s %10s %14s %12s %12s\n", "call", "count", "bytes", "time_s", "wait_s");
+            for (int f = 0; f < NFUNC; f++)
+                if (st[f].calls > 0)
+                    printf("[mpiprof] %-14s %10.0f %14.0f %12.6f %12.6f\n", fn_name[f],
+                           st[f].calls, st[f].bytes, st[f].time, st[f].wait);
+        }
+        fflush(stdout);
+        free(all);
+    }
+    return PMPI_Finalize();
+}
+
+/* ---- point to point ---- */
+
+int MPI_Send(const void *buf, int count, MPI_Datatype type, int dest, int tag, MPI_Comm comm) {
+    size_t b = type_bytes(count, type);
+    double t0 = enter(PF_SEND, dest, tag, b);
+    int rc = PMPI_Send(buf, count, type, dest, tag, comm);
+    double t = now() - t0;
+    /* an eager send returns after a copy; anything longer than ~20 us plus
+     * 1 ns/byte is the receiver not being there yet */
+    double expect = 20e-6 + 1e-9 * (double) b;
+    leave(PF_SEND, b, t0, t > expect ? t - expect : 0.0);
+    return rc;
+}
+
+int MPI_Recv(void *buf, int count, MPI_Datatype type, int source, int tag, MPI_Comm comm, MPI_Status *status) {
+    MPI_Status st;
+    size_t b = type_bytes(count, type);
+    double t0 = enter(PF_RECV, source, tag, b);
+    /* Probe returns once the envelope is here, i.e. once the sender started;
+     * receiving the probed source/tag keeps the match identical */
+    int rc = PMPI_Probe(source, tag, comm, &st);
+    double arrived = now();
+    if (rc == MPI_SUCCESS)
+        rc = PMPI_Recv(buf, count, type, st.MPI_SOURCE, st.MPI_TAG, comm, status);
+    leave(PF_RECV, b, t0, arrived - t0);
+    return rc;
+}
+
+int MPI_Sendrecv(const void *sbuf, int scount, MPI_Datatype stype, int dest, int stag,
+                 void *rbuf, int rcount, MPI_Datatype rtype, int source, int rtag,
+                 MPI_Comm comm, MPI_Status *status) {
+    size_t b = type_bytes(scount, stype) + type_bytes(rcount, rtype);
+    double t0 = enter(PF_SENDRECV, source, rtag, b);
+    MPI_Request sreq;
+    MPI_Status st;
+    /* send first, then time the arrival of the incoming message */
+    int rc = PMPI_Isend(sbuf, scount, stype, dest, stag, comm, &sreq);
+    if (rc == MPI_SUCCESS) rc = PMPI_Probe(source, rtag, comm, &st);
+    double arrived = now();
+    if (rc == MPI_SUCCESS) rc = PMPI_Recv(rbuf, rcount, rtype, st.MPI_SOURCE, st.MPI_TAG, comm, status);
+    if (rc == MPI_SUCCESS) rc = PMPI_Wait(&sreq, MPI_STATUS_IGNORE);
+    leave(PF_SENDRECV, b, t0, arrived - t0);
+    return rc;
+}
+
+int MPI_Isend(const void *buf, int count, MPI_Datatype type, int dest, int tag, MPI_Comm comm, MPI_Request *req) {
+    size_t b = type_bytes(count, type);
+    double t0 = now();
+    int rc = PMPI_Isend(buf, count, type, dest, tag, comm, req);
+    stats[PF_ISEND].calls += 1;
+    stats[PF_ISEND].bytes += (double) b;
+    stats[PF_ISEND].time += now() - t0;
+    if (rc == MPI_SUCCESS) pending_add(*req, PF_ISEND, dest, tag, b);
+    return rc;
+}
+
+int MPI_Irecv(void *buf, int count, MPI_Datatype type, int source, int tag, MPI_Comm comm, MPI_Request *req) {
+    size_t b = type_bytes(count, type);
+    double t0 = now();
+    int rc = PMPI_Irecv(buf, count, type, source, tag, comm, req);
+    stats[PF_IRECV].calls += 1;
+    stats[PF_IRECV].bytes += (double) b;
+    stats[PF_IRECV].time += now() - t0;
+    if (rc == MPI_SUCCESS) pending_add(*req, PF_IRECV, source, tag, b);
+    return rc;
+}
+
+int MPI_Wait(MPI_Request *req, MPI_Status *status) {
+    MPI_Request r = *req;
+    double t0 = enter(PF_WAIT, -1, -1, 0);
+    int rc = PMPI_Wait(req, status);
+    leave(PF_WAIT, 0, t0, now() - t0);
+    pending_remove(r);
+    return rc;
+}
+
+int MPI_Waitall(int count, MPI_Request reqs[], MPI_Status statuses[]) {
+    MPI_Request small[64], *r = count <= 64 ? small : malloc((size_t) count * sizeof(MPI_Request));
+    memcpy(r, reqs, (size_t) count * sizeof(MPI_Request));
+    double t0 = enter(PF_WAITALL, -1, -1, 0);
+    int rc = PMPI_Waitall(count, reqs, statuses);
+    leave(PF_WAITALL, 0, t0, now() - t0);
+    for (int i = 0; i < count; i++) pending_remove(r[i]);
+    if (r != small) free(r);
+    return rc;
+}
+
+int MPI_Test(MPI_Request *req, int *flag, MPI_Status *status) {
+    MPI_Request r = *req;
+    double t0 = now();
+    int rc = PMPI_Test(req, flag, status);
+    stats[PF_TEST].calls += 1;
+    stats[PF_TEST].time += now() - t0;
+    if (*flag) pending_remove(r);
+    return rc;
+}
+
+int MPI_Testall(int count, MPI_Request reqs[], int *flag, MPI_Status statuses[]) {
+    MPI_Request small[64], *r = count <= 64 ? small : malloc((size_t) count * sizeof(MPI_Request));
+    memcpy(r, reqs, (size_t) count * sizeof(MPI_Request));
+    double t0 = now();
+    int rc = PMPI_Testall(count, reqs, flag, statuses);
+    stats[PF_TESTALL].calls += 1;
+    stats[PF_TESTALL].time += now() - t0;
+    if (*flag)
+        for (int i = 0; i < count; i++) pending_remove(r[i]);
+    if (r != small) free(r);
+    return rc;
+}
+
+int MPI_Waitany(int count, MPI_Request reqs[], int *index, MPI_Status *status) {
+    MPI_Request small[64], *r = count <= 64 ? small : malloc((size_t) count * sizeof(MPI_Request));
+    memcpy(r, reqs, (size_t) count * sizeof(MPI_Request));
+    double t0 = enter(PF_WAITANY, -1, -1, 0);
+    int rc = PMPI_Waitany(count, reqs, index, status);
+    leave(PF_WAITANY, 0, t0, now() - t0);
+    if (*index != MPI_UNDEFINED) pending_remove(r[*index]);
+    if (r != small) free(r);
+    return rc;
+}
+
+int MPI_Iprobe(int source, int tag, MPI_Comm comm, int *flag, MPI_Status *status) {
+    double t0 = now();
+    int rc = PMPI_Iprobe(source, tag, comm, flag, status);
+    stats[PF_IPROBE].calls += 1;
+    stats[PF_IPROBE].time += now() - t0;
+    return rc;
+}
+
+/* ---- collectives: optional barrier first to measure the imbalance ---- */
+
+static double coll_enter(int fn, size_t bytes, int root, MPI_Comm comm, double *wait) {
+    double t0 = enter(fn, root, -1, bytes);
+    *wait = 0.0;
+    if (coll_sync) {
+        PMPI_Barrier(comm);
+        *wait = now() - t0;
+    }
+    return t0;
+}
+
+int MPI_Barrier(MPI_Comm comm) {
+    double t0 = enter(PF_BARRIER, -1, -1, 0);
+    int rc = PMPI_Barrier(comm);
+    double t = now() - t0;
+    leave(PF_BARRIER, 0, t0, t);     /* a barrier is all waiting */
+    return rc;
+}
+
+int MPI_Bcast(void *buf, int count, MPI_Datatype type, int root, MPI_Comm comm) {
+    double w;
+    size_t b = type_bytes(count, type);
+    double t0 = coll_enter(PF_BCAST, b, root, comm, &w);
+    int rc = PMPI_Bcast(buf, count, type, root, comm);
+    leave(PF_BCAST, b, t0, w);
+    return rc;
+}
+
+/* nonblocking: no barrier (it would make the call blocking), tracked as pending */
+int MPI_Ibcast(void *buf, int count, MPI_Datatype type, int root, MPI_Comm comm, MPI_Request *req) {
+    size_t b = type_bytes(count, type);
+    double t0 = now();
+    int rc = PMPI_Ibcast(buf, count, type, root, comm, req);
+    stats[PF_IBCAST].calls += 1;
+    stats[PF_IBCAST].bytes += (double) b;
+    stats[PF_IBCAST].time += now() - t0;
+    if (rc == MPI_SUCCESS) pending_add(*req, PF_IBCAST, root, -1, b);
+    return rc;
+}
+
+int MPI_Reduce(const void *sbuf, void *rbuf, int count, MPI_Datatype type, MPI_Op op, int root, MPI_Comm comm) {
+    double w;
+    size_t b = type_bytes(count, type);
+    double t0 = coll_enter(PF_REDUCE, b, root, comm, &w);
+    int rc = PMPI_Reduce(sbuf, rbuf, count, type, op, root, comm);
+    leave(PF_REDUCE, b, t0, w);
+    return rc;
+}
+
+int MPI_Allreduce(const void *sbuf, void *rbuf, int count, MPI_Datatype type, MPI_Op op, MPI_Comm comm) {
+    double w;
+    size_t b = type_bytes(count, type);
+    double t0 = coll_enter(PF_ALLREDUCE, b, -1, comm, &w);
+    int rc = PMPI_Allreduce(sbuf, rbuf, count, type, op, comm);
+    leave(PF_ALLREDUCE, b, t0, w);
+    return rc;
+}
+
+int MPI_Scatter(const void *sbuf, int scount, MPI_Datatype stype, void *rbuf, int rcount, MPI_Datatype rtype,
+                int root, MPI_Comm comm) {
+    double w;
+    size_t b = type_bytes(rcount, rtype);
+    double t0 = coll_enter(PF_SCATTER, b, root, comm, &w);
+    int rc = PMPI_Scatter(sbuf, scount, stype, rbuf, rcount, rtype, root, comm);
+    leave(PF_SCATTER, b, t0, w);
+    return rc;
+}
+
+int MPI_Scatterv(const void *sbuf, const int scounts[], const int displs[], MPI_Datatype stype,
+                 void *rbuf, int rcount, MPI_Datatype rtype, int root, MPI_Comm comm) {
+    double w;
+    size_t b = type_bytes(rcount, rtype);
+    double t0 = coll_enter(PF_SCATTERV, b, root, comm, &w);
+    int rc = PMPI_Scatterv(sbuf, scounts, displs, stype, rbuf, rcount, rtype, root, comm);
+    leave(PF_SCATTERV, b, t0, w);
+    return rc;
+}
+
+int MPI_Gather(const void *sbuf, int scount, MPI_Datatype stype, void *rbuf, int rcount, MPI_Datatype rtype,
+               int root, MPI_Comm comm) {
+    double w;
+    size_t b = type_bytes(scount, stype);
+    double t0 = coll_enter(PF_GATHER, b, root, comm, &w);
+    int rc = PMPI_Gather(sbuf, scount, stype, rbuf, rcount, rtype, root, comm);
+    leave(PF_GATHER, b, t0, w);
+    return rc;
+}
+
+int MPI_Gatherv(const void *sbuf, int scount, MPI_Datatype stype, void *rbuf, const int rcounts[],
+                const int displs[], MPI_Datatype rtype, int root, MPI_Comm comm) {
+    double w;
+    size_t b = type_bytes(scount, stype);
+    double t0 = coll_enter(PF_GATHERV, b, root, comm, &w);
+    int rc = PMPI_Gatherv(sbuf, scount, stype, rbuf, rcounts, displs, rtype, root, comm);
+    leave(PF_GATHERV, b, t0, w);
+    return rc;
+}
+
+int MPI_Allgather(const void *sbuf, int scount, MPI_Datatype stype, void *rbuf, int rcount, MPI_Datatype rtype,
+                  MPI_Comm comm) {
+    double w;
+    size_t b = type_bytes(scount, stype);
+    double t0 = coll_enter(PF_ALLGATHER, b, -1, comm, &w);
+    int rc = PMPI_Allgather(sbuf, scount, stype, rbuf, rcount, rtype, comm);
+    leave(PF_ALLGATHER, b, t0, w);
+    return rc;
+}
+
+int MPI_Alltoall(const void *sbuf, int scount, MPI_Datatype stype, void *rbuf, int rcount, MPI_Datatype rtype,
+                 MPI_Comm comm) {
+    double w;
+    int size;
+    PMPI_Comm_size(comm, &size);
+    size_t b = type_bytes(scount, stype) * size;
+    double t0 = coll_enter(PF_ALLTOALL, b, -1, comm, &w);
+    int rc = PMPI_Alltoall(sbuf, scount, stype, rbuf, rcount, rtype, comm);
+    leave(PF_ALLTOALL, b, t0, w);
+    return rc;
+}
+
+int MPI_Alltoallv(const void *sbuf, const int scounts[], const int sdispls[], MPI_Datatype stype, void *rbuf,
+                  const int rcounts[], const int rdispls[], MPI_Datatype rtype, MPI_Comm comm) {
+    double w;
+    int size;
+    PMPI_Comm_size(comm, &size);
+    size_t b = 0;
+    for (int p = 0; p < size; p++) b += type_bytes(scounts[p], stype);
+    double t0 = coll_enter(PF_ALLTOALLV, b, -1, comm, &w);
+    int rc = PMPI_Alltoallv(sbuf, scounts, sdispls, stype, rbuf, rcounts, rdispls, rtype, comm);
+    leave(PF_ALLTOALLV, b, t0, w);
+    return rc;
+}
@@ -0,0 +1,188 @@
+// mpisvc.c
+// Client of the mpisvcd compute service (plain C, no MPI needed).
+//
+// Build: gcc -O2 -o mpisvc mpisvc.c
+// Run:   ./mpisvc [-s socket] [-n N] [-j jobs] [-c] [-o result.bin] ping|matvec|matmul|sort|shutdown
+//
+// Sends the same job -j times over one connection and reports jobs/s, the
+// client-side latency per job and the service time the server measured.
+// Inputs are generated as in the one-shot programs: A and x / B with the
+// drand of mpi/A7/q1.c and q2.c, the sort keys with srand(12345) + rand()
+// as mpi/A9/s7.c.
+//   -c  check the first result against a serial computation here
+//   -o  write the first result as raw bytes
+// The socket defaults to $MPISVC_SOCKET, then /tmp/mpisvc.sock.
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mpisvc.h"
+
+static double drand(size_t seed) {
+    unsigned int x = (unsigned int) seed;
+    x = (1103515245u * x + 12345u) & 0x7fffffff;
+    return (double)(x % 1000) / 1000.0;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int cmp_long(const void *a, const void *b) {
+    long x = *(const long *) a, y = *(const long *) b;
+    return (x > y) - (x < y);
+}
+
+static int svc_connect(const char *path) {
+    struct sockaddr_un addr;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof addr.sun_path - 1);
+    if (connect(fd, (struct sockaddr *) &addr, sizeof addr) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Input of a job of size n, laid out as mpisvc.h describes */
+static void *make_input(int op, size_t n) {
+    void *in = malloc(svc_in_bytes(op, n) + 1);
+    if (!in) return NULL;
+    if (op == SVC_MATVEC || op == SVC_MATMUL) {
+        double *A = in, *rest = A + n * n;
+        for (size_t i = 0; i < n; i++)
+            for (size_t j = 0; j < n; j++) A[i * n + j] = drand(i * n + j + 1);
+        if (op == SVC_MATVEC)
+            for (size_t i = 0; i < n; i++) rest[i] = drand(i + 12345);
+        else
+            for (size_t i = 0; i < n; i++)
+                for (size_t j = 0; j < n; j++) rest[i * n + j] = drand(i + j + 12345);
+    } else if (op == SVC_SORT) {
+        long *a = in;
+        srand(12345);
+        for (size_t i = 0; i < n; i++) a[i] = rand();
+    }
+    return in;
+}
+
+/* Serial reference; returns 0 if out matches */
+static int check(int op, size_t n, const void *in, const void *out) {
+    if (op == SVC_SORT) {
+        long *ref = malloc(n * sizeof(long) + 1);
+        memcpy(ref, in, n * sizeof(long));
+        qsort(ref, n, sizeof(long), cmp_long);
+        int bad = memcmp(ref, out, n * sizeof(long)) != 0;
+        printf("check: %s\n", bad ? "NOT the sorted input" : "sorted permutation of the input");
+        free(ref);
+        return bad;
+    }
+    if (op != SVC_MATVEC && op != SVC_MATMUL) return 0;
+    const double *A = in, *B = A + n * n, *r = out;
+    size_t cols = op == SVC_MATVEC ? 1 : n;
+    double max_diff = 0.0;
+    for (size_t i = 0; i < n; i++)
+        for (size_t j = 0; j < cols; j++) {
+            double s = 0.0;
+            for (size_t k = 0; k < n; k++) s += A[i * n + k] * B[k * cols + j];
+            double d = fabs(s - r[i * cols + j]);
+            if (d > max_diff) max_diff = d;
+        }
+    /* summation order differs (blocked gemm): allow rounding, relative to n */
+    int bad = max_diff > 1e-12 * n * n;
+    printf("check: max_abs_diff = %.3e%s\n", max_diff, bad ? " (FAILED)" : "");
+    return bad;
+}
+
+int main(int argc, char **argv) {
+    int opt, jobs = 1, do_check = 0;
+    size_t n = 256;
+    const char *path = NULL, *out_path = NULL;
+    while ((opt = getopt(argc, argv, "s:n:j:co:")) != -1) {
+        switch (opt) {
+        case 's': path = optarg; break;
+        case 'n': n = strtoull(optarg, NULL, 10); break;
+        case 'j': jobs = atoi(optarg); break;
+        case 'c': do_check = 1; break;
+        case 'o': out_path = optarg; break;
+        default: argc = 0; break;
+        }
+    }
+    int op = -1;
+    for (int k = 0; argc > optind && k < SVC_NOPS; k++)
+        if (strcmp(argv[optind], svc_op_name[k]) == 0) op = k;
+    if (op < 0 || jobs < 1) {
+        fprintf(stderr, "Usage: %s [-s socket] [-n N] [-j jobs] [-c] [-o result.bin] ping|matvec|matmul|sort|shutdown\n",
+                argv[0]);
+        return 1;
+    }
+    if (op == SVC_SHUTDOWN) jobs = 1;
+    path = svc_socket_path(path);
+    signal(SIGPIPE, SIG_IGN);
+
+    int fd = svc_connect(path);
+    if (fd < 0) {
+        fprintf(stderr, "mpisvc: cannot connect to %s (is mpisvcd running?)\n", path);
+        return 1;
+    }
+    void *in = make_input(op, n), *out = malloc(svc_out_bytes(op, n) + 1);
+    if (!in || !out) {
+        fprintf(stderr, "mpisvc: out of memory\n");
+        return 1;
+    }
+
+    svc_req_t req = { SVC_MAGIC, (uint32_t) op, n };
+    double lat_sum = 0.0, lat_min = 1e30, svc_sum = 0.0, t_all = now();
+    int failed = 0;
+    for (int j = 0; j < jobs && !failed; j++) {
+        double t0 = now(), svc_time = 0.0;
+        svc_rep_t rep;
+        /* a refused request is answered and closed before its payload is
+           read, so a failed write may still have a reply behind it */
+        if (svc_write(fd, &req, sizeof req) == 0) svc_write(fd, in, svc_in_bytes(op, n));
+        if (svc_read(fd, &rep, sizeof rep) != 0 || rep.magic != SVC_MAGIC) {
+            fprintf(stderr, "mpisvc: connection lost\n");
+            return 1;
+        }
+        if (rep.status != SVC_OK) {
+            fprintf(stderr, "mpisvc: job refused (%s)\n", rep.status == SVC_ENOMEM ? "out of memory" : "bad request");
+            return 1;
+        }
+        if (rep.bytes != svc_out_bytes(op, n) || svc_read(fd, out, rep.bytes) != 0 || svc_read(fd, &svc_time, sizeof svc_time) != 0) {
+            fprintf(stderr, "mpisvc: connection lost\n");
+            return 1;
+        }
+        double lat = now() - t0;
+        lat_sum += lat;
+        svc_sum += svc_time;
+        if (lat < lat_min) lat_min = lat;
+        if (j == 0 && do_check) failed = check(op, n, in, out);
+        if (j == 0 && out_path) {
+            FILE *f = fopen(out_path, "wb");
+            if (!f || fwrite(out, 1, rep.bytes, f) != rep.bytes) {
+                fprintf(stderr, "mpisvc: cannot write %s\n", out_path);
+                failed = 1;
+            }
+            if (f) fclose(f);
+        }
+    }
+    t_all = now() - t_all;
+    close(fd);
+
+    if (op != SVC_SHUTDOWN && !failed)
+        printf("%s n=%zu jobs=%d: %.1f jobs/s, latency mean %.3f ms min %.3f ms, service %.3f ms\n",
+               svc_op_name[op], n, jobs, jobs / t_all, lat_sum / jobs * 1e3, lat_min * 1e3, svc_sum / jobs * 1e3);
+    free(in);
+    free(out);
+    return failed;
+}
@@ -0,0 +1,99 @@
+// mpisvc.h
+// Wire protocol between the mpisvcd service and the mpisvc client, over a
+// local Unix domain stream socket, host byte order.
+//
+//   client -> server   svc_req_t, then the input payload
+//   server -> client   svc_rep_t; with status 0 it is followed by rep.bytes
+//                      of result, streamed as the ranks deliver it, and a
+//                      double: the service time in seconds, from the end of
+//                      the request header to the last result byte
+//
+// Jobs (n is the problem size):
+//   SVC_PING      no input, no result: the fixed cost of one job
+//   SVC_MATVEC    A (n x n doubles, row-major), x (n)   ->  y = A x (n)
+//   SVC_MATMUL    A, B (n x n doubles each)             ->  C = A B (n x n)
+//   SVC_SORT      n longs                               ->  the same, sorted
+//   SVC_SHUTDOWN  no input: the service finishes the current job and exits
+//
+// A connection can carry any number of jobs, one after another. A request
+// the service cannot run (unknown op, bad magic, too large) gets a non-zero
+// status and the connection is closed, since its payload was not read.
+#ifndef MPISVC_H
+#define MPISVC_H
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define SVC_MAGIC 0x4d505356u   /* "MPSV" */
+#define SVC_SOCKET_ENV "MPISVC_SOCKET"
+#define SVC_SOCKET_DEFAULT "/tmp/mpisvc.sock"
+#define SVC_MAX_N 100000000ULL  /* bound on n, rejects garbage sizes */
+
+enum { SVC_PING, SVC_MATVEC, SVC_MATMUL, SVC_SORT, SVC_SHUTDOWN, SVC_NOPS };
+
+static const char *const svc_op_name[SVC_NOPS] = { "ping", "matvec", "matmul", "sort", "shutdown" };
+
+enum { SVC_OK, SVC_EBADREQ, SVC_ENOMEM };
+
+typedef struct {
+    uint32_t magic, op;
+    uint64_t n;
+} svc_req_t;
+
+typedef struct {
+    uint32_t magic, status;
+    uint64_t bytes;             /* result bytes that follow */
+} svc_rep_t;
+
+/* Input and result sizes in bytes of a job of size n */
+static inline uint64_t svc_in_bytes(uint32_t op, uint64_t n) {
+    switch (op) {
+    case SVC_MATVEC: return (n * n + n) * sizeof(double);
+    case SVC_MATMUL: return 2 * n * n * sizeof(double);
+    case SVC_SORT: return n * sizeof(long);
+    default: return 0;
+    }
+}
+
+static inline uint64_t svc_out_bytes(uint32_t op, uint64_t n) {
+    switch (op) {
+    case SVC_MATVEC: return n * sizeof(double);
+    case SVC_MATMUL: return n * n * sizeof(double);
+    case SVC_SORT: return n * sizeof(long);
+    default: return 0;
+    }
+}
+
+/* Full read / write on a stream socket; 0 on success, -1 on error or EOF */
+static inline int svc_read(int fd, void *buf, size_t len) {
+    char *p = (char *) buf;
+    while (len > 0) {
+        ssize_t k = read(fd, p, len);
+        if (k < 0 && errno == EINTR) continue;
+        if (k <= 0) return -1;
+        p += k;
+        len -= (size_t) k;
+    }
+    return 0;
+}
+
+static inline int svc_write(int fd, const void *buf, size_t len) {
+    const char *p = (const char *) buf;
+    while (len > 0) {
+        ssize_t k = write(fd, p, len);
+        if (k < 0 && errno == EINTR) continue;
+        if (k <= 0) return -1;
+        p += k;
+        len -= (size_t) k;
+    }
+    return 0;
+}
+
+static inline const char *svc_socket_path(const char *opt) {
+    const char *env = getenv(SVC_SOCKET_ENV);
+    return opt ? opt : env ? env : SVC_SOCKET_DEFAULT;
+}
+
+#endif /* MPISVC_H */
@@ -0,0 +1,409 @@
+// mpisvcd.c
+// Long-running MPI compute service: start the world once, then run any
+// number of small matvec / matmul / sort jobs sent by mpisvc clients over a
+// local Unix domain socket, without paying mpirun, MPI_Init and buffer
+// allocation per job.
+//
+// Build: mpicc -O2 -march=native -o mpisvcd mpisvcd.c
+// Run:   mpirun -np 4 ./mpisvcd [-s socket] [-v] &
+//        ./mpisvc -n 256 -j 1000 matvec          (see mpisvc.c)
+//        ./mpisvc shutdown
+//
+// Rank 0 accepts one connection at a time and reads each job (header and
+// input) completely before the other ranks hear of it, so a client that
+// disappears mid-request never leaves the world half way through a
+// collective. The job header is then broadcast and all ranks run it:
+//   matvec   x broadcast, rows of A scattered, y = A x per row block (as
+//            mpi/A7/q1.c)
+//   matmul   B broadcast, rows of A scattered, C = A B with gemm.h
+//   sort     parallel sort by regular sampling: local sort, P - 1 samples
+//            per rank, splitters from the gathered samples, one Alltoallv,
+//            local sort of the received runs
+// Results stream back: rank 0 writes its own block to the socket while the
+// next rank's block is already being received, so the client sees the
+// first bytes before the last rank has sent.
+//
+// What stays warm between jobs: the communicator (a dup of
+// MPI_COMM_WORLD), the row layout and row datatype of the last n, and every
+// buffer, which only grows. Ranks waiting for the next job poll the
+// broadcast with a backoff up to SVC_IDLE_MAX_US, so an idle service does
+// not keep cores busy; the first job after a pause pays at most that much.
+#include <mpi.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../../common/gemm.h"
+#include "mpisvc.h"
+
+#define SVC_IDLE_SPINS 1000
+#define SVC_IDLE_MAX_US 1000
+#define SVC_TAG 7401
+
+/* Grow-only aligned buffer */
+typedef struct {
+    void *p;
+    size_t cap;
+} wbuf_t;
+
+static void *wbuf_get(wbuf_t *b, size_t bytes) {
+    if (bytes <= b->cap) return b->p;
+    void *p = NULL;
+    if (posix_memalign(&p, 64, bytes) != 0) return NULL;
+    free(b->p);
+    b->p = p;
+    b->cap = bytes;
+    return p;
+}
+
+typedef struct {
+    MPI_Comm comm;
+    int rank, size;
+    int n;                      /* problem size the layout is for, -1 none */
+    int *counts, *displs;       /* block of rows (or elements) per rank */
+    MPI_Datatype rowtype;       /* n doubles */
+    wbuf_t in, a, b, c, x, tmp[2];
+    int fd, fd_ok;              /* rank 0: client connection, still writable */
+    long jobs;
+    double busy;
+} svc_t;
+
+static void svc_layout(svc_t *s, int n) {
+    if (n == s->n) return;
+    if (s->n >= 0) MPI_Type_free(&s->rowtype);
+    MPI_Type_contiguous(n > 0 ? n : 1, MPI_DOUBLE, &s->rowtype);
+    MPI_Type_commit(&s->rowtype);
+    int base = n / s->size, rem = n % s->size;
+    for (int p = 0, off = 0; p < s->size; p++) {
+        s->counts[p] = base + (p < rem ? 1 : 0);
+        s->displs[p] = off;
+        off += s->counts[p];
+    }
+    s->n = n;
+}
+
+/* Rank 0: write to the client unless it has gone; the job runs on regardless */
+static void svc_put(svc_t *s, const void *buf, size_t len) {
+    if (s->fd_ok && svc_write(s->fd, buf, len) != 0) s->fd_ok = 0;
+}
+
+static void svc_reply(svc_t *s, uint32_t status, uint64_t bytes) {
+    svc_rep_t rep = { SVC_MAGIC, status, bytes };
+    svc_put(s, &rep, sizeof rep);
+}
+
+/*
+ * Stream the blocks of all ranks to the client in rank order: this rank
+ * holds nlocal units of ubytes bytes of type unit, cnt[p] (significant at
+ * rank 0 only) is the count of rank p. Rank 0 writes block p while block
+ * p + 1 is received.
+ */
+static void svc_stream(svc_t *s, const void *local, int nlocal, const int *cnt, MPI_Datatype unit,
+                       size_t ubytes) {
+    if (s->rank != 0) {
+        MPI_Send(local, nlocal, unit, 0, SVC_TAG, s->comm);
+        return;
+    }
+    size_t most = 0;
+    for (int p = 1; p < s->size; p++)
+        if ((size_t) cnt[p] > most) most = cnt[p];
+    char *buf[2] = { wbuf_get(&s->tmp[0], most * ubytes + 1), wbuf_get(&s->tmp[1], most * ubytes + 1) };
+    if (!buf[0] || !buf[1]) {
+        fprintf(stderr, "mpisvcd: out of memory for the result stream\n");
+        MPI_Abort(s->comm, 1);
+    }
+    MPI_Request req = MPI_REQUEST_NULL;
+    if (s->size > 1) MPI_Irecv(buf[1], cnt[1], unit, 1, SVC_TAG, s->comm, &req);
+    svc_put(s, local, (size_t) nlocal * ubytes);
+    for (int p = 1; p < s->size; p++) {
+        MPI_Wait(&req, MPI_STATUS_IGNORE);
+        if (p + 1 < s->size) MPI_Irecv(buf[(p + 1) & 1], cnt[p + 1], unit, p + 1, SVC_TAG, s->comm, &req);
+        svc_put(s, buf[p & 1], (size_t) cnt[p] * ubytes);
+    }
+}
+
+/* ---- jobs: input in s->in on rank 0, result streamed by svc_stream ---- */
+
+static void job_matvec(svc_t *s, int n) {
+    int m = s->counts[s->rank];
+    double *in = s->in.p, *A = s->a.p, *y = s->c.p;
+    double *x = s->rank == 0 ? in + (size_t) n * n : s->x.p;     /* root: in place */
+    MPI_Bcast(x, n, MPI_DOUBLE, 0, s->comm);
+    MPI_Scatterv(in, s->counts, s->displs, s->rowtype, A, m, s->rowtype, 0, s->comm);
+    for (int i = 0; i < m; i++) {
+        const double *row = A + (size_t) i * n;
+        double sum = 0.0;
+        for (int j = 0; j < n; j++) sum += row[j] * x[j];
+        y[i] = sum;
+    }
+    svc_stream(s, y, m, s->counts, MPI_DOUBLE, sizeof(double));
+}
+
+static void job_matmul(svc_t *s, int n) {
+    int m = s->counts[s->rank];
+    double *in = s->in.p, *A = s->a.p, *C = s->c.p;
+    double *B = s->rank == 0 ? in + (size_t) n * n : s->b.p;
+    MPI_Bcast(B, n, s->rowtype, 0, s->comm);
+    MPI_Scatterv(in, s->counts, s->displs, s->rowtype, A, m, s->rowtype, 0, s->comm);
+    memset(C, 0, (size_t) m * n * sizeof(double));
+    gemm(m, n, n, A, n, B, n, C, n);
+    svc_stream(s, C, m, s->counts, s->rowtype, (size_t) n * sizeof(double));
+}
+
+static int cmp_long(const void *a, const void *b) {
+    long x = *(const long *) a, y = *(const long *) b;
+    return (x > y) - (x < y);
+}
+
+/* First index in sorted a[0, n) with a[i] > key */
+static int upper_bound(const long *a, int n, long key) {
+    int lo = 0, hi = n;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (a[mid] <= key) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static void job_sort(svc_t *s) {
+    int P = s->size, m = s->counts[s->rank];
+    long *a = s->a.p;
+    MPI_Scatterv(s->in.p, s->counts, s->displs, MPI_LONG, a, m, MPI_LONG, 0, s->comm);
+    qsort(a, m, sizeof(long), cmp_long);
+
+    int *sc = malloc(4 * P * sizeof(int)), *sd = sc + P, *rc = sc + 2 * P, *rd = sc + 3 * P;
+    int total = m;
+    if (P > 1) {
+        /* regular samples (empty blocks sample +inf), splitters from all of them */
+        long *smp = malloc((size_t) P * (P - 1) * sizeof(long)), *mine = malloc((P - 1) * sizeof(long));
+        for (int i = 1; i < P; i++) mine[i - 1] = m > 0 ? a[(size_t) i * m / P] : LONG_MAX;
+        MPI_Allgather(mine, P - 1, MPI_LONG, smp, P - 1, MPI_LONG, s->comm);
+        qsort(smp, (size_t) P * (P - 1), sizeof(long), cmp_long);
+        for (int j = 0, lo = 0; j < P; j++) {
+            int hi = j < P - 1 ? upper_bound(a, m, smp[(size_t) (j + 1) * (P - 1) - 1]) : m;
+            if (hi < lo) hi = lo;
+            sd[j] = lo;
+            sc[j] = hi - lo;
+            lo = hi;
+        }
+        MPI_Alltoall(sc, 1, MPI_INT, rc, 1, MPI_INT, s->comm);
+        total = 0;
+        for (int j = 0; j < P; j++) {
+            rd[j] = total;
+            total += rc[j];
+        }
+        long *b = wbuf_get(&s->b, (size_t) (total ? total : 1) * sizeof(long));
+        if (!b) {
+            fprintf(stderr, "mpisvcd: rank %d out of memory in sort\n", s->rank);
+            MPI_Abort(s->comm, 1);
+        }
+        MPI_Alltoallv(a, sc, sd, MPI_LONG, b, rc, rd, MPI_LONG, s->comm);
+        qsort(b, total, sizeof(long), cmp_long);
+        a = b;
+        free(smp);
+        free(mine);
+    }
+    MPI_Gather(&total, 1, MPI_INT, rc, 1, MPI_INT, 0, s->comm);
+    svc_stream(s, a, total, rc, MPI_LONG, sizeof(long));
+    free(sc);
+}
+
+/* Reserve the buffers of a job on this rank; 0 if they could not be had */
+static int svc_reserve(svc_t *s, int op, int n) {
+    size_t m = (size_t) s->counts[s->rank], nn = (size_t) n;
+    switch (op) {
+    case SVC_MATVEC:
+        return wbuf_get(&s->a, m * nn * sizeof(double) + 1) && wbuf_get(&s->x, nn * sizeof(double) + 1) &&
+               wbuf_get(&s->c, m * sizeof(double) + 1);
+    case SVC_MATMUL:
+        return wbuf_get(&s->a, m * nn * sizeof(double) + 1) && wbuf_get(&s->b, nn * nn * sizeof(double) + 1) &&
+               wbuf_get(&s->c, m * nn * sizeof(double) + 1);
+    case SVC_SORT:
+        return wbuf_get(&s->a, m * sizeof(long) + 1) != NULL;
+    default:
+        return 1;
+    }
+}
+
+/* ---- rank 0: socket side ---- */
+
+static int svc_listen(const char *path) {
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof addr.sun_path) {
+        fprintf(stderr, "mpisvcd: socket path too long: %s\n", path);
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("mpisvcd: socket");
+        return -1;
+    }
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);   /* stale socket of a previous run */
+    if (bind(fd, (struct sockaddr *) &addr, sizeof addr) != 0 || listen(fd, 16) != 0) {
+        perror("mpisvcd: bind/listen");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*
+ * Next runnable job: accept connections and read requests until one is
+ * complete, answering the ones that cannot run. Returns the op and sets *n;
+ * the input is in s->in.
+ */
+static int svc_next(svc_t *s, int lfd, long long *n) {
+    for (;;) {
+        if (s->fd < 0) {
+            s->fd = accept(lfd, NULL, NULL);
+            if (s->fd < 0) continue;
+        }
+        s->fd_ok = 1;
+        svc_req_t req;
+        if (svc_read(s->fd, &req, sizeof req) != 0) {   /* client done */
+            close(s->fd);
+            s->fd = -1;
+            continue;
+        }
+        uint64_t in = svc_in_bytes(req.op, req.n);
+        int bad = req.magic != SVC_MAGIC || req.op >= SVC_NOPS || req.n > SVC_MAX_N;
+        void *buf = bad ? NULL : wbuf_get(&s->in, in + 1);
+        if (bad || !buf || svc_read(s->fd, buf, in) != 0) {
+            if (bad || !buf) svc_reply(s, bad ? SVC_EBADREQ : SVC_ENOMEM, 0);
+            close(s->fd);
+            s->fd = -1;
+            continue;
+        }
+        *n = (long long) req.n;
+        return (int) req.op;
+    }
+}
+
+/* Non-root ranks: wait for the next job header without spinning a core */
+static void svc_wait(svc_t *s, long long job[2]) {
+    MPI_Request req;
+    MPI_Ibcast(job, 2, MPI_LONG_LONG, 0, s->comm, &req);
+    if (s->rank == 0) {
+        MPI_Wait(&req, MPI_STATUS_IGNORE);
+        return;
+    }
+    int flag = 0;
+    long us = 0;
+    for (long spins = 0;; spins++) {
+        MPI_Test(&req, &flag, MPI_STATUS_IGNORE);
+        if (flag) return;
+        if (spins < SVC_IDLE_SPINS) continue;
+        us = us ? (2 * us < SVC_IDLE_MAX_US ? 2 * us : SVC_IDLE_MAX_US) : 1;
+        struct timespec ts = { 0, us * 1000 };
+        nanosleep(&ts, NULL);
+    }
+}
+
+int main(int argc, char **argv) {
+    MPI_Init(&argc, &argv);
+    svc_t s = { .n = -1, .fd = -1 };
+    MPI_Comm_dup(MPI_COMM_WORLD, &s.comm);
+    MPI_Comm_rank(s.comm, &s.rank);
+    MPI_Comm_size(s.comm, &s.size);
+    s.counts = malloc(s.size * sizeof(int));
+    s.displs = malloc(s.size * sizeof(int));
+
+    int opt, verbose = 0;
+    const char *path = NULL;
+    while ((opt = getopt(argc, argv, "s:v")) != -1) {
+        switch (opt) {
+        case 's': path = optarg; break;
+        case 'v': verbose = 1; break;
+        default:
+            if (s.rank == 0) fprintf(stderr, "Usage: %s [-s socket] [-v]\n", argv[0]);
+            MPI_Finalize();
+            return 1;
+        }
+    }
+    path = svc_socket_path(path);
+
+    int lfd = -1, up;
+    if (s.rank == 0) {
+        signal(SIGPIPE, SIG_IGN);       /* a vanished client is a write error */
+        lfd = svc_listen(path);
+    }
+    up = lfd >= 0;
+    MPI_Bcast(&up, 1, MPI_INT, 0, s.comm);
+    if (!up) {
+        MPI_Finalize();
+        return 1;
+    }
+    if (s.rank == 0) {
+        printf("mpisvcd: %d ranks listening on %s\n", s.size, path);
+        fflush(stdout);
+    }
+
+    for (;;) {
+        long long job[2] = { SVC_SHUTDOWN, 0 };
+        double t0 = 0.0;
+        if (s.rank == 0) {
+            job[0] = svc_next(&s, lfd, &job[1]);
+            t0 = MPI_Wtime();
+        }
+        svc_wait(&s, job);
+        int op = (int) job[0], n = (int) job[1];
+        if (op == SVC_SHUTDOWN) {
+            if (s.rank == 0) {
+                svc_reply(&s, SVC_OK, 0);
+                double zero = 0.0;
+                svc_put(&s, &zero, sizeof zero);
+            }
+            break;
+        }
+
+        svc_layout(&s, n);
+        int ok = svc_reserve(&s, op, n), all_ok;
+        MPI_Allreduce(&ok, &all_ok, 1, MPI_INT, MPI_MIN, s.comm);
+        if (s.rank == 0) svc_reply(&s, all_ok ? SVC_OK : SVC_ENOMEM, all_ok ? svc_out_bytes(op, n) : 0);
+        if (!all_ok) continue;
+
+        switch (op) {
+        case SVC_MATVEC: job_matvec(&s, n); break;
+        case SVC_MATMUL: job_matmul(&s, n); break;
+        case SVC_SORT: job_sort(&s); break;
+        default: break;
+        }
+        if (s.rank == 0) {
+            double dt = MPI_Wtime() - t0;
+            svc_put(&s, &dt, sizeof dt);
+            s.jobs++;
+            s.busy += dt;
+            if (verbose) printf("mpisvcd: %s n=%d %.6f s%s\n", svc_op_name[op], n, dt, s.fd_ok ? "" : " (client gone)");
+        }
+    }
+
+    if (s.rank == 0) {
+        printf("mpisvcd: %ld jobs, %.3f s busy, shutting down\n", s.jobs, s.busy);
+        close(s.fd);
+        close(lfd);
+        unlink(path);
+    }
+    free(s.in.p);
+    free(s.a.p);
+    free(s.b.p);
+    free(s.c.p);
+    free(s.x.p);
+    free(s.tmp[0].p);
+    free(s.tmp[1].p);
+    free(s.counts);
+    free(s.displs);
+    if (s.n >= 0) MPI_Type_free(&s.rowtype);
+    MPI_Comm_free(&s.comm);
+    MPI_Finalize();
+    return 0;
+}
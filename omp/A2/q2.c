@@ -1,6 +1,8 @@
 #include <stdio.h>
 #include <omp.h>
 
+#include "../../common/repro_sum.h"
+
 int main() {
     long long int num_steps = 100000000;
     double step = 1.0 / (double)num_steps;
@@ -25,8 +27,28 @@ int main() {
 
     double end = omp_get_wtime();
 
-    printf("Calculated Pi = %.15f\n", pi);
+    // Reproducible: every term goes into an exact binned accumulator, the
+    // per-thread accumulators are merged by the rsum user reduction, and the
+    // total is rounded once, so the bits do not depend on the thread count
+    double rstart = omp_get_wtime();
+    rsum_t acc;
+    rsum_init(&acc);
+
+    #pragma omp parallel for reduction(rsum : acc)
+    for (int i = 0; i < num_steps; i++) {
+        double x = (i + 0.5) * step;
+        rsum_add(&acc, 4.0 / (1.0 + x * x));
+    }
+
+    double rpi = rsum_value(&acc) * step;
+    double rend = omp_get_wtime();
+
+    printf("Threads = %d\n", omp_get_max_threads());
+    printf("Calculated Pi = %.15f (%a)\n", pi, pi);
     printf("Time taken = %f seconds\n", end - start);
+    printf("Reproducible Pi = %.15f (%a)\n", rpi, rpi);
+    printf("Time taken = %f seconds (%.2fx the plain reduction)\n",
+           rend - rstart, (rend - rstart) / (end - start));
 
     return 0;
 }
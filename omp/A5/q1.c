@@ -1,10 +1,48 @@
 // mm_mult.c
+// Usage: ./mm_mult [N] [layout] [tile]
+//   layout 0 = row-major i-k-j loop (default)
+//          1 = tiled, 2 = Morton: blocked GEMM on contiguous T x T tiles
+//   tile   = tile edge T for layouts 1/2 (default 64)
+// Build: gcc -O2 -fopenmp -o mm_mult q1.c
 #include <stdio.h>
 #include <stdlib.h>
 #include <omp.h>
 
-int main() {
-    int N = 1024; // adjust for testing
+#include "../../common/matlayout.h"
+
+/* C_tile += A_tile * B_tile, all T x T row-major and contiguous */
+static void tile_gemm(size_t T, const double *A, const double *B, double *C) {
+    for (size_t i = 0; i < T; ++i) {
+        double *c = C + i * T;
+        for (size_t k = 0; k < T; ++k) {
+            double a = A[i * T + k];
+            const double *b = B + k * T;
+            #pragma omp simd
+            for (size_t j = 0; j < T; ++j) c[j] += a * b[j];
+        }
+    }
+}
+
+/* Blocked GEMM over tile storage: each thread owns whole C tiles */
+static void gemm_tiled(const mat_desc_t *d, double *A, double *B, double *C) {
+    size_t nt = d->nt;
+    #pragma omp parallel for collapse(2) schedule(static)
+    for (size_t ti = 0; ti < nt; ++ti)
+        for (size_t tj = 0; tj < nt; ++tj) {
+            double *c = mat_tile(d, C, ti, tj);
+            for (size_t tk = 0; tk < nt; ++tk)
+                tile_gemm(d->T, mat_tile(d, A, ti, tk), mat_tile(d, B, tk, tj), c);
+        }
+}
+
+int main(int argc, char **argv) {
+    int N = (argc > 1) ? atoi(argv[1]) : 1024; // adjust for testing
+    int layout = (argc > 2) ? atoi(argv[2]) : 0;
+    int tile = (argc > 3) ? atoi(argv[3]) : 64;
+    if (N < 1 || layout < 0 || layout > 2 || tile < 1) {
+        fprintf(stderr, "Usage: %s [N >= 1] [layout 0|1|2] [tile >= 1]\n", argv[0]);
+        return 1;
+    }
     double *A = malloc(N * N * sizeof(double));
     double *B = malloc(N * N * sizeof(double));
     double *C = malloc(N * N * sizeof(double));
@@ -12,20 +50,40 @@ int main() {
     // init
     for (int i=0;i<N*N;i++) { A[i]=1.0; B[i]=1.0; C[i]=0.0; }
 
-    double t0 = omp_get_wtime();
+    if (layout == 0) {
+        double t0 = omp_get_wtime();
 
-    #pragma omp parallel for schedule(static)
-    for (int i = 0; i < N; ++i) {
-        for (int k = 0; k < N; ++k) {
-            double a = A[i*N + k];
-            for (int j = 0; j < N; ++j) {
-                C[i*N + j] += a * B[k*N + j];
+        #pragma omp parallel for schedule(static)
+        for (int i = 0; i < N; ++i) {
+            for (int k = 0; k < N; ++k) {
+                double a = A[i*N + k];
+                for (int j = 0; j < N; ++j) {
+                    C[i*N + j] += a * B[k*N + j];
+                }
             }
         }
-    }
 
-    double t1 = omp_get_wtime();
-    printf("Time: %f sec\n", t1 - t0);
+        double t1 = omp_get_wtime();
+        printf("Time: %f sec\n", t1 - t0);
+    } else {
+        mat_desc_t d = mat_desc(layout == 2 ? MAT_MORTON : MAT_TILED, N, tile);
+        double *At = malloc(mat_elems(&d) * sizeof(double));
+        double *Bt = malloc(mat_elems(&d) * sizeof(double));
+        double *Ct = calloc(mat_elems(&d), sizeof(double));
+
+        double t0 = omp_get_wtime();
+        mat_pack(&d, A, N, At);
+        mat_pack(&d, B, N, Bt);
+        double t1 = omp_get_wtime();
+        gemm_tiled(&d, At, Bt, Ct);
+        double t2 = omp_get_wtime();
+        mat_unpack(&d, Ct, C, N);
+        double t3 = omp_get_wtime();
+
+        printf("Time: %f sec (%s, T=%d, convert %f sec)\n", t2 - t1,
+               layout == 2 ? "morton" : "tiled", tile, (t1 - t0) + (t3 - t2));
+        free(At); free(Bt); free(Ct);
+    }
 
     // checksum
     double sum = 0;
@@ -35,4 +93,3 @@ int main() {
     free(A); free(B); free(C);
     return 0;
 }
-
@@ -0,0 +1,87 @@
+// transpose.c
+// Bandwidth of the cache-oblivious transpose (common/transpose.h) against a
+// plain parallel copy and a naive transpose of the same matrix.
+//
+// Build: gcc -O2 -march=native -fopenmp -o transpose transpose.c
+// Run:   OMP_NUM_THREADS=8 ./transpose [N] [reps]
+//
+// Bandwidth counts one read and one write of the N x N matrix.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+
+#include "../../common/transpose.h"
+
+static double *alloc_doubles(size_t n) {
+    void *p = NULL;
+    if (posix_memalign(&p, 64, n * sizeof(double)) != 0) return NULL;
+    return (double *) p;
+}
+
+static void copy_par(const double *A, double *B, size_t n) {
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < n; i++)
+        memcpy(&B[i * n], &A[i * n], n * sizeof(double));
+}
+
+static void transpose_naive(const double *A, double *B, size_t n) {
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < n; i++)
+        for (size_t j = 0; j < n; j++)
+            B[j * n + i] = A[i * n + j];
+}
+
+static void report(const char *name, double t, size_t n) {
+    double gb = 2.0 * n * n * sizeof(double) / 1e9;
+    printf("%-18s %10.6f s  %8.2f GB/s\n", name, t, gb / t);
+}
+
+int main(int argc, char **argv) {
+    size_t n = (argc > 1) ? (size_t) atol(argv[1]) : 4096;
+    int reps = (argc > 2) ? atoi(argv[2]) : 5;
+
+    double *A = alloc_doubles(n * n);
+    double *B = alloc_doubles(n * n);
+    if (!A || !B) { fprintf(stderr, "alloc failed\n"); return 1; }
+
+    #pragma omp parallel for schedule(static)
+    for (size_t i = 0; i < n * n; i++) { A[i] = (double) i; B[i] = 0.0; }
+
+    double best_copy = 1e30, best_naive = 1e30, best_oop = 1e30, best_inp = 1e30;
+    for (int r = 0; r < reps; r++) {
+        double t0 = omp_get_wtime();
+        copy_par(A, B, n);
+        double t1 = omp_get_wtime();
+        transpose_naive(A, B, n);
+        double t2 = omp_get_wtime();
+        transpose_oop(A, n, B, n, n, n);
+        double t3 = omp_get_wtime();
+        transpose_inplace(A, n, n);
+        double t4 = omp_get_wtime();
+        transpose_inplace(A, n, n);   /* restore A for the next rep */
+
+        if (t1 - t0 < best_copy) best_copy = t1 - t0;
+        if (t2 - t1 < best_naive) best_naive = t2 - t1;
+        if (t3 - t2 < best_oop) best_oop = t3 - t2;
+        if (t4 - t3 < best_inp) best_inp = t4 - t3;
+    }
+
+    /* B holds A^T from the out-of-place run; A is back to its original */
+    size_t bad = 0;
+    for (size_t i = 0; i < n; i++)
+        for (size_t j = 0; j < n; j++) {
+            if (A[i * n + j] != (double) (i * n + j)) bad++;
+            if (B[j * n + i] != A[i * n + j]) bad++;
+        }
+
+    printf("N=%zu threads=%d reps=%d (best of)\n", n, omp_get_max_threads(), reps);
+    report("copy", best_copy, n);
+    report("naive transpose", best_naive, n);
+    report("oop transpose", best_oop, n);
+    report("in-place transpose", best_inp, n);
+    printf("check: %s\n", bad ? "FAILED" : "ok");
+
+    free(A); free(B);
+    return bad ? 1 : 0;
+}